@@ -0,0 +1,155 @@
+#include <QByteArray>
+#include <QElapsedTimer>
+#include <QString>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <utility>
+#include <vector>
+#include "FrameReader.h"
+
+using namespace std;
+
+/**
+ * Microbenchmark del decodificado de mensajes en el cliente.
+ *
+ * Compara, sobre los mismos mensajes, el camino anterior de MessageHandler
+ * (QByteArray → QString → QByteArray y luego mid() por campo) con el lector
+ * FrameReader, que lee los campos directo de los bytes recibidos.
+ *
+ * Uso: ./decode_bench [iteraciones]
+ */
+
+/**
+ * Agrega una cadena con su longitud de un byte (protocolo v1).
+ */
+void appendField(QByteArray& out, const string& text) {
+    out.append(static_cast<char>(text.size()));
+    out.append(text.data(), static_cast<int>(text.size()));
+}
+
+/**
+ * Construye un historial tipo 56 con `count` mensajes.
+ */
+QByteArray buildHistoryFrame(int count) {
+    QByteArray frame;
+    frame.append(static_cast<char>(56));
+    frame.append(static_cast<char>(count));
+    for (int i = 0; i < count; i++) {
+        appendField(frame, "usuario" + to_string(i % 7));
+        appendField(frame, "mensaje de prueba número " + to_string(i) + " con algo más de texto para el cuerpo");
+    }
+    return frame;
+}
+
+/**
+ * Construye un mensaje de chat tipo 55 (sin secuencia, como el formato original).
+ */
+QByteArray buildChatFrame() {
+    QByteArray frame;
+    frame.append(static_cast<char>(55));
+    appendField(frame, "usuario3");
+    appendField(frame, "hola, ¿cómo va todo por allá? aquí todo bien");
+    return frame;
+}
+
+/**
+ * Camino anterior: el mensaje binario se convertía a QString, se volvía a
+ * convertir a bytes y cada campo se copiaba con mid() a un QString.
+ */
+size_t decodeLegacy(const QByteArray& binary) {
+    QString message = QString::fromUtf8(binary);
+    QByteArray data = message.toUtf8();
+    quint8 type = static_cast<quint8>(data[0]);
+    size_t total = 0;
+
+    if (type == 55) {
+        quint8 usernameLen = static_cast<quint8>(data[1]);
+        QString username = QString::fromUtf8(data.mid(2, usernameLen));
+        quint8 messageLen = static_cast<quint8>(data[2 + usernameLen]);
+        QString content = QString::fromUtf8(data.mid(3 + usernameLen, messageLen));
+        total += username.size() + content.size();
+    } else if (type == 56) {
+        quint8 numMessages = static_cast<quint8>(data[1]);
+        int pos = 2;
+        vector<pair<string, string>> history;
+        for (quint8 i = 0; i < numMessages; i++) {
+            quint8 usernameLen = static_cast<quint8>(data[pos]);
+            QString username = QString::fromUtf8(data.mid(pos + 1, usernameLen));
+            pos += 1 + usernameLen;
+            quint8 messageLen = static_cast<quint8>(data[pos]);
+            QString content = QString::fromUtf8(data.mid(pos + 1, messageLen));
+            pos += 1 + messageLen;
+            history.emplace_back(username.toStdString(), content.toStdString());
+        }
+        total += history.size();
+    }
+    return total;
+}
+
+/**
+ * Camino nuevo: FrameReader sobre el mismo QByteArray. El historial se copia
+ * directo a std::string; el mensaje de chat se decodifica a QString porque
+ * se muestra en pantalla.
+ */
+size_t decodeReader(const QByteArray& data) {
+    FrameReader in(data, 1, 1);
+    quint8 type = static_cast<quint8>(data[0]);
+    size_t total = 0;
+
+    if (type == 55) {
+        QString username, content;
+        if (in.text(username) && in.text(content)) {
+            total += username.size() + content.size();
+        }
+    } else if (type == 56) {
+        quint32 numMessages = 0;
+        if (!in.count(numMessages)) return 0;
+        vector<pair<string, string>> history;
+        history.reserve(numMessages);
+        for (quint32 i = 0; i < numMessages; i++) {
+            string username, content;
+            if (!in.stdString(username) || !in.stdString(content)) break;
+            history.emplace_back(std::move(username), std::move(content));
+        }
+        total += history.size();
+    }
+    return total;
+}
+
+/**
+ * Mide cuántos mensajes por segundo decodifica una función.
+ */
+double framesPerSecond(size_t (*decode)(const QByteArray&), const QByteArray& frame, int iterations, size_t& sink) {
+    QElapsedTimer timer;
+    timer.start();
+    for (int i = 0; i < iterations; i++) {
+        sink += decode(frame);
+    }
+    qint64 ns = timer.nsecsElapsed();
+    return ns > 0 ? iterations * 1e9 / ns : 0;
+}
+
+/**
+ * Imprime la comparación para un tipo de mensaje.
+ */
+void report(const char* name, const QByteArray& frame, int iterations) {
+    size_t sink = 0;
+    framesPerSecond(decodeLegacy, frame, iterations / 10, sink);  // Calentamiento
+    framesPerSecond(decodeReader, frame, iterations / 10, sink);
+
+    double before = framesPerSecond(decodeLegacy, frame, iterations, sink);
+    double after = framesPerSecond(decodeReader, frame, iterations, sink);
+    cout << name << " (" << frame.size() << " bytes)\n"
+         << "  antes:   " << static_cast<long long>(before) << " mensajes/s\n"
+         << "  después: " << static_cast<long long>(after) << " mensajes/s\n"
+         << "  mejora:  x" << (before > 0 ? after / before : 0) << "  [" << sink << "]\n";
+}
+
+int main(int argc, char* argv[]) {
+    int iterations = argc > 1 ? atoi(argv[1]) : 200000;
+
+    report("Mensaje de chat (55)", buildChatFrame(), iterations);
+    report("Historial de 100 mensajes (56)", buildHistoryFrame(100), iterations / 50);
+    return 0;
+}
@@ -0,0 +1,13 @@
+QT -= gui
+QT += core
+CONFIG += console c++11
+CONFIG -= app_bundle
+
+INCLUDEPATH += ../../Client
+
+HEADERS += \
+    ../../Client/FrameReader.h
+
+SOURCES += \
+    decode_bench.cpp \
+    ../../Client/FrameReader.cpp
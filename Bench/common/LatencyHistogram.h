@@ -0,0 +1,72 @@
+#ifndef LATENCY_HISTOGRAM_H
+#define LATENCY_HISTOGRAM_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/**
+ * Histograma logarítmico-lineal de latencias en nanosegundos: 64 cubetas por
+ * potencia de dos (error menor al 1,6 %) y tamaño fijo sin importar cuántas
+ * muestras haya (con difusiones grandes hay millones).
+ */
+class LatencyHistogram {
+public:
+    static constexpr int SUB_BITS = 6;
+    static constexpr std::size_t BUCKETS = (64 - SUB_BITS) * (1u << SUB_BITS) + (1u << SUB_BITS);
+
+    LatencyHistogram() : counts(BUCKETS, 0) {}
+
+    void record(std::uint64_t ns) {
+        ++counts[index(ns)];
+        ++total;
+        maxValue = std::max(maxValue, ns);
+    }
+
+    void merge(const LatencyHistogram& other) {
+        for (std::size_t i = 0; i < BUCKETS; ++i) counts[i] += other.counts[i];
+        total += other.total;
+        maxValue = std::max(maxValue, other.maxValue);
+    }
+
+    std::uint64_t count() const { return total; }
+    std::uint64_t max() const { return maxValue; }
+
+    /**
+     * Valor bajo el que queda la fracción `p` de las muestras (límite
+     * superior de su cubeta).
+     */
+    std::uint64_t percentile(double p) const {
+        if (total == 0) return 0;
+        std::uint64_t rank = static_cast<std::uint64_t>(p * total);
+        if (rank >= total) rank = total - 1;
+        std::uint64_t seen = 0;
+        for (std::size_t i = 0; i < BUCKETS; ++i) {
+            seen += counts[i];
+            if (seen > rank) return std::min(upper(i), maxValue);
+        }
+        return maxValue;
+    }
+
+private:
+    static std::size_t index(std::uint64_t v) {
+        if (v < (2u << SUB_BITS)) return static_cast<std::size_t>(v);
+        int msb = 63 - __builtin_clzll(v);
+        std::uint64_t mantissa = v >> (msb - SUB_BITS);  // En [64, 128)
+        return static_cast<std::size_t>(msb - SUB_BITS + 1) * (1u << SUB_BITS) + (mantissa - (1u << SUB_BITS));
+    }
+
+    static std::uint64_t upper(std::size_t i) {
+        if (i < (2u << SUB_BITS)) return i;
+        int msb = static_cast<int>(i >> SUB_BITS) + SUB_BITS - 1;
+        std::uint64_t mantissa = (1u << SUB_BITS) + (i & ((1u << SUB_BITS) - 1));
+        return ((mantissa + 1) << (msb - SUB_BITS)) - 1;
+    }
+
+    std::vector<std::uint64_t> counts;
+    std::uint64_t total = 0;
+    std::uint64_t maxValue = 0;
+};
+
+#endif // LATENCY_HISTOGRAM_H
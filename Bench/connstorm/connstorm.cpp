@@ -0,0 +1,410 @@
+#include <boost/asio.hpp>
+#include <boost/beast/core.hpp>
+#include <boost/beast/websocket.hpp>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "LatencyHistogram.h"
+
+namespace beast = boost::beast;
+namespace websocket = beast::websocket;
+namespace net = boost::asio;
+using tcp = net::ip::tcp;
+using Clock = std::chrono::steady_clock;
+
+/**
+ * Mide cuántas conexiones por segundo acepta el servidor, como en una
+ * tormenta de reconexiones (ej. después de reiniciarlo, cuando todos los
+ * clientes reintentan a la vez).
+ *
+ * Cada ronda abre `conexiones` sesiones completas (TCP + handshake WebSocket
+ * con `?name=`, protocolo v2) con a lo más `concurrencia` handshakes en
+ * curso, las deja abiertas hasta que termina la ronda y luego las cierra. La
+ * primera ronda registra usuarios nuevos; las siguientes reconectan a los
+ * mismos usuarios, ya desconectados.
+ *
+ * Reporta por ronda las conexiones por segundo, p50/p99/p999 del tiempo de
+ * conexión (desde connect() hasta el 101 del servidor) y p50/p99 del tiempo
+ * hasta que el cliente tiene lo necesario para mostrar la interfaz (lista de
+ * usuarios y chat general):
+ * - `bienvenida` (por defecto): hasta que llega el estado inicial (tipo 62),
+ *   que el servidor envía solo al aceptar la conexión.
+ * - `solicitudes`: como el cliente sin estado inicial; pide la lista (tipo 8)
+ *   y la página más reciente del general (tipo 6) y espera ambas respuestas.
+ *
+ * Uso: ./connstorm [conexiones] [concurrencia] [rondas] [hilos] [host:puerto] [bienvenida|solicitudes]
+ */
+
+// Tiempo máximo de una conexión (TCP + handshake)
+constexpr auto CONNECT_TIMEOUT = std::chrono::seconds(30);
+// Pausa entre rondas, para que el servidor termine de registrar las desconexiones
+constexpr auto ROUND_PAUSE = std::chrono::milliseconds(500);
+// Tiempo máximo de espera del estado inicial una vez conectadas todas
+constexpr auto READY_TIMEOUT = std::chrono::seconds(10);
+// Mensajes de la página del chat general en modo `solicitudes` (como el cliente de Qt)
+constexpr unsigned char HISTORY_PAGE_SIZE = 50;
+
+struct Config {
+    int connections = 2000;
+    int concurrency = 256;     // Handshakes en curso a la vez
+    int rounds = 3;
+    int threads = static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+    std::string host = "127.0.0.1";
+    std::string port = "8080";
+    std::string prefix = "tormenta";
+    bool welcome = true;       // false: pedir lista e historial (modo `solicitudes`)
+};
+
+std::mutex outputMutex;
+
+/**
+ * Avisa de una conexión fallida; solo las primeras, para no inundar la salida.
+ */
+void report_failure(const std::string& name, const char* what, const beast::error_code& ec) {
+    static std::atomic<int> reported{0};
+    if (reported.fetch_add(1) < 5) {
+        std::lock_guard<std::mutex> lock(outputMutex);
+        std::cerr << "❌ " << name << ": " << what << ": " << ec.message() << "\n";
+    }
+}
+
+/**
+ * Lee un varint LEB128 (cantidades y longitudes del protocolo v2).
+ *
+ * @return false si el mensaje se termina antes de tiempo
+ */
+bool read_varint(const unsigned char*& pos, const unsigned char* end, std::uint64_t& value) {
+    value = 0;
+    for (int shift = 0; pos < end && shift < 64; shift += 7) {
+        unsigned char byte = *pos++;
+        value |= std::uint64_t(byte & 0x7f) << shift;
+        if (!(byte & 0x80)) return true;
+    }
+    return false;
+}
+
+/**
+ * Una conexión de la tormenta. Mientras está abierta lee lo que envíe el
+ * servidor (avisos de presencia, respuestas), para no llenar su cola, y
+ * anota cuándo llegó lo necesario para mostrar la interfaz.
+ */
+class Connection : public std::enable_shared_from_this<Connection> {
+public:
+    Connection(net::io_context& ioc, const Config& config, std::string name)
+        : ws(net::make_strand(ioc)), config(config), name(std::move(name)) {}
+
+    void connect(const tcp::resolver::results_type& endpoints);
+    void close();
+    net::any_io_executor get_executor() { return ws.get_executor(); }
+
+    std::uint64_t latencyNs = 0;             // Tiempo de conexión (si tuvo éxito)
+    std::uint64_t readyNs = 0;               // Tiempo hasta tener lista y chat general (si llegaron)
+    std::function<void(bool)> onConnected;   // Se llama una vez, al terminar el handshake (o fallar)
+    std::function<void()> onReady;           // Se llama una vez, al llegar lo necesario para la interfaz
+    std::function<void()> onClosed;          // Se llama una vez, al terminar close()
+
+private:
+    void on_connect(beast::error_code ec, const tcp::endpoint&);
+    void on_handshake(beast::error_code ec);
+    void do_read();
+    void send_requests(std::size_t next);
+    void on_frame(const unsigned char* data, std::size_t size);
+
+    websocket::stream<beast::tcp_stream> ws;
+    const Config& config;
+    std::string name;
+    beast::flat_buffer buffer;
+    Clock::time_point started;
+    bool open = false;
+    std::vector<std::vector<unsigned char>> requests;   // Solicitudes del modo `solicitudes`
+    bool gotRoster = false;                             // Llegó la lista (tipo 60)
+    bool gotHistory = false;                            // Llegó la página del general (tipo 57)
+};
+
+void Connection::connect(const tcp::resolver::results_type& endpoints) {
+    started = Clock::now();
+    beast::get_lowest_layer(ws).expires_after(CONNECT_TIMEOUT);
+    beast::get_lowest_layer(ws).async_connect(endpoints,
+        beast::bind_front_handler(&Connection::on_connect, shared_from_this()));
+}
+
+void Connection::on_connect(beast::error_code ec, const tcp::endpoint&) {
+    if (ec) {
+        report_failure(name, "no se pudo conectar", ec);
+        onConnected(false);
+        return;
+    }
+    // El servidor busca "Upgrade" con mayúscula, como lo envía el cliente de Qt
+    ws.set_option(websocket::stream_base::decorator([](websocket::request_type& req) {
+        req.set(beast::http::field::connection, "Upgrade");
+    }));
+    ws.async_handshake(config.host + ":" + config.port, "/?name=" + name + "&v=2",
+        beast::bind_front_handler(&Connection::on_handshake, shared_from_this()));
+}
+
+void Connection::on_handshake(beast::error_code ec) {
+    if (ec) {
+        report_failure(name, "handshake rechazado", ec);
+        onConnected(false);
+        return;
+    }
+    latencyNs = static_cast<std::uint64_t>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - started).count());
+    beast::get_lowest_layer(ws).expires_never();
+    ws.set_option(websocket::stream_base::timeout::suggested(beast::role_type::client));
+    ws.binary(true);
+    open = true;
+    if (!config.welcome) {
+        // [8, época 0]: lista completa; [6, "~", antes_de 0xFFFFFFFF, límite]: página más reciente
+        requests.push_back({8, 0, 0, 0, 0});
+        requests.push_back({6, 1, '~', 0xff, 0xff, 0xff, 0xff, HISTORY_PAGE_SIZE});
+        send_requests(0);
+    }
+    do_read();
+    onConnected(true);
+}
+
+/**
+ * Envía las solicitudes del modo `solicitudes`, una escritura a la vez.
+ */
+void Connection::send_requests(std::size_t next) {
+    if (next == requests.size()) return;
+    ws.async_write(net::buffer(requests[next]), [self = shared_from_this(), next](beast::error_code ec, std::size_t) {
+        if (!ec) self->send_requests(next + 1);
+    });
+}
+
+void Connection::do_read() {
+    ws.async_read(buffer, [self = shared_from_this()](beast::error_code ec, std::size_t) {
+        if (ec) return;
+        auto data = self->buffer.data();
+        self->on_frame(static_cast<const unsigned char*>(data.data()), data.size());
+        self->buffer.consume(self->buffer.size());
+        self->do_read();
+    });
+}
+
+/**
+ * Revisa un mensaje del servidor (y los de un grupo tipo 58) por si completa
+ * lo necesario para la interfaz.
+ */
+void Connection::on_frame(const unsigned char* data, std::size_t size) {
+    if (size == 0 || readyNs > 0 || !open) return;
+    if (data[0] == 58) {
+        const unsigned char* pos = data + 1;
+        const unsigned char* end = data + size;
+        std::uint64_t count = 0, length = 0;
+        if (!read_varint(pos, end, count)) return;
+        for (std::uint64_t i = 0; i < count && read_varint(pos, end, length) && length <= std::uint64_t(end - pos); ++i) {
+            on_frame(pos, length);
+            pos += length;
+        }
+        return;
+    }
+
+    if (config.welcome) {
+        if (data[0] != 62) return;
+    } else {
+        gotRoster = gotRoster || data[0] == 60;
+        gotHistory = gotHistory || data[0] == 57;
+        if (!gotRoster || !gotHistory) return;
+    }
+    readyNs = static_cast<std::uint64_t>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - started).count());
+    onReady();
+}
+
+/**
+ * Cierra la conexión (si llegó a abrirse) y avisa con onClosed.
+ */
+void Connection::close() {
+    if (!open) {
+        onClosed();
+        return;
+    }
+    open = false;
+    ws.async_close(websocket::close_code::normal, [self = shared_from_this()](beast::error_code) {
+        self->onClosed();
+    });
+}
+
+std::string millis(std::uint64_t ns) {
+    char text[32];
+    std::snprintf(text, sizeof(text), "%.3f", ns / 1e6);
+    return text;
+}
+
+/**
+ * Resultado de una ronda.
+ */
+struct RoundResult {
+    int connected = 0;
+    int failed = 0;
+    int notReady = 0;           // Conectadas que no recibieron la lista y el general a tiempo
+    double seconds = 0;
+    LatencyHistogram latency;
+    LatencyHistogram ready;     // Desde connect() hasta tener lista y chat general
+};
+
+/**
+ * Abre todas las conexiones con la ventana de concurrencia y espera a que
+ * terminen (con éxito o no) y a que las conectadas tengan lo necesario para
+ * la interfaz (a lo más READY_TIMEOUT); luego las cierra.
+ */
+RoundResult run_round(net::io_context& ioc, const Config& config, const tcp::resolver::results_type& endpoints) {
+    std::vector<std::shared_ptr<Connection>> connections;
+    connections.reserve(config.connections);
+    for (int i = 0; i < config.connections; ++i) {
+        connections.push_back(std::make_shared<Connection>(ioc, config, config.prefix + std::to_string(i)));
+    }
+
+    std::atomic<int> connected{0};
+    std::atomic<int> failed{0};
+    std::atomic<int> ready{0};
+    std::atomic<int> nextToConnect{0};
+    std::function<void()> connect_next = [&] {
+        int i = nextToConnect.fetch_add(1);
+        if (i < config.connections) connections[i]->connect(endpoints);
+    };
+    for (auto& connection : connections) {
+        connection->onConnected = [&](bool ok) {
+            (ok ? connected : failed).fetch_add(1);
+            connect_next();
+        };
+        connection->onReady = [&ready] { ready.fetch_add(1); };
+    }
+
+    Clock::time_point start = Clock::now();
+    for (int i = 0; i < std::min(config.concurrency, config.connections); ++i) connect_next();
+    while (connected + failed < config.connections) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+
+    RoundResult result;
+    result.seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    result.connected = connected;
+    result.failed = failed;
+
+    Clock::time_point readyDeadline = Clock::now() + READY_TIMEOUT;
+    while (ready < result.connected && Clock::now() < readyDeadline) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    result.notReady = result.connected - ready;
+    for (const auto& connection : connections) {
+        if (connection->latencyNs > 0) result.latency.record(connection->latencyNs);
+    }
+
+    // readyNs se lee en el strand de cada conexión, junto con el cierre: a
+    // partir de ahí un mensaje tardío ya no cuenta
+    std::vector<std::uint64_t> readyTimes(connections.size());
+    std::atomic<int> closed{0};
+    for (std::size_t i = 0; i < connections.size(); ++i) {
+        auto& connection = connections[i];
+        connection->onClosed = [&closed] { closed.fetch_add(1); };
+        net::post(connection->get_executor(), [connection, &readyTimes, i] {
+            connection->onReady = [] {};
+            readyTimes[i] = connection->readyNs;
+            connection->close();
+        });
+    }
+    while (closed < config.connections) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+    for (std::uint64_t ns : readyTimes) {
+        if (ns > 0) result.ready.record(ns);
+    }
+    return result;
+}
+
+int main(int argc, char* argv[]) {
+    Config config;
+    if (argc > 1) config.connections = std::max(1, std::atoi(argv[1]));
+    if (argc > 2) config.concurrency = std::max(1, std::atoi(argv[2]));
+    if (argc > 3) config.rounds = std::max(1, std::atoi(argv[3]));
+    if (argc > 4) config.threads = std::max(1, std::atoi(argv[4]));
+    if (argc > 5) {
+        std::string address = argv[5];
+        std::size_t colon = address.rfind(':');
+        config.host = address.substr(0, colon);
+        if (colon != std::string::npos) config.port = address.substr(colon + 1);
+    }
+    if (argc > 6) {
+        std::string mode = argv[6];
+        if (mode != "bienvenida" && mode != "solicitudes") {
+            std::cerr << "❌ Modo desconocido: " << mode << " (bienvenida o solicitudes)\n";
+            return 1;
+        }
+        config.welcome = mode == "bienvenida";
+    }
+
+    net::io_context ioc;
+    auto work = net::make_work_guard(ioc);
+    std::vector<std::thread> threads;
+    for (int i = 0; i < config.threads; ++i) {
+        threads.emplace_back([&ioc] { ioc.run(); });
+    }
+    auto stop = [&] {
+        work.reset();
+        ioc.stop();
+        for (auto& thread : threads) thread.join();
+    };
+
+    tcp::resolver resolver(ioc);
+    beast::error_code ec;
+    auto endpoints = resolver.resolve(config.host, config.port, ec);
+    if (ec) {
+        std::cerr << "❌ No se pudo resolver " << config.host << ":" << config.port << ": " << ec.message() << "\n";
+        stop();
+        return 1;
+    }
+
+    std::cout << "🌪️ " << config.rounds << " rondas de " << config.connections << " conexiones a "
+              << config.host << ":" << config.port << " (" << config.concurrency << " a la vez, "
+              << config.threads << " hilos, modo " << (config.welcome ? "bienvenida" : "solicitudes") << ")\n\n";
+    std::printf("  %-8s %10s %8s %12s %10s %10s %10s %10s %12s %12s %9s\n", "ronda", "conectadas", "fallas",
+                "conexiones/s", "p50 ms", "p99 ms", "p999 ms", "máx ms", "p50 listo", "p99 listo", "sin listo");
+
+    bool anyFailed = false;
+    LatencyHistogram total;
+    LatencyHistogram totalReady;
+    int totalConnected = 0;
+    double totalSeconds = 0;
+    for (int round = 1; round <= config.rounds; ++round) {
+        if (round > 1) std::this_thread::sleep_for(ROUND_PAUSE);
+        RoundResult result = run_round(ioc, config, endpoints);
+        anyFailed = anyFailed || result.failed > 0 || result.notReady > 0;
+        total.merge(result.latency);
+        totalReady.merge(result.ready);
+        totalConnected += result.connected;
+        totalSeconds += result.seconds;
+
+        std::string label = std::to_string(round) + (round == 1 ? " (nuevos)" : "");
+        std::printf("  %-8s %10d %8d %12.0f %10s %10s %10s %10s %12s %12s %9d\n", label.c_str(), result.connected,
+                    result.failed, result.connected / result.seconds, millis(result.latency.percentile(0.50)).c_str(),
+                    millis(result.latency.percentile(0.99)).c_str(), millis(result.latency.percentile(0.999)).c_str(),
+                    millis(result.latency.max()).c_str(), millis(result.ready.percentile(0.50)).c_str(),
+                    millis(result.ready.percentile(0.99)).c_str(), result.notReady);
+        std::fflush(stdout);
+    }
+
+    if (config.rounds > 1) {
+        std::printf("  %-8s %10d %8s %12.0f %10s %10s %10s %10s %12s %12s\n", "total", totalConnected, "",
+                    totalConnected / totalSeconds, millis(total.percentile(0.50)).c_str(),
+                    millis(total.percentile(0.99)).c_str(), millis(total.percentile(0.999)).c_str(),
+                    millis(total.max()).c_str(), millis(totalReady.percentile(0.50)).c_str(),
+                    millis(totalReady.percentile(0.99)).c_str());
+    }
+
+    stop();
+    return anyFailed ? 2 : 0;
+}
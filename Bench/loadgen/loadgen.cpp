@@ -0,0 +1,675 @@
+#include <boost/asio.hpp>
+#include <boost/beast/core.hpp>
+#include <boost/beast/websocket.hpp>
+#include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <dirent.h>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+#include "LatencyHistogram.h"
+#include "Protocol.h"
+
+namespace beast = boost::beast;
+namespace websocket = beast::websocket;
+namespace net = boost::asio;
+using tcp = net::ip::tcp;
+using Clock = std::chrono::steady_clock;
+
+/**
+ * Generador de carga para el servidor de chat.
+ *
+ * Abre `usuarios` conexiones WebSocket (handshake `?name=`, protocolo v2) y
+ * cada usuario envía solicitudes a ritmo fijo (lazo abierto: el ritmo no
+ * depende de cuánto tarde el servidor) elegidas al azar según la mezcla:
+ *
+ *   general    tipo 4 al chat general "~"
+ *   privado    tipo 4 a otro usuario de la carga
+ *   estado     tipo 3 (siempre a Activo, para no cambiar lo que recibe el usuario)
+ *   historial  tipo 5 del chat general
+ *   lista      tipo 1
+ *   info       tipo 2 de otro usuario
+ *
+ * Latencias (desde el momento en que tocaba enviar la solicitud, así un
+ * servidor lento no esconde su demora retrasando los envíos):
+ *   - por operación: hasta la respuesta al propio usuario (para los mensajes
+ *     de chat, la copia que el servidor le devuelve al emisor);
+ *   - entrega: de punta a punta, hasta que el mensaje llega a cada
+ *     destinatario (el cuerpo lleva el emisor y la hora de envío).
+ *
+ * Al final reporta el rendimiento, p50/p99/p999 de cada serie y el RSS del
+ * servidor (antes de conectar, con todos conectados y el máximo).
+ *
+ * Uso: ./loadgen [usuarios] [ops_por_seg] [segundos] [mezcla] [hilos] [host:puerto] [pid_servidor]
+ *   mezcla: pesos por operación, ej. "general=1,privado=6,estado=1,historial=1,lista=1,info=0"
+ *   pid_servidor: si no se indica, se busca un proceso llamado "server"
+ */
+
+// Operaciones de la mezcla
+enum Op { OpGeneral, OpPrivate, OpState, OpHistory, OpList, OpInfo, OP_COUNT };
+const char* const OP_NAMES[OP_COUNT] = {"general", "privado", "estado", "historial", "lista", "info"};
+
+// Series de latencia: una por operación y dos de entrega
+enum Series { DeliveryGeneral = OP_COUNT, DeliveryPrivate, SERIES_COUNT };
+const char* const SERIES_NAMES[SERIES_COUNT] = {
+    "general", "privado", "estado", "historial", "lista", "info", "entrega general", "entrega privado"};
+
+// Tiempo para terminar de recibir respuestas después de dejar de enviar
+constexpr auto DRAIN_TIME = std::chrono::seconds(2);
+// Conexiones que se abren a la vez durante el arranque
+constexpr int CONNECT_WINDOW = 64;
+
+struct Config {
+    int users = 100;
+    double rate = 1000;        // Solicitudes por segundo entre todos los usuarios
+    int seconds = 10;
+    int weights[OP_COUNT] = {1, 6, 1, 1, 1, 0};
+    int threads = static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+    std::string host = "127.0.0.1";
+    std::string port = "8080";
+    long serverPid = 0;
+    std::string prefix = "carga";
+    std::size_t bodySize = 64; // Bytes del cuerpo de cada mensaje de chat
+};
+
+/**
+ * Contadores de un hilo del generador. Cada hilo escribe solo en los suyos;
+ * se suman al final, con los hilos ya detenidos.
+ */
+struct ThreadStats {
+    LatencyHistogram latency[SERIES_COUNT];
+    std::uint64_t sent[OP_COUNT] = {};
+    std::uint64_t framesReceived = 0;
+    std::uint64_t bytesReceived = 0;
+    std::uint64_t errors = 0;        // Respuestas tipo 50
+    std::uint64_t throttled = 0;     // De ellas, avisos de límite de tasa (código 5)
+};
+
+std::mutex statsMutex;
+std::vector<std::unique_ptr<ThreadStats>> allStats;
+
+/**
+ * Contadores del hilo actual (se registran en el primer uso).
+ */
+ThreadStats& thread_stats() {
+    thread_local ThreadStats* stats = [] {
+        std::lock_guard<std::mutex> lock(statsMutex);
+        allStats.push_back(std::make_unique<ThreadStats>());
+        return allStats.back().get();
+    }();
+    return *stats;
+}
+
+std::atomic<int> connectedUsers{0};
+std::atomic<int> failedUsers{0};
+std::atomic<std::uint64_t> unanswered{0};   // Solicitudes sin respuesta al cerrar
+
+/**
+ * Nanosegundos del reloj monótono (los comparten todos los hilos del proceso).
+ */
+std::uint64_t now_ns() {
+    return static_cast<std::uint64_t>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now().time_since_epoch()).count());
+}
+
+/**
+ * Avisa de una conexión fallida; solo las primeras, para no inundar la salida.
+ */
+void report_failure(const std::string& name, const char* what, const beast::error_code& ec) {
+    static std::atomic<int> reported{0};
+    if (reported.fetch_add(1) < 5) {
+        std::lock_guard<std::mutex> lock(statsMutex);
+        std::cerr << "❌ " << name << ": " << what << ": " << ec.message() << "\n";
+    }
+}
+
+/**
+ * Un usuario simulado con su propia conexión y strand.
+ */
+class Client : public std::enable_shared_from_this<Client> {
+public:
+    Client(net::io_context& ioc, const Config& config, int index)
+        : ws(net::make_strand(ioc)), timer(ws.get_executor()), config(config), index(index),
+          name(config.prefix + std::to_string(index)), random(static_cast<unsigned>(index) * 7919u + 1),
+          pick(config.weights, config.weights + OP_COUNT), peer(0, config.users - 1) {}
+
+    void connect(const tcp::resolver::results_type& endpoints);
+    void begin(Clock::time_point start, Clock::duration interval, Clock::time_point stop);
+    void close();
+    net::any_io_executor get_executor() { return ws.get_executor(); }
+
+    std::function<void(bool)> onConnected;   // Se llama una vez, al terminar el handshake (o fallar)
+
+private:
+    void on_connect(beast::error_code ec, const tcp::endpoint&);
+    void on_handshake(beast::error_code ec);
+    void do_read();
+    void on_read(beast::error_code ec, std::size_t bytes);
+    void on_timer(beast::error_code ec);
+    void send_op(int op, std::uint64_t stamp);
+    void queue(std::vector<unsigned char> frame);
+    void do_write();
+    void on_write(beast::error_code ec, std::size_t);
+    void handle_frame(const unsigned char* data, std::size_t size);
+    void answered(int op);
+    int other_user();
+
+    websocket::stream<beast::tcp_stream> ws;
+    net::steady_timer timer;
+    const Config& config;
+    int index;
+    std::string name;
+    beast::flat_buffer buffer;
+    std::deque<std::vector<unsigned char>> outbox;
+    bool writing = false;
+    bool open = false;
+    bool sending = false;
+    Clock::time_point next;
+    Clock::duration interval{};
+    Clock::time_point stopAt;
+    std::deque<std::uint64_t> pending[OP_COUNT];   // Hora de envío de las solicitudes sin respuesta
+    std::mt19937 random;
+    std::discrete_distribution<int> pick;
+    std::uniform_int_distribution<int> peer;
+};
+
+/**
+ * Abre la conexión TCP y hace el handshake WebSocket.
+ */
+void Client::connect(const tcp::resolver::results_type& endpoints) {
+    beast::get_lowest_layer(ws).expires_after(std::chrono::seconds(30));
+    beast::get_lowest_layer(ws).async_connect(endpoints,
+        beast::bind_front_handler(&Client::on_connect, shared_from_this()));
+}
+
+void Client::on_connect(beast::error_code ec, const tcp::endpoint&) {
+    if (ec) {
+        report_failure(name, "no se pudo conectar", ec);
+        onConnected(false);
+        return;
+    }
+    beast::get_lowest_layer(ws).socket().set_option(tcp::no_delay(true));
+    // El servidor busca "Upgrade" con mayúscula, como lo envía el cliente de Qt
+    ws.set_option(websocket::stream_base::decorator([](websocket::request_type& req) {
+        req.set(beast::http::field::connection, "Upgrade");
+    }));
+    ws.async_handshake(config.host + ":" + config.port, "/?name=" + name + "&v=2",
+        beast::bind_front_handler(&Client::on_handshake, shared_from_this()));
+}
+
+void Client::on_handshake(beast::error_code ec) {
+    if (ec) {
+        report_failure(name, "handshake rechazado", ec);
+        onConnected(false);
+        return;
+    }
+    beast::get_lowest_layer(ws).expires_never();
+    ws.set_option(websocket::stream_base::timeout::suggested(beast::role_type::client));
+    ws.binary(true);
+    open = true;
+    do_read();
+    onConnected(true);
+}
+
+/**
+ * Empieza a enviar solicitudes cada `interval` desde `start` hasta `stop`.
+ */
+void Client::begin(Clock::time_point start, Clock::duration every, Clock::time_point stop) {
+    if (!open) return;
+    sending = true;
+    next = start;
+    interval = every;
+    stopAt = stop;
+    timer.expires_at(next);
+    timer.async_wait(beast::bind_front_handler(&Client::on_timer, shared_from_this()));
+}
+
+void Client::on_timer(beast::error_code ec) {
+    if (ec || !open) return;
+
+    // Si el generador se atrasa, envía lo que debía sin esperar; cada
+    // solicitud lleva la hora en que tocaba
+    Clock::time_point now = Clock::now();
+    while (next <= now && next < stopAt) {
+        std::uint64_t stamp = static_cast<std::uint64_t>(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(next.time_since_epoch()).count());
+        send_op(pick(random), stamp);
+        next += interval;
+    }
+    if (next >= stopAt) {
+        sending = false;
+        return;
+    }
+    timer.expires_at(next);
+    timer.async_wait(beast::bind_front_handler(&Client::on_timer, shared_from_this()));
+}
+
+/**
+ * Otro usuario de la carga (o el mismo si solo hay uno).
+ */
+int Client::other_user() {
+    if (config.users == 1) return index;
+    int other = peer(random);
+    return other == index ? (other + 1) % config.users : other;
+}
+
+/**
+ * Arma y encola una solicitud.
+ *
+ * @param op Operación de la mezcla
+ * @param stamp Hora (ns) en que tocaba enviarla
+ */
+void Client::send_op(int op, std::uint64_t stamp) {
+    FrameWriter out(PROTOCOL_V2);
+    switch (op) {
+        case OpGeneral:
+        case OpPrivate: {
+            // Cuerpo: "#emisor#hora#" y relleno hasta bodySize
+            std::string body = "#" + std::to_string(index) + "#" + std::to_string(stamp) + "#";
+            if (body.size() < config.bodySize) body.append(config.bodySize - body.size(), 'x');
+            out.u8(4);
+            out.str(op == OpGeneral ? std::string("~") : config.prefix + std::to_string(other_user()));
+            out.str(body);
+            break;
+        }
+        case OpState:
+            out.u8(3);
+            out.str(name);
+            out.u8(1);  // Activo
+            pending[op].push_back(stamp);
+            break;
+        case OpHistory:
+            out.u8(5);
+            out.str("~");
+            pending[op].push_back(stamp);
+            break;
+        case OpList:
+            out.u8(1);
+            pending[op].push_back(stamp);
+            break;
+        case OpInfo:
+            out.u8(2);
+            out.str(config.prefix + std::to_string(other_user()));
+            pending[op].push_back(stamp);
+            break;
+    }
+    ++thread_stats().sent[op];
+    queue(out.take());
+}
+
+void Client::queue(std::vector<unsigned char> frame) {
+    outbox.push_back(std::move(frame));
+    if (!writing) do_write();
+}
+
+void Client::do_write() {
+    writing = true;
+    ws.async_write(net::buffer(outbox.front()), beast::bind_front_handler(&Client::on_write, shared_from_this()));
+}
+
+void Client::on_write(beast::error_code ec, std::size_t) {
+    writing = false;
+    if (ec) {
+        outbox.clear();
+        return;
+    }
+    outbox.pop_front();
+    if (!outbox.empty()) do_write();
+}
+
+void Client::do_read() {
+    ws.async_read(buffer, beast::bind_front_handler(&Client::on_read, shared_from_this()));
+}
+
+void Client::on_read(beast::error_code ec, std::size_t bytes) {
+    if (ec) {
+        open = false;
+        timer.cancel();
+        for (auto& queue : pending) {
+            unanswered += queue.size();
+            queue.clear();
+        }
+        return;
+    }
+    ThreadStats& stats = thread_stats();
+    ++stats.framesReceived;
+    stats.bytesReceived += bytes;
+    handle_frame(static_cast<const unsigned char*>(buffer.data().data()), buffer.size());
+    buffer.consume(buffer.size());
+    do_read();
+}
+
+/**
+ * Registra la respuesta a la solicitud más antigua pendiente de una operación.
+ */
+void Client::answered(int op) {
+    if (pending[op].empty()) return;
+    thread_stats().latency[op].record(now_ns() - pending[op].front());
+    pending[op].pop_front();
+}
+
+/**
+ * Identifica un mensaje recibido y registra su latencia si corresponde.
+ */
+void Client::handle_frame(const unsigned char* data, std::size_t size) {
+    if (size == 0) return;
+    FrameReader in(data + 1, size - 1, PROTOCOL_V2);
+    switch (data[0]) {
+        case 50: {
+            std::uint8_t code = 0;
+            in.u8(code);
+            ++thread_stats().errors;
+            if (code == 5) ++thread_stats().throttled;
+            break;
+        }
+        case 51:
+            answered(OpList);
+            break;
+        case 52:
+            answered(OpInfo);
+            break;
+        case 54: {
+            std::string_view user;
+            if (in.str(user) && user == name) answered(OpState);
+            break;
+        }
+        case 55: {
+            std::string_view sender, body;
+            if (!in.str(sender) || !in.str(body)) break;
+            bool general = sender == "~";
+
+            // "#emisor#hora#..." (en el general, precedido por "nombre: ")
+            std::size_t start = body.find('#');
+            if (start == std::string_view::npos) break;
+            int origin = -1;
+            std::uint64_t stamp = 0;
+            const char* pos = body.data() + start + 1;
+            const char* end = body.data() + body.size();
+            auto first = std::from_chars(pos, end, origin);
+            if (first.ec != std::errc() || first.ptr == end || *first.ptr != '#') break;
+            if (std::from_chars(first.ptr + 1, end, stamp).ec != std::errc()) break;
+
+            std::uint64_t latency = now_ns() - stamp;
+            if (origin == index) {
+                thread_stats().latency[general ? OpGeneral : OpPrivate].record(latency);
+            } else {
+                thread_stats().latency[general ? DeliveryGeneral : DeliveryPrivate].record(latency);
+            }
+            break;
+        }
+        case 56:
+            answered(OpHistory);
+            break;
+        case 58: {
+            // Varios mensajes agrupados: [58, cantidad, [longitud, mensaje], ...]
+            std::size_t count = 0;
+            if (!in.count(count)) break;
+            for (std::size_t i = 0; i < count; ++i) {
+                std::string_view message;
+                if (!in.str(message)) break;
+                handle_frame(reinterpret_cast<const unsigned char*>(message.data()), message.size());
+            }
+            break;
+        }
+        default:
+            break;
+    }
+}
+
+/**
+ * Cierra la conexión; lo que siga pendiente se cuenta como sin respuesta.
+ */
+void Client::close() {
+    timer.cancel();
+    if (!open) return;
+    ws.async_close(websocket::close_code::normal, [self = shared_from_this()](beast::error_code) {});
+}
+
+/**
+ * RSS de un proceso en bytes (0 si no se puede leer).
+ */
+std::uint64_t read_rss(long pid) {
+    if (pid <= 0) return 0;
+    std::ifstream status("/proc/" + std::to_string(pid) + "/status");
+    std::string line;
+    while (std::getline(status, line)) {
+        if (line.compare(0, 6, "VmRSS:") == 0) {
+            return std::strtoull(line.c_str() + 6, nullptr, 10) * 1024;
+        }
+    }
+    return 0;
+}
+
+/**
+ * Busca el PID de un proceso por su nombre (el primero que aparezca).
+ */
+long find_process(const std::string& name) {
+    DIR* proc = opendir("/proc");
+    if (!proc) return 0;
+    long found = 0;
+    while (dirent* entry = readdir(proc)) {
+        char* end = nullptr;
+        long pid = std::strtol(entry->d_name, &end, 10);
+        if (pid <= 0 || *end != '\0') continue;
+        std::ifstream comm("/proc/" + std::string(entry->d_name) + "/comm");
+        std::string command;
+        if (std::getline(comm, command) && command == name) {
+            found = pid;
+            break;
+        }
+    }
+    closedir(proc);
+    return found;
+}
+
+/**
+ * Lee la mezcla "general=1,privado=6,...". Las operaciones que no aparecen
+ * quedan con peso 0.
+ *
+ * @return false si hay una operación desconocida o ningún peso positivo
+ */
+bool parse_mix(const std::string& text, int (&weights)[OP_COUNT]) {
+    int parsed[OP_COUNT] = {};
+    std::size_t pos = 0;
+    while (pos < text.size()) {
+        std::size_t end = text.find(',', pos);
+        if (end == std::string::npos) end = text.size();
+        std::string item = text.substr(pos, end - pos);
+        std::size_t eq = item.find('=');
+        if (eq == std::string::npos) return false;
+        std::string opName = item.substr(0, eq);
+        int op = 0;
+        while (op < OP_COUNT && opName != OP_NAMES[op]) ++op;
+        if (op == OP_COUNT) return false;
+        parsed[op] = std::max(0, std::atoi(item.c_str() + eq + 1));
+        pos = end + 1;
+    }
+    if (std::all_of(parsed, parsed + OP_COUNT, [](int w) { return w == 0; })) return false;
+    std::copy(parsed, parsed + OP_COUNT, weights);
+    return true;
+}
+
+std::string megabytes(std::uint64_t bytes) {
+    char text[32];
+    std::snprintf(text, sizeof(text), "%.1f MB", bytes / (1024.0 * 1024.0));
+    return text;
+}
+
+std::string millis(std::uint64_t ns) {
+    char text[32];
+    std::snprintf(text, sizeof(text), "%.3f", ns / 1e6);
+    return text;
+}
+
+int main(int argc, char* argv[]) {
+    Config config;
+    if (argc > 1) config.users = std::max(1, std::atoi(argv[1]));
+    if (argc > 2) config.rate = std::atof(argv[2]);
+    if (argc > 3) config.seconds = std::max(1, std::atoi(argv[3]));
+    if (argc > 4 && !parse_mix(argv[4], config.weights)) {
+        std::cerr << "❌ Mezcla inválida: " << argv[4] << " (ej. general=1,privado=6,estado=1,historial=1,lista=1,info=0)\n";
+        return 1;
+    }
+    if (argc > 5) config.threads = std::max(1, std::atoi(argv[5]));
+    if (argc > 6) {
+        std::string address = argv[6];
+        std::size_t colon = address.rfind(':');
+        config.host = address.substr(0, colon);
+        if (colon != std::string::npos) config.port = address.substr(colon + 1);
+    }
+    config.serverPid = argc > 7 ? std::atol(argv[7]) : find_process("server");
+    if (config.rate <= 0) {
+        std::cerr << "❌ ops_por_seg debe ser mayor que 0\n";
+        return 1;
+    }
+
+    net::io_context ioc;
+    auto work = net::make_work_guard(ioc);
+    std::vector<std::thread> threads;
+    for (int i = 0; i < config.threads; ++i) {
+        threads.emplace_back([&ioc] { ioc.run(); });
+    }
+
+    tcp::resolver resolver(ioc);
+    beast::error_code ec;
+    auto endpoints = resolver.resolve(config.host, config.port, ec);
+    if (ec) {
+        std::cerr << "❌ No se pudo resolver " << config.host << ":" << config.port << ": " << ec.message() << "\n";
+        work.reset();
+        ioc.stop();
+        for (auto& thread : threads) thread.join();
+        return 1;
+    }
+
+    std::uint64_t rssIdle = read_rss(config.serverPid);
+    std::cout << "🔌 Conectando " << config.users << " usuarios a " << config.host << ":" << config.port
+              << " (" << config.threads << " hilos)\n";
+
+    // Conectar con una ventana de CONNECT_WINDOW handshakes a la vez
+    std::vector<std::shared_ptr<Client>> clients;
+    clients.reserve(config.users);
+    for (int i = 0; i < config.users; ++i) {
+        clients.push_back(std::make_shared<Client>(ioc, config, i));
+    }
+    std::atomic<int> nextToConnect{0};
+    std::function<void()> connect_next = [&] {
+        int i = nextToConnect.fetch_add(1);
+        if (i < config.users) clients[i]->connect(endpoints);
+    };
+    for (auto& client : clients) {
+        client->onConnected = [&](bool ok) {
+            (ok ? connectedUsers : failedUsers).fetch_add(1);
+            connect_next();
+        };
+    }
+    Clock::time_point connectStart = Clock::now();
+    for (int i = 0; i < std::min(CONNECT_WINDOW, config.users); ++i) connect_next();
+    while (connectedUsers + failedUsers < config.users) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    double connectSeconds = std::chrono::duration<double>(Clock::now() - connectStart).count();
+    std::cout << "✅ " << connectedUsers << " conectados en " << connectSeconds << " s";
+    if (failedUsers > 0) std::cout << " (" << failedUsers << " fallaron)";
+    std::cout << "\n";
+    if (connectedUsers == 0) {
+        work.reset();
+        ioc.stop();
+        for (auto& thread : threads) thread.join();
+        return 1;
+    }
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(500));  // Que lleguen los avisos de usuario nuevo
+    std::uint64_t rssConnected = read_rss(config.serverPid);
+    std::uint64_t rssPeak = rssConnected;
+
+    // Cada usuario envía cada users/rate segundos; los inicios se reparten en el primer intervalo
+    auto interval = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(config.users / config.rate));
+    Clock::time_point start = Clock::now() + std::chrono::milliseconds(100);
+    Clock::time_point stop = start + std::chrono::seconds(config.seconds);
+    for (int i = 0; i < config.users; ++i) {
+        auto offset = interval * i / config.users;
+        net::post(clients[i]->get_executor(), [client = clients[i], begin = start + offset, interval, stop] {
+            client->begin(begin, interval, stop);
+        });
+    }
+    std::cout << "🚀 Enviando " << config.rate << " solicitudes/s durante " << config.seconds << " s\n";
+
+    while (Clock::now() < stop + DRAIN_TIME) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(250));
+        rssPeak = std::max(rssPeak, read_rss(config.serverPid));
+    }
+    std::uint64_t rssEnd = read_rss(config.serverPid);
+
+    for (auto& client : clients) {
+        net::post(client->get_executor(), [client] { client->close(); });
+    }
+    std::this_thread::sleep_for(std::chrono::seconds(1));
+    work.reset();
+    ioc.stop();
+    for (auto& thread : threads) thread.join();
+
+    // Sumar los contadores de todos los hilos
+    ThreadStats total;
+    for (const auto& stats : allStats) {
+        for (int s = 0; s < SERIES_COUNT; ++s) total.latency[s].merge(stats->latency[s]);
+        for (int op = 0; op < OP_COUNT; ++op) total.sent[op] += stats->sent[op];
+        total.framesReceived += stats->framesReceived;
+        total.bytesReceived += stats->bytesReceived;
+        total.errors += stats->errors;
+        total.throttled += stats->throttled;
+    }
+
+    double seconds = config.seconds;
+    std::uint64_t sentTotal = 0;
+    for (int op = 0; op < OP_COUNT; ++op) sentTotal += total.sent[op];
+
+    std::cout << "\n📊 Rendimiento (" << config.seconds << " s)\n"
+              << "  solicitudes enviadas: " << sentTotal << " (" << static_cast<long long>(sentTotal / seconds) << "/s)\n";
+    for (int op = 0; op < OP_COUNT; ++op) {
+        if (total.sent[op] == 0) continue;
+        std::cout << "    " << OP_NAMES[op] << ": " << total.sent[op] << "\n";
+    }
+    std::cout << "  mensajes recibidos: " << total.framesReceived << " ("
+              << static_cast<long long>(total.framesReceived / seconds) << "/s, "
+              << megabytes(static_cast<std::uint64_t>(total.bytesReceived / seconds)) << "/s)\n"
+              << "  errores (tipo 50): " << total.errors << " (" << total.throttled << " por límite de tasa)\n"
+              << "  sin respuesta al cerrar: " << unanswered.load() << "\n";
+
+    std::cout << "\n⏱️ Latencia (ms)\n";
+    std::printf("  %-16s %10s %10s %10s %10s %10s\n", "serie", "muestras", "p50", "p99", "p999", "máx");
+    for (int s = 0; s < SERIES_COUNT; ++s) {
+        const LatencyHistogram& h = total.latency[s];
+        if (h.count() == 0) continue;
+        std::printf("  %-16s %10llu %10s %10s %10s %10s\n", SERIES_NAMES[s], static_cast<unsigned long long>(h.count()),
+                    millis(h.percentile(0.50)).c_str(), millis(h.percentile(0.99)).c_str(),
+                    millis(h.percentile(0.999)).c_str(), millis(h.max()).c_str());
+    }
+    std::fflush(stdout);
+
+    if (config.serverPid > 0 && rssIdle > 0) {
+        std::cout << "\n🧠 RSS del servidor (pid " << config.serverPid << ")\n"
+                  << "  antes de conectar: " << megabytes(rssIdle) << "\n"
+                  << "  con " << connectedUsers << " conectados: " << megabytes(rssConnected);
+        if (connectedUsers > 0 && rssConnected > rssIdle) {
+            std::cout << " (" << (rssConnected - rssIdle) / connectedUsers << " bytes por conexión)";
+        }
+        std::cout << "\n  máximo: " << megabytes(rssPeak) << "\n"
+                  << "  al terminar: " << megabytes(rssEnd) << "\n";
+    } else {
+        std::cout << "\n🧠 RSS del servidor: no disponible (indicar pid_servidor)\n";
+    }
+    return failedUsers > 0 ? 2 : 0;
+}
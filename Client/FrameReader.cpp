@@ -0,0 +1,103 @@
+#include "FrameReader.h"
+#include <QtEndian>
+
+/**
+ * @brief Crea un lector sobre un mensaje recibido
+ *
+ * @param data Mensaje recibido
+ * @param version Versión del protocolo negociada
+ * @param offset Primer byte a leer (1 para saltar el tipo de mensaje)
+ */
+FrameReader::FrameReader(const QByteArray& data, int version, int offset)
+    : pos(data.constData() + qMin(offset, data.size())), end(data.constData() + data.size()), version(version) {}
+
+/**
+ * @brief Lee un byte (tipo, estado o bandera)
+ *
+ * @param value Valor leído
+ */
+bool FrameReader::u8(quint8& value) {
+    if (pos == end) return false;
+    value = static_cast<quint8>(*pos++);
+    return true;
+}
+
+/**
+ * @brief Lee un entero de 32 bits big-endian (secuencias)
+ *
+ * @param value Valor leído
+ */
+bool FrameReader::u32(quint32& value) {
+    if (remaining() < 4) return false;
+    value = qFromBigEndian<quint32>(reinterpret_cast<const uchar*>(pos));
+    pos += 4;
+    return true;
+}
+
+/**
+ * @brief Lee una cantidad o longitud: un byte en v1, varint LEB128 en v2
+ *
+ * @param value Valor leído
+ * @return false si el mensaje se terminó o el varint es demasiado largo
+ */
+bool FrameReader::count(quint32& value) {
+    if (version == 1) {
+        quint8 byte;
+        if (!u8(byte)) return false;
+        value = byte;
+        return true;
+    }
+    quint64 result = 0;
+    for (int i = 0; i < 5; i++) {
+        quint8 byte;
+        if (!u8(byte)) return false;
+        result |= quint64(byte & 0x7F) << (7 * i);
+        if (!(byte & 0x80)) {
+            if (result > 0xFFFFFFFFu) return false;
+            value = static_cast<quint32>(result);
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief Lee una cadena precedida por su longitud sin copiarla
+ *
+ * @param data Inicio de la cadena dentro del mensaje
+ * @param size Longitud en bytes
+ */
+bool FrameReader::bytes(const char*& data, int& size) {
+    quint32 len;
+    if (!count(len) || len > static_cast<quint32>(remaining())) return false;
+    data = pos;
+    size = static_cast<int>(len);
+    pos += len;
+    return true;
+}
+
+/**
+ * @brief Lee una cadena UTF-8 para mostrarla en la interfaz
+ *
+ * @param value Texto decodificado directo de los bytes del mensaje
+ */
+bool FrameReader::text(QString& value) {
+    const char* data;
+    int size;
+    if (!bytes(data, size)) return false;
+    value = QString::fromUtf8(data, size);
+    return true;
+}
+
+/**
+ * @brief Lee una cadena UTF-8 tal cual, sin pasar por QString
+ *
+ * @param value Bytes de la cadena
+ */
+bool FrameReader::stdString(std::string& value) {
+    const char* data;
+    int size;
+    if (!bytes(data, size)) return false;
+    value.assign(data, size);
+    return true;
+}
@@ -0,0 +1,38 @@
+#ifndef FRAMEREADER_H
+#define FRAMEREADER_H
+
+#include <QByteArray>
+#include <QString>
+#include <string>
+
+/**
+ * @brief Lector de mensajes binarios del servidor
+ *
+ * Recorre un QByteArray sin copiarlo: cada campo se lee directo de los bytes
+ * recibidos, verificando que no se pase del final. Las longitudes y
+ * cantidades se leen según la versión del protocolo (un byte en v1, varint
+ * LEB128 en v2). Cada método devuelve false si el mensaje se termina antes
+ * de tiempo.
+ *
+ * El QByteArray debe vivir mientras se use el lector.
+ */
+class FrameReader {
+public:
+    FrameReader(const QByteArray& data, int version, int offset = 0);
+
+    bool u8(quint8& value);
+    bool u32(quint32& value);
+    bool count(quint32& value);
+    bool bytes(const char*& data, int& size);
+    bool text(QString& value);
+    bool stdString(std::string& value);
+
+    int remaining() const { return static_cast<int>(end - pos); }
+
+private:
+    const char* pos;   // Siguiente byte a leer
+    const char* end;   // Fin del mensaje
+    int version;       // Versión del protocolo negociada
+};
+
+#endif // FRAMEREADER_H
@@ -1,4 +1,9 @@
 #include "MessageHandler.h"
+#include "FrameReader.h"
+#include <QScrollBar>
+#include <QSignalBlocker>
+#include <QStringList>
+#include <QtEndian>
 #include <iostream>
 #include <unordered_map>
 #include <string>
@@ -7,6 +12,48 @@
 using namespace std;
 unordered_map<string, vector<pair<string, string>>> localChatHistory; // clave: ID del chat
 
+// Mensajes por página de historial
+const quint8 HISTORY_PAGE_SIZE = 50;
+// Secuencia "antes de" que pide la página más reciente
+const quint32 LATEST_HISTORY_SEQ = 0xFFFFFFFF;
+
+/**
+ * @brief Agrega una cantidad o longitud con el formato de la versión del protocolo
+ * 
+ * v1: un byte. v2: varint LEB128 (7 bits por byte, el bit alto indica que sigue otro).
+ * 
+ * @param out Mensaje de salida
+ * @param version Versión del protocolo negociada
+ * @param value Valor a escribir
+ */
+void appendCount(QByteArray& out, int version, quint32 value) {
+    if (version == 1) {
+        out.append(static_cast<char>(qMin<quint32>(value, 255)));
+        return;
+    }
+    while (value >= 0x80) {
+        out.append(static_cast<char>((value & 0x7F) | 0x80));
+        value >>= 7;
+    }
+    out.append(static_cast<char>(value));
+}
+
+/**
+ * @brief Agrega una cadena precedida por su longitud en bytes UTF-8
+ * 
+ * En v1 las cadenas de más de 255 bytes se recortan.
+ * 
+ * @param out Mensaje de salida
+ * @param version Versión del protocolo negociada
+ * @param text Texto a escribir
+ */
+void appendString(QByteArray& out, int version, const QString& text) {
+    QByteArray utf8 = text.toUtf8();
+    if (version == 1) utf8.truncate(255);
+    appendCount(out, version, static_cast<quint32>(utf8.size()));
+    out.append(utf8);
+}
+
 /**
  * @brief Constructor de la clase MessageHandler
  * 
@@ -34,7 +81,6 @@ MessageHandler::MessageHandler(QWebSocket& socket,
     m_userInfoCallback(nullptr) { 
 
     actualUser = ""; // Espacio para registrar el nombre del usuario actual
-    pendingHistoryRequests; // Bandera de quién está solicitando el historial de chat
 
     // Conectar señales y slots para el chat personal
     connect(sendButton, &QPushButton::clicked, this, &MessageHandler::sendMessage);
@@ -47,6 +93,31 @@ MessageHandler::MessageHandler(QWebSocket& socket,
     // Conectar cambios de estado
     connect(stateList, QOverload<int>::of(&QComboBox::currentIndexChanged), this, &MessageHandler::onStateChanged);
 
+    // Cargar páginas anteriores del historial al llegar arriba del todo
+    // (al limpiar el área el rango queda vacío y no cuenta como desplazamiento)
+    connect(generalChatArea->verticalScrollBar(), &QScrollBar::valueChanged, this, [this](int value) {
+        QScrollBar* bar = this->generalChatArea->verticalScrollBar();
+        if (value == bar->minimum() && bar->maximum() > bar->minimum()) {
+            requestOlderHistory("~");
+        }
+    });
+    connect(chatArea->verticalScrollBar(), &QScrollBar::valueChanged, this, [this](int value) {
+        QScrollBar* bar = this->chatArea->verticalScrollBar();
+        if (value == bar->minimum() && bar->maximum() > bar->minimum()) {
+            requestOlderHistory(this->userList->currentText());
+        }
+    });
+
+}
+
+/**
+ * Fija la versión del protocolo negociada con el servidor al conectar
+ * (1 si el servidor no anuncia otra). La lista de usuarios se vuelve a
+ * pedir completa en cada conexión.
+ */
+void MessageHandler::setProtocolVersion(int version) {
+    protocolVersion = version;
+    rosterEpoch = 0;
 }
 
 /**
@@ -85,6 +156,8 @@ string get_error_string(int error) {
         case 2: return "El estatus enviado es inválido.";
         case 3: return "¡El mensaje está vacío!";
         case 4: return "El mensaje fue enviado a un usuario con estatus desconectado";
+        case 5: return "Demasiadas solicitudes; el servidor descartó algunas.";
+        case 6: return "El mensaje es demasiado largo.";
         default: return "Desconocido";
     }
 }
@@ -110,8 +183,7 @@ void MessageHandler::requestUserInfo(const QString& username) {
     // Formato: [Tipo=2][LongitudNombre][Nombre]
     QByteArray request;
     request.append(static_cast<char>(2));  // Tipo 2: Obtener info de usuario
-    request.append(static_cast<char>(username.length()));  // Longitud del nombre
-    request.append(username.toUtf8());  // Nombre en UTF-8
+    appendString(request, protocolVersion, username);  // Nombre en UTF-8 con su longitud
 
     socket.sendBinaryMessage(request);  // Enviar solicitud al servidor
 }
@@ -120,16 +192,30 @@ void MessageHandler::setUserListReceivedCallback(std::function<void(const std::u
     m_userListReceivedCallback = callback;
 }
 
+/**
+ * @brief Pide la lista de usuarios al servidor
+ * 
+ * En v2 se pide por épocas (tipo 8): el servidor solo responde con los
+ * usuarios que cambiaron desde la última lista recibida. En v1 se pide la
+ * lista completa (tipo 1).
+ */
 void MessageHandler::requestUsersList() {
     if (socket.state() != QAbstractSocket::ConnectedState) {
         qDebug() << "⚠️ Cannot request user list: WebSocket not connected";
         return;
     }
     
-    // Crear mensaje binario para solicitar la lista de usuarios
-    // Formato: [Tipo=1]
     QByteArray request;
-    request.append(static_cast<char>(1));  // Tipo 1: Obtener lista de usuarios
+    if (protocolVersion >= 2) {
+        // Formato: [Tipo=8][Época (u32)]
+        uchar epochBytes[4];
+        qToBigEndian(rosterEpoch, epochBytes);
+        request.append(static_cast<char>(8));  // Tipo 8: Sincronizar lista de usuarios
+        request.append(reinterpret_cast<const char*>(epochBytes), 4);
+    } else {
+        // Formato: [Tipo=1]
+        request.append(static_cast<char>(1));  // Tipo 1: Obtener lista de usuarios
+    }
 
     qDebug()<<"Pidiendo lista de usuarios: "<<request;
     
@@ -138,20 +224,65 @@ void MessageHandler::requestUsersList() {
 /**
  * @brief Solicita el historial de conversación de un chat específico
  * 
+ * La primera vez solo se pide la página más reciente; las anteriores se
+ * cargan con requestOlderHistory al desplazarse hacia arriba. Si el chat ya
+ * está cargado, solo se piden los mensajes posteriores al último recibido.
+ * 
  * @param chatName Nombre del chat (un usuario o "~" para el chat general)
  */
 void MessageHandler::requestChatHistory(const QString& chatName) {
-    pendingHistoryRequests.push(chatName);
     if (chatName.isEmpty()) return;  // Validar entrada
 
-    // Crear mensaje binario para solicitar historial
-    // Formato: [Tipo=5][LongitudNombre][Nombre]
+    HistoryCursor& cursor = historyCursors[chatName.toStdString()];
+    if (cursor.loaded) {
+        cursor.pending.push(PageKind::Since);
+        sendHistoryRequest(7, chatName, cursor.nextSeq);
+    } else {
+        cursor.pending.push(PageKind::Latest);
+        sendHistoryRequest(6, chatName, LATEST_HISTORY_SEQ);
+    }
+}
+
+/**
+ * @brief Solicita la página anterior al mensaje más antiguo cargado de un chat
+ * 
+ * No hace nada si ya se cargó todo el historial o si hay una página en camino.
+ * 
+ * @param chatName Nombre del chat (un usuario o "~" para el chat general)
+ */
+void MessageHandler::requestOlderHistory(const QString& chatName) {
+    if (chatName.isEmpty()) return;  // Validar entrada
+
+    auto it = historyCursors.find(chatName.toStdString());
+    if (it == historyCursors.end() || !it->second.hasMore || !it->second.pending.empty()) return;
+
+    it->second.pending.push(PageKind::Older);
+    sendHistoryRequest(6, chatName, it->second.oldestSeq);
+}
+
+/**
+ * @brief Envía una solicitud de historial
+ * 
+ * Formato tipo 6: [Tipo=6][LongitudNombre][Nombre][AntesDe (u32)][Limite]
+ * Formato tipo 7: [Tipo=7][LongitudNombre][Nombre][Desde (u32)]
+ * 
+ * @param type 6 para una página anterior a `seq`, 7 para los mensajes desde `seq`
+ * @param chatName Nombre del chat (un usuario o "~" para el chat general)
+ * @param seq Secuencia límite
+ */
+void MessageHandler::sendHistoryRequest(quint8 type, const QString& chatName, quint32 seq) {
+    uchar seqBytes[4];
+    qToBigEndian(seq, seqBytes);
+
     QByteArray request;
-    request.append(static_cast<char>(5));  // Tipo 5: Solicitar historial
-    request.append(static_cast<char>(chatName.length()));  // Longitud del nombre
-    request.append(chatName.toUtf8());  // Nombre en UTF-8
+    request.append(static_cast<char>(type));  // Tipo 6 o 7: Solicitar historial
+    appendString(request, protocolVersion, chatName);  // Nombre en UTF-8 con su longitud
+    request.append(reinterpret_cast<const char*>(seqBytes), 4);  // Secuencia límite
+    if (type == 6) {
+        request.append(static_cast<char>(HISTORY_PAGE_SIZE));  // Mensajes por página
+    }
 
-    qDebug()<<"Pidiendo chat history: "<<request;
+    qDebug()<<"Pidiendo historial: "<<request;
 
     socket.sendBinaryMessage(request);  // Enviar solicitud al servidor
 }
@@ -169,8 +300,7 @@ void MessageHandler::requestChangeState(const QString& username, uint8_t newStat
     // Formato: [Tipo=3][LongitudNombre][Nombre][NuevoEstado]
     QByteArray request;
     request.append(static_cast<char>(3));  // Tipo 3: Cambiar estado
-    request.append(static_cast<char>(username.length()));  // Longitud del nombre
-    request.append(username.toUtf8());  // Nombre en UTF-8
+    appendString(request, protocolVersion, username);  // Nombre en UTF-8 con su longitud
     request.append(static_cast<char>(newStatus));  // Nuevo estado
 
     qDebug()<<"Pidiendo state change: "<<request;
@@ -208,7 +338,7 @@ void MessageHandler::sendMessage() {
         chatArea->append("!! Mensaje vacío");
         return;
     }
-    if (message.length() > 255) {
+    if (!fitsMessageLimit(message)) {
         chatArea->append("!! Mensaje inválido (demasiado largo)");
         return;
     }
@@ -246,7 +376,7 @@ void MessageHandler::sendGeneralMessage() {
         generalChatArea->append("!! Mensaje vacío");
         return;
     }
-    if (message.length() > 255) {
+    if (!fitsMessageLimit(message)) {
         generalChatArea->append("!! Mensaje inválido (demasiado largo)");
         return;
     }
@@ -263,6 +393,19 @@ void MessageHandler::sendGeneralMessage() {
     generalMessageInput->clear();
 }
 
+/**
+ * @brief Verifica que un mensaje respete el límite de 255 caracteres
+ * 
+ * En v1 la longitud viaja en un byte, así que además el texto en UTF-8
+ * no puede pasar de 255 bytes.
+ * 
+ * @param message Mensaje a enviar
+ */
+bool MessageHandler::fitsMessageLimit(const QString& message) const {
+    if (message.length() > 255) return false;
+    return protocolVersion != 1 || message.toUtf8().size() <= 255;
+}
+
 /** 
  * Genera una clave única para cada conversación.
  * 
@@ -279,23 +422,119 @@ QString MessageHandler::get_chat_id(const QString& user2) {
 }
 
 /**
- * Guarda un mensaje específico en el chat establecido
+ * @brief Actualiza el estado conocido de un usuario
+ * 
+ * @param username Usuario cuyo estado cambió
+ * @param newStatus Nuevo estado
+ * 
+ * Si el afectado es el usuario actual y pasa de Ocupado a Activo, se
+ * recuperan los mensajes que no recibió mientras estaba ocupado: en v2 el
+ * servidor los envía solo (bandeja tipo 61), en v1 se piden al historial.
+ * Si el servidor lo pasó a Inactivo, el selector de estado lo refleja.
+ */
+void MessageHandler::applyStatusChange(const QString& username, quint8 newStatus) {
+    string last_status = userStates[username.toStdString()];
+    userStates[username.toStdString()] = get_status_string(newStatus);
+
+    if (actualUser != username) return; // Solo actúa si el usuario actual es el afectado
+
+    if (newStatus == 3) {
+        // Sin reenviar el cambio al servidor; al volver a escribir pasa a Activo
+        int stateIndex = stateList->findData(newStatus);
+        if (stateIndex != -1 && stateIndex != stateList->currentIndex()) {
+            QSignalBlocker blocker(stateList);
+            stateList->setCurrentIndex(stateIndex);
+        }
+    }
+    
+    if (last_status == "Ocupado" && newStatus == 1 && protocolVersion < 2) {  // Recuperar los mensajes si se cambia a activo
+        requestChatHistory("~");
+        requestChatHistory(userList->currentText());
+    }
+}
+
+/**
+ * @brief Agrega o actualiza un usuario de la lista
+ * 
+ * @param username Usuario
+ * @param status Estado, o 255 si el usuario ya no existe (se quita de la lista)
+ */
+void MessageHandler::applyRosterEntry(const QString& username, quint8 status) {
+    if (status == 255) {
+        userStates.erase(username.toStdString());
+        int index = userList->findText(username);
+        if (index != -1) userList->removeItem(index);
+        return;
+    }
+
+    // Guardar en la estructura de datos
+    userStates[username.toStdString()] = get_status_string(status);
+
+    if (username != actualUser && userList->findText(username) == -1) {
+        userList->addItem(username);  // Añadir solo si no está en la lista
+    }
+
+    // Actualizar estado si es el usuario actual
+    if (username == userList->currentText()) {
+        int stateIndex = stateList->findData(status);
+        if (stateIndex != -1) {
+            stateList->setCurrentIndex(stateIndex);
+        }
+    }
+}
+
+/**
+ * Guarda un mensaje recibido en vivo en el historial local de su chat.
+ * Solo se guarda si es el siguiente que se esperaba; si faltan mensajes
+ * antes de él, se piden al servidor los que siguen al último recibido.
  * 
- * @param sender usuario que mandó el mensaje
+ * @param sender usuario que mandó el mensaje ("~" para el chat general)
  * @param message mensaje a guardar
+ * @param seq secuencia del mensaje dentro de su chat
  */
-void MessageHandler::storeMessage(const QString& sender, const QString& message) {
-    // Obtener el chat_id en formato QString o mantenerlo si es "~"
-    QString chat_id_qt = sender != "~" ? get_chat_id(sender) : sender;
-    std::string chat_id_std = chat_id_qt.toStdString();
+void MessageHandler::storeMessage(const QString& sender, const QString& message, quint32 seq) {
+    QString chatName = sender;
+    string storedSender = sender.toStdString();
+    string content = message.toStdString();
+    if (sender == "~") {
+        // El chat general llega como "emisor: mensaje"
+        int split = message.indexOf(": ");
+        if (split < 0) return;
+        storedSender = message.left(split).toStdString();
+        content = message.mid(split + 2).toStdString();
+    } else if (sender == actualUser) {
+        chatName = userList->currentText();  // Copia propia: solo se puede enviar al chat abierto
+    }
+    appendMessage(chatName, std::move(storedSender), std::move(content), seq);
+}
 
-    // Verificar si el mensaje ya está en el historial local
-    auto& chatHistory = localChatHistory[chat_id_std];
-    if (std::find(chatHistory.begin(), chatHistory.end(),
-                  std::make_pair(sender.toStdString(), message.toStdString())) == chatHistory.end()) {
-        // Agregar mensaje al historial local
-        chatHistory.emplace_back(sender.toStdString(), message.toStdString());
+/**
+ * Agrega un mensaje al final del historial local de un chat ya cargado.
+ * Solo se guarda si es el siguiente que se esperaba; si faltan mensajes
+ * antes de él, se piden al servidor los que siguen al último recibido.
+ * 
+ * @param chatName Nombre del chat (un usuario o "~" para el chat general)
+ * @param sender usuario que escribió el mensaje
+ * @param content contenido del mensaje
+ * @param seq secuencia del mensaje dentro de su chat
+ * @return true si el mensaje quedó en el historial local
+ */
+bool MessageHandler::appendMessage(const QString& chatName, string sender, string content, quint32 seq) {
+    // Los chats que no se han abierto se cargan completos al abrirlos
+    auto it = historyCursors.find(chatName.toStdString());
+    if (it == historyCursors.end() || !it->second.loaded) return false;
+
+    HistoryCursor& cursor = it->second;
+    if (!cursor.pending.empty() || seq < cursor.nextSeq) return false;  // Llegará (o llegó) con el historial
+    if (seq > cursor.nextSeq) {
+        requestChatHistory(chatName);  // Faltan mensajes anteriores a este
+        return false;
     }
+
+    string chat_id = chatName != "~" ? get_chat_id(chatName).toStdString() : chatName.toStdString();
+    localChatHistory[chat_id].emplace_back(std::move(sender), std::move(content));
+    cursor.nextSeq = seq + 1;
+    return true;
 }
 
 /**
@@ -338,105 +577,112 @@ QByteArray MessageHandler::buildMessage(quint8 type, const QString& param1, cons
     // Añadir tipo de mensaje
     message.append(static_cast<char>(type));
 
-    // Añadir primer parámetro si existe
+    // Añadir primer parámetro si existe (longitud en bytes UTF-8 y datos)
     if (!param1.isEmpty()) {
-        message.append(static_cast<char>(param1.length()));  // Longitud
-        message.append(param1.toUtf8());  // Datos
+        appendString(message, protocolVersion, param1);
     }
 
     // Añadir segundo parámetro si existe
     if (!param2.isEmpty()) {
-        message.append(static_cast<char>(param2.length()));  // Longitud
-        message.append(param2.toUtf8());  // Datos
+        appendString(message, protocolVersion, param2);
     }
     qDebug() << "mensaje:" << QString::fromUtf8(message);
     return message;
 }
 
 /**
- * @brief Procesa los mensajes recibidos del servidor
+ * @brief Procesa los mensajes de texto recibidos del servidor
  * 
- * @param message Mensaje recibido (en formato binario)
+ * @param message Mensaje recibido como texto
  * 
- * Esta función analiza el tipo de mensaje y extrae la información
- * relevante para actualizar la interfaz de usuario.
+ * El servidor envía mensajes binarios; los de texto se tratan igual.
  */
 void MessageHandler::receiveMessage(const QString& message) {
-    
-    QByteArray data = message.toUtf8();
-    qDebug()<<"RECIBIDO DESPUES "<<data;
+    handleFrame(message.toUtf8());
+}
+
+/**
+ * @brief Procesa los mensajes binarios recibidos del servidor
+ * 
+ * @param data Mensaje recibido
+ * 
+ * En v2 el servidor puede agrupar varios mensajes en uno tipo 58:
+ * [58, cantidad, [longitud, mensaje], ...]. Cada uno se procesa por
+ * separado, sin copiarlo, como si hubiera llegado solo.
+ */
+void MessageHandler::receiveBinaryMessage(const QByteArray& data) {
+    if (data.isEmpty() || static_cast<quint8>(data[0]) != 58) {
+        handleFrame(data);
+        return;
+    }
 
+    FrameReader in(data, protocolVersion, 1);
+    quint32 numMessages = 0;
+    if (!in.count(numMessages)) return;
+    for (quint32 i = 0; i < numMessages; i++) {
+        const char* message;
+        int size;
+        if (!in.bytes(message, size)) break;
+        handleFrame(QByteArray::fromRawData(message, size));
+    }
+}
+
+/**
+ * @brief Procesa un mensaje recibido del servidor
+ * 
+ * @param data Mensaje recibido (en formato binario)
+ * 
+ * Esta función analiza el tipo de mensaje y extrae la información
+ * relevante para actualizar la interfaz de usuario. Los campos se leen
+ * con un FrameReader directo de los bytes recibidos; solo se crea un
+ * QString para lo que se muestra en pantalla.
+ */
+void MessageHandler::handleFrame(const QByteArray& data) {
     if (data.isEmpty()) return;  // Validar entrada
 
     quint8 messageType = static_cast<quint8>(data[0]);  // Obtener tipo de mensaje
+    FrameReader in(data, protocolVersion, 1);  // Lector de los campos que siguen al tipo
 
     qDebug()<<"TIPO MENSAJE"<<messageType;
 
     // Procesar según el tipo de mensaje
     if (messageType == 50) { // ERROR
-        quint8 errorType = static_cast<quint8>(data[1]);
-        QString errorMsg;
-        switch (errorType) {
-            case 1: errorMsg = "El usuario que intentas obtener no existe."; break;
-            case 2: errorMsg = "El estatus enviado es inválido."; break;
-            case 3: errorMsg = "¡El mensaje está vacío!"; break;
-            case 4: errorMsg = "El mensaje fue enviado a un usuario con estatus desconectado"; break;
-            default: errorMsg = "Error desconocido"; break;
-        }
-        
-        generalChatArea->append("Error: " + errorMsg);
-        cerr << "⚠️ " + errorMsg.toStdString() << endl;  // Log en consola
-        cerr << "⚠️ " + get_error_string(errorType) << endl;  // Log en consola
+        quint8 errorType = 0;
+        in.u8(errorType);
+        string errorMsg = get_error_string(errorType);
+
+        generalChatArea->append("Error: " + QString::fromStdString(errorMsg));
+        cerr << "⚠️ " + errorMsg << endl;  // Log en consola
     }
     else if (messageType == 51) {  // Lista de usuarios con estados
         userList->clear();  // Limpiar lista actual
-        quint8 numUsers = static_cast<quint8>(data[1]);  // Número de usuarios
-        int pos = 2;  // Posición para leer datos
+        quint32 numUsers = 0;  // Número de usuarios
+        if (!in.count(numUsers)) return;
 
         // Procesar cada usuario en la lista
-        for (quint8 i = 0; i < numUsers; i++) {
-            // Leer nombre de usuario
-            quint8 usernameLen = static_cast<quint8>(data[pos]);
-            QString username = QString::fromUtf8(data.mid(pos + 1, usernameLen));
-            pos += 1 + usernameLen;  // Avanzar posición
-
-            // Leer estado
-            quint8 status = static_cast<quint8>(data[pos]);
-            pos += 1;  // Avanzar posición
-
-            // Convertir status numérico a string
-            string user_status = get_status_string(status);
-
-            // Guardar en la estructura de datos
-            this-> userStates[username.toStdString()] = user_status;
-
-            if (username != actualUser && userList->findText(username) == -1) {
-                userList->addItem(username);  // Añadir solo si no está en la lista
-            }
-            
-
-            // Actualizar estado si es el usuario actual
-            if (username == userList->currentText()) {
-                int stateIndex = stateList->findData(status);
-                if (stateIndex != -1) {
-                    stateList->setCurrentIndex(stateIndex);
-                }
-            }
+        for (quint32 i = 0; i < numUsers; i++) {
+            // Leer nombre de usuario y estado
+            QString username;
+            quint8 status;
+            if (!in.text(username) || !in.u8(status)) break;
+            applyRosterEntry(username, status);
         }
         
         if (m_userListReceivedCallback) {
             m_userListReceivedCallback(userStates);
         }
     } 
+    else if (messageType == 60) {  // Lista de usuarios por épocas (completa o solo cambios)
+        quint32 epoch = 0;
+        quint8 full = 0;
+        if (!in.u32(epoch) || !in.u8(full)) return;
+        readRoster(in, epoch, full != 0);
+    }
     else if (messageType == 52) {  // Información de usuario
-        quint8 success = static_cast<quint8>(data[1]);  // Éxito/fracaso
-
-        if (success) {
-            // Extraer información del usuario
-            quint8 usernameLen = static_cast<quint8>(data[1]);
-            QString username = QString::fromUtf8(data.mid(2, usernameLen));
-            quint8 status = static_cast<quint8>(data[2 + usernameLen]);
-
+        // Extraer información del usuario
+        QString username;
+        quint8 status;
+        if (in.text(username) && !username.isEmpty() && in.u8(status)) {
             // Llamar al callback si está configurado
             if (m_userInfoCallback) {
                 m_userInfoCallback(username, status);
@@ -446,8 +692,8 @@ void MessageHandler::receiveMessage(const QString& message) {
         }
     }
     else if (messageType == 53) {  // Nuevo usuario conectado
-        quint8 usernameLen = static_cast<quint8>(data[1]);
-        QString username = QString::fromUtf8(data.mid(2, usernameLen));
+        QString username;
+        if (!in.text(username)) return;
         notificationLabel->setText(username + " se ha registrado!");
         notificationLabel->show();
         notificationTimer->start(5000);
@@ -456,39 +702,55 @@ void MessageHandler::receiveMessage(const QString& message) {
     }
     else if (messageType == 54) {  // Cambio de estado de usuario
         
-        quint8 usernameLen = static_cast<quint8>(data[1]);
-        QString username = QString::fromUtf8(data.mid(2, usernameLen));
-        quint8 newStatus = static_cast<quint8>(data[2 + usernameLen]);
+        QString username;
+        quint8 newStatus;
+        if (!in.text(username) || !in.u8(newStatus)) return;
         notificationLabel->setText(username + " ha cambiado su estado a " + 
                         QString::fromStdString(get_status_string(newStatus)));
         notificationLabel->show();
         notificationTimer->start(5000);
-        
-        string last_status = userStates[username.toStdString()];
-        userStates[username.toStdString()] = get_status_string(newStatus);
 
-        if (actualUser != username) return; // Solo actúa si el usuario actual es el afectado
-        
-        if (last_status == "Ocupado" && newStatus == 1) {  // Recuperar los mensajes si se cambia a activo
-            requestChatHistory("~");
-            requestChatHistory(userList->currentText());
+        applyStatusChange(username, newStatus);
+    }
+    else if (messageType == 59) {  // Cambios de estado agrupados (v2)
+        quint32 numChanges = 0;
+        if (!in.count(numChanges)) return;
+
+        QString username;
+        quint8 newStatus = 0;
+        quint32 applied = 0;
+        for (quint32 i = 0; i < numChanges; i++) {
+            if (!in.text(username) || !in.u8(newStatus)) break;
+            applyStatusChange(username, newStatus);
+            applied++;
         }
+        if (applied == 0) return;
+
+        // Una sola notificación por grupo
+        if (applied == 1) {
+            notificationLabel->setText(username + " ha cambiado su estado a " +
+                            QString::fromStdString(get_status_string(newStatus)));
+        } else {
+            notificationLabel->setText(QString::number(applied) + " usuarios cambiaron su estado");
+        }
+        notificationLabel->show();
+        notificationTimer->start(5000);
     }
     else if (messageType == 55) {  // Mensaje normal de chat
 
-        // Extraer remitente
-        quint8 usernameLen = static_cast<quint8>(data[1]);
-        QString username = QString::fromUtf8(data.mid(2, usernameLen));
-
-        // Extraer contenido del mensaje
-        quint8 messageLen = static_cast<quint8>(data[2 + usernameLen]);
-        QString content = QString::fromUtf8(data.mid(3 + usernameLen, messageLen));
+        // Extraer remitente y contenido del mensaje
+        QString username, content;
+        if (!in.text(username) || !in.text(content)) return;
 
-        if (stateList->currentText() == "Ocupado") {
-            storeMessage(username, content);
-            return;
+        // Guardar en el historial local según su secuencia (si el servidor la envía)
+        quint32 seq;
+        if (in.u32(seq)) {
+            storeMessage(username, content, seq);
         }
 
+        // Ocupado: el mensaje ya quedó en el historial local, se mostrará al volver
+        if (stateList->currentText() == "Ocupado") return;
+
         // Definir nombre de usuario en la UI
         QString displayUsername = (actualUser == username) ? "Tú" : username;
 
@@ -510,41 +772,15 @@ void MessageHandler::receiveMessage(const QString& message) {
         }
 
     } 
-    else if (messageType == 56) {  // Historial de chat recibido
-        quint8 numMessages = static_cast<quint8>(data[1]);  // Número de mensajes
-        int pos = 2;  // Posición para leer datos
-
-        if (pendingHistoryRequests.empty()) return;
-        
-        QString requestedHistory = pendingHistoryRequests.front();
-        pendingHistoryRequests.pop();
-        
-        localChatHistory.clear();  // Eliminar mensajes previos del historial
-        for (quint8 i = 0; i < numMessages; i++) {
-
-            // Extraer remitente
-            quint8 usernameLen = static_cast<quint8>(data[pos]);
-            QString username = QString::fromUtf8(data.mid(pos + 1, usernameLen));
-            pos += 1 + usernameLen;  // Avanzar posición
-
-            // Extraer contenido
-            quint8 messageLen = static_cast<quint8>(data[pos]);
-            QString content = QString::fromUtf8(data.mid(pos + 1, messageLen));
-            pos += 1 + messageLen;  // Avanzar posición
-
-            // Construir la clave del chat para el historial
-            QString chat_id_qt = requestedHistory.toStdString() != "~" ? get_chat_id(requestedHistory) : requestedHistory;;
-            // Convertir a string solo para acceder a unordered_map
-            string chat_id_std = chat_id_qt.toStdString();
-
-            // Verificar si el mensaje ya está en el historial local
-            auto& chatHistory = localChatHistory[chat_id_std];
-            // Agregar mensaje al historial local
-            chatHistory.emplace_back(username.toStdString(), content.toStdString());
-        }
-        
-        showChatMessages(requestedHistory);
-    }    
+    else if (messageType == 57) {  // Página de historial
+        receiveHistoryPage(data);
+    }
+    else if (messageType == 61) {  // Mensajes pendientes al volver a Activo (v2)
+        receiveInbox(data);
+    }
+    else if (messageType == 62) {  // Estado inicial al conectar (v2)
+        receiveWelcome(data);
+    }
     else {
         // Tipo de mensaje desconocido
         qDebug() << "MENSAJE NO CONOCIDO" <<  messageType;
@@ -552,15 +788,231 @@ void MessageHandler::receiveMessage(const QString& message) {
     }
 }
 
-void MessageHandler::receiveBinaryMessage(const QByteArray& data) {
-    qDebug() << "MENSAJE BINARIO RECIBIDO:" << data;
-    
-    if (data.isEmpty()) return;
-    
-    quint8 messageType = static_cast<quint8>(data[0]);
-    qDebug() << "TIPO MENSAJE BINARIO:" << messageType;
-    
-    // Convertir los datos binarios a QString y utilizar la función existente
-    QString message = QString::fromUtf8(data);
-    receiveMessage(message);
-}
\ No newline at end of file
+/**
+ * @brief Lee una lista de usuarios y la aplica
+ * 
+ * Formato: [NumUsuarios][[LongitudNombre][Nombre][Estado], ...]
+ * 
+ * @param in Lector posicionado en la cantidad de usuarios
+ * @param epoch Época de la lista
+ * @param full Si es la lista completa (reemplaza la actual) o solo los cambios
+ * @return false si el mensaje se terminó antes de tiempo
+ */
+bool MessageHandler::readRoster(FrameReader& in, quint32 epoch, bool full) {
+    quint32 numUsers = 0;
+    if (!in.count(numUsers)) return false;
+
+    if (full) {
+        userList->clear();
+        userStates.clear();
+    }
+    bool complete = true;
+    for (quint32 i = 0; i < numUsers; i++) {
+        QString username;
+        quint8 status;
+        if (!in.text(username) || !in.u8(status)) {
+            complete = false;
+            break;
+        }
+        applyRosterEntry(username, status);
+    }
+    rosterEpoch = epoch;
+
+    if (m_userListReceivedCallback) {
+        m_userListReceivedCallback(userStates);
+    }
+    return complete;
+}
+
+/**
+ * @brief Procesa una página de historial (tipo 57)
+ * 
+ * Formato: [57][LongitudNombre][Nombre][PrimeraSeq (u32)][NumMensajes][HayMas]
+ *          [[LongitudEmisor][Emisor][LongitudMensaje][Mensaje], ...]
+ * 
+ * La página más reciente reemplaza el historial local del chat; las
+ * anteriores se agregan al inicio conservando la posición de lectura, y las
+ * de sincronización (tipo 7) se agregan al final.
+ * 
+ * @param data Mensaje recibido
+ */
+void MessageHandler::receiveHistoryPage(const QByteArray& data) {
+    FrameReader in(data, protocolVersion, 1);
+    QString chatName;
+    quint32 firstSeq, numMessages;
+    quint8 hasMoreFlag;
+    if (!in.text(chatName) || !in.u32(firstSeq) ||
+        !in.count(numMessages) || !in.u8(hasMoreFlag)) return;
+    bool hasMore = hasMoreFlag != 0;
+
+    // Leer los mensajes de la página
+    vector<pair<string, string>> page;
+    page.reserve(qMin<quint32>(numMessages, in.remaining() / 2));  // Cada mensaje ocupa al menos 2 bytes
+    for (quint32 i = 0; i < numMessages; i++) {
+        string username, content;
+        if (!in.stdString(username) || !in.stdString(content)) break;
+        page.emplace_back(std::move(username), std::move(content));
+    }
+
+    quint32 received = static_cast<quint32>(page.size());
+    HistoryCursor& cursor = historyCursors[chatName.toStdString()];
+    PageKind kind = PageKind::Latest;
+    if (!cursor.pending.empty()) {
+        kind = cursor.pending.front();
+        cursor.pending.pop();
+    }
+
+    string chat_id = chatName != "~" ? get_chat_id(chatName).toStdString() : chatName.toStdString();
+    auto& chatHistory = localChatHistory[chat_id];
+
+    // Mensajes nuevos que siguen justo al último recibido: se agregan al final
+    if (kind == PageKind::Since && firstSeq == cursor.nextSeq) {
+        chatHistory.insert(chatHistory.end(), page.begin(), page.end());
+        cursor.nextSeq = firstSeq + received;
+        showChatMessages(chatName);
+        return;
+    }
+
+    // Página más reciente (o faltaban demasiados mensajes): reemplaza lo local
+    if (kind != PageKind::Older) {
+        loadLatestPage(chatName, firstSeq, hasMore, std::move(page));
+        return;
+    }
+
+    cursor.oldestSeq = firstSeq;
+    cursor.hasMore = hasMore;
+
+    // Página anterior: mantener a la vista el mismo mensaje tras redibujar
+    bool isGeneralChat = (chatName == "~");
+    if (!isGeneralChat && chatName != userList->currentText()) {
+        chatHistory.insert(chatHistory.begin(), page.begin(), page.end());
+        return;
+    }
+    QScrollBar* bar = (isGeneralChat ? generalChatArea : chatArea)->verticalScrollBar();
+    int fromBottom = bar->maximum() - bar->value();
+    chatHistory.insert(chatHistory.begin(), page.begin(), page.end());
+    showChatMessages(chatName);
+    bar->setValue(bar->maximum() - fromBottom);
+}
+
+/**
+ * @brief Procesa la bandeja de entrada (tipo 61, v2)
+ * 
+ * Formato: [61][Descartados][NumChats]
+ *          [[LongitudChat][Chat][NumMensajes][[LongitudEmisor][Emisor][LongitudMensaje][Mensaje][Seq (u32)], ...], ...]
+ * 
+ * Son los mensajes que llegaron mientras el usuario estaba Ocupado, Inactivo
+ * o desconectado. Se agregan a los chats ya cargados como si hubieran llegado
+ * en vivo (si falta alguno, el hueco de secuencia hace que se pida al
+ * historial); los chats sin abrir solo se avisan y se cargan al abrirlos.
+ * 
+ * @param data Mensaje recibido
+ */
+void MessageHandler::receiveInbox(const QByteArray& data) {
+    FrameReader in(data, protocolVersion, 1);
+    quint32 dropped = 0, numChats = 0;
+    if (!in.count(dropped) || !in.count(numChats)) return;
+
+    QString actualChat = userList->currentText();
+    QStringList unseen;  // Chats privados con mensajes nuevos que no están a la vista
+    for (quint32 i = 0; i < numChats; i++) {
+        QString chatName;
+        quint32 numMessages = 0;
+        if (!in.text(chatName) || !in.count(numMessages)) break;
+
+        bool stored = false;
+        for (quint32 j = 0; j < numMessages; j++) {
+            string sender, content;
+            quint32 seq;
+            if (!in.stdString(sender) || !in.stdString(content) || !in.u32(seq)) return;
+            stored = appendMessage(chatName, std::move(sender), std::move(content), seq) || stored;
+        }
+
+        if (chatName == "~" || chatName == actualChat) {
+            if (stored) showChatMessages(chatName);
+        } else {
+            unseen << chatName;
+        }
+    }
+    if (dropped > 0) {
+        qDebug() << "Bandeja: " << dropped << " mensajes pendientes se recuperan con el historial";
+    }
+
+    if (!unseen.isEmpty()) {
+        notificationLabel->setText("Recibiste mensajes nuevos de: " + unseen.join(", "));
+        notificationLabel->show();
+        notificationTimer->start(5000);
+    }
+}
+
+/**
+ * @brief Reemplaza el historial local de un chat con su página más reciente
+ * 
+ * @param chatName Nombre del chat (un usuario o "~" para el chat general)
+ * @param firstSeq Secuencia del primer mensaje de la página
+ * @param hasMore Si el servidor tiene mensajes anteriores
+ * @param page Mensajes (emisor, contenido), del más antiguo al más nuevo
+ */
+void MessageHandler::loadLatestPage(const QString& chatName, quint32 firstSeq, bool hasMore,
+                                    vector<pair<string, string>> page) {
+    HistoryCursor& cursor = historyCursors[chatName.toStdString()];
+    cursor.loaded = true;
+    cursor.oldestSeq = firstSeq;
+    cursor.nextSeq = firstSeq + static_cast<quint32>(page.size());
+    cursor.hasMore = hasMore;
+
+    string chat_id = chatName != "~" ? get_chat_id(chatName).toStdString() : chatName.toStdString();
+    localChatHistory[chat_id] = std::move(page);
+    showChatMessages(chatName);
+}
+
+/**
+ * @brief Procesa el estado inicial que envía el servidor al conectar (tipo 62, v2)
+ * 
+ * Formato: [62][Época (u32)][NumUsuarios][[LongitudNombre][Nombre][Estado], ...]
+ *          [EstadoPropio]
+ *          [PrimeraSeq (u32)][NumMensajes][HayMas][[LongitudEmisor][Emisor][LongitudMensaje][Mensaje], ...]
+ *          [NumChats][[LongitudChat][Chat][NoLeídos], ...]
+ * 
+ * Equivale a la lista completa (tipo 60), la página más reciente del chat
+ * general (tipo 57) y un aviso de los privados que llegaron mientras el
+ * usuario estaba desconectado, sin haber hecho ninguna solicitud.
+ * 
+ * @param data Mensaje recibido
+ */
+void MessageHandler::receiveWelcome(const QByteArray& data) {
+    FrameReader in(data, protocolVersion, 1);
+    quint32 epoch = 0;
+    if (!in.u32(epoch) || !readRoster(in, epoch, true)) return;
+
+    quint8 ownStatus = 1;
+    if (!in.u8(ownStatus)) return;
+    applyStatusChange(actualUser, ownStatus);
+
+    quint32 firstSeq, numMessages;
+    quint8 hasMoreFlag;
+    if (!in.u32(firstSeq) || !in.count(numMessages) || !in.u8(hasMoreFlag)) return;
+    vector<pair<string, string>> page;
+    page.reserve(qMin<quint32>(numMessages, in.remaining() / 2));  // Cada mensaje ocupa al menos 2 bytes
+    for (quint32 i = 0; i < numMessages; i++) {
+        string username, content;
+        if (!in.stdString(username) || !in.stdString(content)) return;
+        page.emplace_back(std::move(username), std::move(content));
+    }
+    loadLatestPage("~", firstSeq, hasMoreFlag != 0, std::move(page));
+
+    quint32 numChats = 0;
+    if (!in.count(numChats)) return;
+    QStringList unread;
+    for (quint32 i = 0; i < numChats; i++) {
+        QString chatName;
+        quint32 count = 0;
+        if (!in.text(chatName) || !in.count(count)) break;
+        unread << chatName + " (" + QString::number(count) + ")";
+    }
+    if (!unread.isEmpty()) {
+        notificationLabel->setText("Mensajes sin leer de: " + unread.join(", "));
+        notificationLabel->show();
+        notificationTimer->start(5000);
+    }
+}
@@ -11,7 +11,12 @@
 #include <QComboBox>
 #include <functional> // Para usar std::function
 #include <queue>
+#include <string>
 #include <unordered_map>
+#include <utility>
+#include <vector>
+
+class FrameReader;
 
 
 class MessageHandler : public QObject {
@@ -25,10 +30,14 @@ public:
         QObject* parent = nullptr);
 
     void requestChatHistory(const QString& chatName);
+    void requestOlderHistory(const QString& chatName);
     void requestChangeState(const QString& username, uint8_t newStatus);
     void requestUserInfo(const QString& username);
     void setUserInfoCallback(std::function<void(const QString&, int)> callback);
     void setActualUser(const QString& username);
+    void setProtocolVersion(int version);
+    // En v2 el servidor envía la lista y el chat general al conectar (tipo 62): no hay que pedirlos
+    bool receivesWelcome() const { return protocolVersion >= 2; }
     const std::unordered_map<std::string, std::string>& getUserStates() const { 
         return userStates; 
     }
@@ -44,7 +53,13 @@ private slots:
     void onStateChanged(int index);
     void showChatMessages(const QString& user2);
     QString get_chat_id(const QString& user2);
-    void storeMessage(const QString& sender, const QString& message);
+    void storeMessage(const QString& sender, const QString& message, quint32 seq);
+    void handleFrame(const QByteArray& data);
+    void receiveHistoryPage(const QByteArray& data);
+    void receiveInbox(const QByteArray& data);
+    void receiveWelcome(const QByteArray& data);
+    void applyStatusChange(const QString& username, quint8 newStatus);
+    void applyRosterEntry(const QString& username, quint8 status);
 
 private:
     QWebSocket& socket;
@@ -65,13 +80,31 @@ private:
     std::unordered_map<std::string, std::string> userStates;
     // Creador de mensajes para el server
     QByteArray buildMessage(quint8 type, const QString& param1, const QString& param2 = "");
+    bool fitsMessageLimit(const QString& message) const;
+    int protocolVersion = 1;  // Versión del protocolo negociada al conectar
+    quint32 rosterEpoch = 0;  // Última época de la lista de usuarios recibida (0: ninguna)
     
     // Callback para manejar información de usuario
     std::function<void(const QString&, int)> m_userInfoCallback;
 
     //Otras variables
     QString actualUser;
-    std::queue<QString> pendingHistoryRequests;
+
+    // Estado de la carga por páginas de cada chat (clave: nombre del chat solicitado)
+    enum class PageKind { Latest, Older, Since };
+    struct HistoryCursor {
+        bool loaded = false;             // Si ya llegó la página más reciente
+        quint32 oldestSeq = 0;           // Secuencia del mensaje más antiguo cargado
+        quint32 nextSeq = 0;             // Secuencia del próximo mensaje que falta
+        bool hasMore = false;            // Si el servidor tiene mensajes anteriores
+        std::queue<PageKind> pending;    // Páginas solicitadas, en orden
+    };
+    std::unordered_map<std::string, HistoryCursor> historyCursors;
+    void sendHistoryRequest(quint8 type, const QString& chatName, quint32 seq);
+    bool appendMessage(const QString& chatName, std::string sender, std::string content, quint32 seq);
+    void loadLatestPage(const QString& chatName, quint32 firstSeq, bool hasMore,
+                        std::vector<std::pair<std::string, std::string>> page);
+    bool readRoster(FrameReader& in, quint32 epoch, bool full);
     std::function<void(const std::unordered_map<std::string, std::string>&)> m_userListReceivedCallback;
 };
 
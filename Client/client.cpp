@@ -220,6 +220,8 @@ public slots:
         auto *response = http.get(QNetworkRequest(httpURL));
         connect(response, &QNetworkReply::finished, this, [this, response, host, port, username](){
             int replyCode = response->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+            // Versión más nueva del protocolo que acepta el servidor (sin encabezado: v1)
+            int serverProtocol = response->rawHeader("X-Chat-Protocol").toInt();
             response->deleteLater();
 
             qDebug()<<"REPLY CODE "<<replyCode;
@@ -230,6 +232,10 @@ public slots:
             } else if (replyCode >= 200 && replyCode < 300) {
                 qDebug() << "Valida la respuesta HTTP, procediendo a conectar con websocket";
                 QString url = QString("ws://%1:%2?name=%3").arg(host, port, username);
+                // Usar el protocolo v2 (longitudes varint) si el servidor lo acepta
+                int protocol = serverProtocol >= 2 ? 2 : 1;
+                if (protocol == 2) url += "&v=2";
+                messageHandler->setProtocolVersion(protocol);
                 statusLabel->setText("Conectando a " + url + "...");
         
                 connect(&socket, QOverload<QAbstractSocket::SocketError>::of(&QWebSocket::error),
@@ -364,9 +370,11 @@ public slots:
         refreshButtonGeneral->show();
         refreshButtonPrivate->show();
 
-        // Solicitar historial de chat general
+        // Solicitar historial de chat general (en v2 llega solo, con el estado inicial)
         generalChatArea->clear();  // Limpiar antes de mostrar los mensajes
-        messageHandler->requestChatHistory("~"); // Cargar historial del canal
+        if (!messageHandler->receivesWelcome()) {
+            messageHandler->requestChatHistory("~"); // Cargar historial del canal
+        }
 
         // Mostrar la interfaz de chat personal
         chatLabel->show();
@@ -384,8 +392,10 @@ public slots:
         // Registrar nombre de usuario
         messageHandler->setActualUser(usernameInput->text());
         
-        // Solicitar lista de usuarios
-        messageHandler->requestUsersList();
+        // Solicitar lista de usuarios (en v2 llega con el estado inicial)
+        if (!messageHandler->receivesWelcome()) {
+            messageHandler->requestUsersList();
+        }
 
         inactivityTimer->start(40000);
     }    
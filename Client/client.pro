@@ -4,11 +4,13 @@ CONFIG += c++11
 HEADERS += \
     OptionsDialog.h \
     client.h \
-    MessageHandler.h
-    Ayuda.h\
+    MessageHandler.h \
+    FrameReader.h \
+    Ayuda.h
 
 SOURCES += \
     OptionsDialog.cpp \
     client.cpp \
-    MessageHandler.cpp\
-    Ayuda.cpp
\ No newline at end of file
+    MessageHandler.cpp \
+    FrameReader.cpp \
+    Ayuda.cpp
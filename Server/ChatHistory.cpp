@@ -0,0 +1,369 @@
+#include "ChatHistory.h"
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+namespace {
+// Cabecera de cada registro en el arena: id del emisor y longitud del cuerpo
+constexpr std::size_t RECORD_HEADER = 2 * sizeof(std::uint32_t);
+// No vale la pena compactar arenas más pequeños que esto
+constexpr std::size_t MIN_COMPACT_BYTES = 4096;
+}
+
+/**
+ * Crea el historial con la profundidad por chat y el límite global indicados.
+ *
+ * @param symbols Tabla con los nombres de los emisores
+ * @param depth Mensajes que se conservan por chat
+ * @param maxBytes Memoria máxima para todos los chats
+ */
+ChatHistory::ChatHistory(SymbolTable& symbols, std::size_t depth, std::size_t maxBytes)
+    : symbols(symbols), depth(depth == 0 ? 1 : depth), maxBytes(maxBytes) {}
+
+/**
+ * Cambia los límites. Debe llamarse al arrancar, antes de guardar mensajes.
+ *
+ * @param newDepth Mensajes que se conservan por chat
+ * @param newMaxBytes Memoria máxima para todos los chats
+ */
+void ChatHistory::configure(std::size_t newDepth, std::size_t newMaxBytes) {
+    std::unique_lock<std::shared_mutex> lock(chatsMutex);
+    depth = newDepth == 0 ? 1 : newDepth;
+    maxBytes = newMaxBytes;
+}
+
+/**
+ * Conecta un registro persistente. Debe llamarse al arrancar, antes de
+ * guardar mensajes: la numeración de cada chat continúa desde el registro.
+ *
+ * Los participantes de los chats privados del registro se agregan a la
+ * tabla de símbolos, para que su historial se pueda pedir aunque todavía no
+ * se hayan conectado en esta ejecución. El nombre "a-b" es ambiguo si los
+ * nombres llevan guiones, así que se separa usando al emisor del primer
+ * mensaje, que es uno de los dos.
+ *
+ * @param messageLog Registro donde se guardará cada mensaje
+ */
+void ChatHistory::attach_log(std::shared_ptr<MessageLog> messageLog) {
+    messageLog->for_each_chat([this](std::string_view chatId, std::string_view sender) {
+        if (chatId == "~" || chatId.size() <= sender.size()) return;
+        std::size_t rest = chatId.size() - sender.size() - 1;
+        if (chatId.compare(0, sender.size(), sender) == 0 && chatId[sender.size()] == '-') {
+            symbols.intern(sender);
+            symbols.intern(chatId.substr(sender.size() + 1));
+        } else if (chatId.compare(rest + 1, sender.size(), sender) == 0 && chatId[rest] == '-') {
+            symbols.intern(sender);
+            symbols.intern(chatId.substr(0, rest));
+        }
+    });
+
+    std::unique_lock<std::shared_mutex> lock(chatsMutex);
+    log = std::move(messageLog);
+}
+
+/**
+ * Busca un chat existente y marca su último acceso.
+ *
+ * @param chatId Clave del chat
+ */
+std::shared_ptr<ChatHistory::Chat> ChatHistory::find_chat(ChatKey chatId) {
+    std::shared_lock<std::shared_mutex> lock(chatsMutex);
+    auto it = chats.find(chatId);
+    if (it == chats.end()) return nullptr;
+    it->second->lastAccess = ++clock;
+    return it->second;
+}
+
+/**
+ * Busca un chat y lo crea si no existe.
+ *
+ * @param chatId Clave del chat
+ */
+std::shared_ptr<ChatHistory::Chat> ChatHistory::find_or_create_chat(ChatKey chatId) {
+    if (auto chat = find_chat(chatId)) return chat;
+
+    std::unique_lock<std::shared_mutex> lock(chatsMutex);
+    auto& chat = chats[chatId];
+    if (!chat) {
+        chat = std::make_shared<Chat>();
+        if (log) chat->logName = symbols.chat_name(chatId);
+        // Sin registro, un chat descartado no puede repetir secuencias al
+        // volver: todo chat nuevo empieza después de la mayor descartada
+        chat->nextSeq = log ? log->count(chat->logName) : seqFloor;
+    }
+    chat->lastAccess = ++clock;
+    return chat;
+}
+
+/**
+ * Agranda el anillo cuando está lleno pero todavía no llega a la profundidad
+ * configurada. Los chats pequeños no reservan `depth` posiciones de entrada.
+ *
+ * @param chat Chat con su candado tomado
+ */
+void ChatHistory::grow_ring(Chat& chat) {
+    if (chat.count < chat.ring.size() || chat.ring.size() >= depth) return;
+
+    // Dejar el mensaje más antiguo en la posición 0 antes de crecer
+    std::rotate(chat.ring.begin(), chat.ring.begin() + chat.head, chat.ring.end());
+    chat.head = 0;
+    chat.ring.resize(std::min(depth, std::max<std::size_t>(8, chat.ring.size() * 2)));
+}
+
+/**
+ * Descarta del arena los bytes de mensajes que ya salieron del anillo.
+ * Solo mueve memoria cuando la parte muerta es al menos la mitad del arena,
+ * así que el costo por mensaje se mantiene constante en promedio.
+ *
+ * @param chat Chat con su candado tomado
+ * @param force Compactar aunque la parte muerta sea pequeña
+ */
+void ChatHistory::compact(Chat& chat, bool force) {
+    std::size_t dead = chat.count == 0 ? chat.arena.size() : chat.ring[chat.head].offset;
+    if (dead == 0 || (!force && (dead < MIN_COMPACT_BYTES || dead * 2 < chat.arena.size()))) return;
+
+    chat.arena.erase(chat.arena.begin(), chat.arena.begin() + dead);
+    for (std::size_t i = 0; i < chat.count; ++i) {
+        chat.ring[(chat.head + i) % chat.ring.size()].offset -= static_cast<std::uint32_t>(dead);
+    }
+}
+
+/**
+ * Hace lugar en el arena para un registro de `bytes`. Descartar chats no
+ * alcanza cuando uno solo (en la práctica el general) llega al límite, así
+ * que si el arena tendría que crecer por encima de lo que le toca se
+ * descartan sus mensajes más antiguos hasta que lo vivo ocupe la mitad y se
+ * reutiliza el espacio sin volver a reservar.
+ *
+ * Lo que le toca a un chat nunca pasa de UINT32_MAX, así que las posiciones
+ * del anillo caben en 32 bits.
+ *
+ * @param chat Chat con su candado tomado
+ * @param bytes Tamaño del registro que se va a agregar
+ */
+void ChatHistory::make_room(Chat& chat, std::size_t bytes) {
+    std::size_t needed = chat.arena.size() + bytes;
+    if (needed <= chat.arena.capacity()) return;
+
+    std::size_t ringBytes = chat.ring.capacity() * sizeof(Slot);
+    std::size_t target = maxBytes / 10 * 9;
+    std::size_t budget = std::min<std::size_t>(target > ringBytes ? target - ringBytes : 0, UINT32_MAX);
+    // Un vector que crece al menos duplica su reserva
+    if (std::max(needed, chat.arena.capacity() * 2) <= budget) return;
+
+    std::size_t live = chat.count == 0 ? 0 : chat.arena.size() - chat.ring[chat.head].offset;
+    while (chat.count > 0 && live + bytes > budget / 2) {
+        live -= chat.ring[chat.head].size;
+        chat.head = (chat.head + 1) % chat.ring.size();
+        --chat.count;
+        --messageCount;
+    }
+    compact(chat, true);
+    if (chat.arena.capacity() < live + bytes) {
+        chat.arena.reserve(std::max(budget, live + bytes));
+    }
+}
+
+/**
+ * Actualiza el contador global con la memoria reservada por un chat.
+ *
+ * @param chat Chat con su candado tomado
+ */
+void ChatHistory::account(Chat& chat) {
+    std::size_t now = chat.arena.capacity() + chat.ring.capacity() * sizeof(Slot);
+    if (now >= chat.accounted) {
+        bytesUsed += now - chat.accounted;
+    } else {
+        bytesUsed -= chat.accounted - now;
+    }
+    chat.accounted = now;
+}
+
+/**
+ * Guarda un mensaje al final del historial de un chat.
+ * Si el anillo está lleno se pierde el mensaje más antiguo.
+ *
+ * @param chatId Clave del chat
+ * @param sender Id del emisor
+ * @param body Contenido del mensaje
+ * @return Número de secuencia asignado al mensaje
+ */
+std::uint64_t ChatHistory::append(ChatKey chatId, UserId sender, std::string_view body) {
+    if (body.size() > UINT32_MAX - RECORD_HEADER) {
+        throw std::length_error("Mensaje demasiado grande para el historial");
+    }
+    std::uint64_t seq;
+    for (;;) {
+        auto chat = find_or_create_chat(chatId);
+        std::lock_guard<std::mutex> lock(chat->mutex);
+        if (chat->evicted) continue;  // Se descartó mientras tanto: usar el chat nuevo
+        if (log) {
+            // Dentro del candado del chat: el orden en disco coincide con la secuencia
+            log->append(chat->logName, symbols.name(sender), body);
+        }
+
+        grow_ring(*chat);
+        if (chat->count == chat->ring.size()) {
+            // Anillo lleno: el mensaje más antiguo deja de estar vivo
+            chat->head = (chat->head + 1) % chat->ring.size();
+            --chat->count;
+            --messageCount;
+        }
+        compact(*chat);
+        make_room(*chat, RECORD_HEADER + body.size());
+
+        Slot slot{static_cast<std::uint32_t>(chat->arena.size()),
+                  static_cast<std::uint32_t>(RECORD_HEADER + body.size())};
+        std::uint32_t bodyLen = static_cast<std::uint32_t>(body.size());
+        chat->arena.resize(chat->arena.size() + slot.size);
+        unsigned char* out = chat->arena.data() + slot.offset;
+        std::memcpy(out, &sender, sizeof(sender));
+        std::memcpy(out + sizeof(sender), &bodyLen, sizeof(bodyLen));
+        std::memcpy(out + RECORD_HEADER, body.data(), body.size());
+
+        chat->ring[(chat->head + chat->count) % chat->ring.size()] = slot;
+        ++chat->count;
+        ++messageCount;
+        seq = chat->nextSeq++;
+        account(*chat);
+        break;
+    }
+
+    if (bytesUsed > maxBytes) {
+        evict_if_needed();
+    }
+    return seq;
+}
+
+/**
+ * Secuencia que recibirá el próximo mensaje de un chat. Con registro es
+ * cuántos mensajes ha tenido el chat desde siempre; sin él, un chat que no
+ * está en memoria empieza después de la mayor secuencia descartada.
+ *
+ * @param chatId Clave del chat
+ */
+std::uint64_t ChatHistory::next_seq(ChatKey chatId) {
+    if (auto chat = find_chat(chatId)) {
+        std::lock_guard<std::mutex> lock(chat->mutex);
+        return chat->nextSeq;
+    }
+    if (log) return log->count(symbols.chat_name(chatId));
+    std::shared_lock<std::shared_mutex> lock(chatsMutex);
+    return seqFloor;
+}
+
+/**
+ * Secuencia del mensaje más antiguo que todavía se puede leer de un chat.
+ * Con registro es 0; sin él, el más antiguo que sigue en el anillo (o
+ * next_seq() si el chat no tiene nada en memoria).
+ *
+ * @param chatId Clave del chat
+ */
+std::uint64_t ChatHistory::oldest_seq(ChatKey chatId) {
+    if (log) return 0;
+    if (auto chat = find_chat(chatId)) {
+        std::lock_guard<std::mutex> lock(chat->mutex);
+        return chat->nextSeq - chat->count;
+    }
+    return next_seq(chatId);
+}
+
+/**
+ * Recorre los mensajes de un chat con secuencia en [from, to), del más
+ * antiguo al más nuevo. Los que siguen en el anillo se leen del arena; los
+ * anteriores, del registro persistente si hay uno. Las vistas solo son
+ * válidas durante la llamada.
+ *
+ * @param chatId Clave del chat
+ * @param from Primera secuencia a incluir
+ * @param to Secuencia siguiente a la última a incluir
+ * @param fn Función a ejecutar por cada mensaje
+ * @return Cantidad de mensajes recorridos
+ */
+std::size_t ChatHistory::read(ChatKey chatId, std::uint64_t from, std::uint64_t to, const Visitor& fn) {
+    auto chat = find_chat(chatId);
+    if (!chat) {
+        return (log && from < to) ? log->read(symbols.chat_name(chatId), from, to, fn) : 0;
+    }
+
+    std::lock_guard<std::mutex> lock(chat->mutex);
+    std::uint64_t firstSeq = chat->nextSeq - chat->count;
+    to = std::min(to, chat->nextSeq);
+    std::size_t visited = 0;
+
+    // Parte vieja: ya no está en el anillo
+    if (log && from < std::min(to, firstSeq)) {
+        visited += log->read(chat->logName, from, std::min(to, firstSeq), fn);
+    }
+
+    // Parte reciente: directo del arena
+    for (std::uint64_t seq = std::max(from, firstSeq); seq < to; ++seq) {
+        const Slot& slot = chat->ring[(chat->head + (seq - firstSeq)) % chat->ring.size()];
+        const unsigned char* record = chat->arena.data() + slot.offset;
+        std::uint32_t senderId, bodyLen;
+        std::memcpy(&senderId, record, sizeof(senderId));
+        std::memcpy(&bodyLen, record + sizeof(senderId), sizeof(bodyLen));
+        fn(seq, symbols.name(senderId),
+           std::string_view(reinterpret_cast<const char*>(record + RECORD_HEADER), bodyLen));
+        ++visited;
+    }
+    return visited;
+}
+
+/**
+ * Recorre los últimos `depth` mensajes de un chat, del más antiguo al más nuevo.
+ *
+ * @param chatId Clave del chat
+ * @param fn Función a ejecutar por cada mensaje
+ * @return Cantidad de mensajes recorridos
+ */
+std::size_t ChatHistory::for_each(ChatKey chatId, const Visitor& fn) {
+    std::uint64_t next = next_seq(chatId);
+    return read(chatId, next > depth ? next - depth : 0, next, fn);
+}
+
+/**
+ * Mensajes que se conservan en memoria por chat.
+ */
+std::size_t ChatHistory::max_depth() const {
+    std::shared_lock<std::shared_mutex> lock(chatsMutex);
+    return depth;
+}
+
+/**
+ * Descarta los chats usados hace más tiempo hasta bajar del 90% del límite.
+ */
+void ChatHistory::evict_if_needed() {
+    std::unique_lock<std::shared_mutex> lock(chatsMutex);
+    if (bytesUsed <= maxBytes) return;
+
+    std::vector<std::pair<std::uint64_t, ChatKey>> byAge;
+    byAge.reserve(chats.size());
+    for (const auto& [chatId, chat] : chats) {
+        byAge.emplace_back(chat->lastAccess.load(), chatId);
+    }
+    std::sort(byAge.begin(), byAge.end());
+
+    std::size_t target = maxBytes / 10 * 9;
+    for (const auto& [lastAccess, chatId] : byAge) {
+        if (bytesUsed <= target || chats.size() <= 1) break;
+        auto it = chats.find(chatId);
+        {
+            std::lock_guard<std::mutex> chatLock(it->second->mutex);
+            bytesUsed -= it->second->accounted;
+            messageCount -= it->second->count;
+            if (!log) seqFloor = std::max(seqFloor, it->second->nextSeq);
+            it->second->evicted = true;
+        }
+        chats.erase(it);
+        ++evictedChats;
+    }
+}
+
+/**
+ * Devuelve las métricas actuales del historial.
+ */
+HistoryStats ChatHistory::stats() const {
+    std::shared_lock<std::shared_mutex> lock(chatsMutex);
+    return {bytesUsed.load(), maxBytes, chats.size(), messageCount.load(), evictedChats.load()};
+}
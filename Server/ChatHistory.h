@@ -0,0 +1,111 @@
+#ifndef CHATHISTORY_H
+#define CHATHISTORY_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include "MessageLog.h"
+#include "Symbols.h"
+
+/**
+ * Métricas del historial en memoria.
+ */
+struct HistoryStats {
+    std::size_t bytesUsed;      // Bytes reservados por todos los chats
+    std::size_t maxBytes;       // Límite global configurado
+    std::size_t chats;          // Chats con historial en memoria
+    std::size_t messages;       // Mensajes guardados en total
+    std::uint64_t evictedChats; // Chats descartados por falta de memoria
+};
+
+/**
+ * Historial de chats acotado.
+ *
+ * Cada chat guarda sus últimos `depth` mensajes en un anillo. Los mensajes se
+ * empaquetan de forma contigua en un arena por chat como
+ * [id_emisor u32][longitud u32][cuerpo], en lugar de dos std::string por
+ * mensaje. Los chats se identifican por su ChatKey y los emisores por su id
+ * en la tabla de símbolos: guardar un mensaje no arma ni compara nombres.
+ * Un contador global lleva los bytes usados y, al pasar el límite, se
+ * descartan los chats que llevan más tiempo sin usarse. Un chat que por sí
+ * solo llegaría al límite pierde sus mensajes más antiguos antes de tener
+ * `depth`.
+ *
+ * Cada mensaje recibe un número de secuencia por chat que solo crece. Sin
+ * registro no se recuerda nada de un chat descartado: los chats nuevos
+ * empiezan en la mayor secuencia que tuvo uno descartado, así que la
+ * numeración de uno que vuelve nunca retrocede.
+ *
+ * Con un MessageLog conectado, todo mensaje también se guarda en disco y el
+ * anillo funciona como la capa caliente: lo que ya no está en memoria (por
+ * antigüedad, por descarte o tras reiniciar) se lee del registro mapeado.
+ * El registro sigue guardando los chats por nombre ("~", "ana-bob"), así
+ * que sobrevive a que los ids cambien entre ejecuciones.
+ */
+class ChatHistory {
+public:
+    using Visitor = std::function<void(std::uint64_t seq, std::string_view sender, std::string_view body)>;
+
+    explicit ChatHistory(SymbolTable& symbols, std::size_t depth = 1000, std::size_t maxBytes = 256u << 20);
+
+    void configure(std::size_t depth, std::size_t maxBytes);
+    void attach_log(std::shared_ptr<MessageLog> log);
+    std::uint64_t append(ChatKey chatId, UserId sender, std::string_view body);
+    std::uint64_t next_seq(ChatKey chatId);
+    std::uint64_t oldest_seq(ChatKey chatId);
+    std::size_t read(ChatKey chatId, std::uint64_t from, std::uint64_t to, const Visitor& fn);
+    std::size_t for_each(ChatKey chatId, const Visitor& fn);
+    std::size_t max_depth() const;
+    HistoryStats stats() const;
+
+private:
+    struct Slot {
+        std::uint32_t offset;  // Posición del registro dentro del arena
+        std::uint32_t size;    // Tamaño total del registro
+    };
+
+    struct Chat {
+        std::mutex mutex;
+        std::vector<unsigned char> arena;   // Registros empaquetados, del más viejo al más nuevo
+        std::vector<Slot> ring;             // Anillo de mensajes vivos
+        std::size_t head = 0;               // Índice del mensaje más antiguo en el anillo
+        std::size_t count = 0;              // Mensajes vivos
+        std::uint64_t nextSeq = 0;          // Secuencia del próximo mensaje
+        std::size_t accounted = 0;          // Bytes sumados al contador global
+        bool evicted = false;               // Si ya fue descartado del mapa
+        std::string logName;                // Nombre en el registro persistente (si hay uno)
+        std::atomic<std::uint64_t> lastAccess{0};
+    };
+
+    std::shared_ptr<Chat> find_chat(ChatKey chatId);
+    std::shared_ptr<Chat> find_or_create_chat(ChatKey chatId);
+    void grow_ring(Chat& chat);
+    void compact(Chat& chat, bool force = false);
+    void make_room(Chat& chat, std::size_t bytes);
+    void account(Chat& chat);
+    void evict_if_needed();
+
+    SymbolTable& symbols;
+    std::size_t depth;
+    std::size_t maxBytes;
+    std::shared_ptr<MessageLog> log;  // Capa persistente opcional
+
+    mutable std::shared_mutex chatsMutex;
+    std::unordered_map<ChatKey, std::shared_ptr<Chat>> chats;
+    std::uint64_t seqFloor = 0;  // Mayor secuencia de un chat descartado (sin registro)
+
+    std::atomic<std::size_t> bytesUsed{0};
+    std::atomic<std::size_t> messageCount{0};
+    std::atomic<std::uint64_t> clock{0};
+    std::atomic<std::uint64_t> evictedChats{0};
+};
+
+#endif // CHATHISTORY_H
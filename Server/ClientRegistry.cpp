@@ -0,0 +1,239 @@
+#include "ClientRegistry.h"
+#include <algorithm>
+#include <mutex>
+
+// Entradas viejas toleradas en la cola de desconexiones antes de reconstruirla
+constexpr std::size_t STALE_DEPARTURES = 64;
+
+/**
+ * Crea el registro con la cantidad de fragmentos indicada.
+ *
+ * @param shardCount Número de fragmentos (al menos 1)
+ */
+ClientRegistry::ClientRegistry(std::size_t shardCount)
+    : shardCount(shardCount == 0 ? 1 : shardCount), shards(new Shard[this->shardCount]) {}
+
+/**
+ * Devuelve el fragmento responsable de un usuario. Los ids son consecutivos,
+ * así que se reparten parejo sin calcular un hash.
+ *
+ * @param user Id del usuario
+ */
+ClientRegistry::Shard& ClientRegistry::shard_for(UserId user) const {
+    return shards[user % shardCount];
+}
+
+/**
+ * Busca un usuario.
+ *
+ * @param user Id del usuario
+ * @return Copia de la entrada (sin sesión y con estado 0 si está
+ *         desconectado), o vacío si el usuario no existe
+ */
+std::optional<ClientSession> ClientRegistry::lookup(UserId user) const {
+    Shard& shard = shard_for(user);
+    std::shared_lock<std::shared_mutex> lock(shard.mutex);
+    auto it = shard.live.find(user);
+    if (it != shard.live.end()) return it->second;
+    if (shard.offline.count(user)) return ClientSession{nullptr, 0, {}};
+    return std::nullopt;
+}
+
+/**
+ * Busca la sesión y el estado de un usuario, sin copiar el resto de la entrada.
+ *
+ * @param user Id del usuario
+ * @return Sesión y estado (sin sesión y con estado 0 si está desconectado),
+ *         o vacío si el usuario no existe
+ */
+std::optional<SessionRef> ClientRegistry::find_session(UserId user) const {
+    Shard& shard = shard_for(user);
+    std::shared_lock<std::shared_mutex> lock(shard.mutex);
+    auto it = shard.live.find(user);
+    if (it != shard.live.end()) return SessionRef{it->second.session, it->second.status};
+    if (shard.offline.count(user)) return SessionRef{nullptr, 0};
+    return std::nullopt;
+}
+
+/**
+ * Cambia el estado de un usuario conectado.
+ *
+ * @param user Id del usuario
+ * @param status Nuevo estado
+ * @return false si el usuario no existe o está desconectado
+ */
+bool ClientRegistry::set_status(UserId user, int status) {
+    Shard& shard = shard_for(user);
+    std::unique_lock<std::shared_mutex> lock(shard.mutex);
+    auto it = shard.live.find(user);
+    if (it == shard.live.end()) return false;
+    it->second.status = status;
+    return true;
+}
+
+/**
+ * Cambia el estado de un usuario solo si todavía tiene el esperado, para
+ * que un cambio automático no pise uno que el usuario hizo mientras tanto.
+ *
+ * @param user Id del usuario
+ * @param expected Estado que debe tener
+ * @param status Nuevo estado
+ * @return false si el usuario no existe o su estado es otro
+ */
+bool ClientRegistry::replace_status(UserId user, int expected, int status) {
+    Shard& shard = shard_for(user);
+    std::unique_lock<std::shared_mutex> lock(shard.mutex);
+    auto it = shard.live.find(user);
+    if (it == shard.live.end() || it->second.status != expected) return false;
+    it->second.status = status;
+    return true;
+}
+
+/**
+ * Registra un usuario al completar el handshake, de forma atómica respecto a
+ * otros intentos con el mismo nombre.
+ *
+ * @param user Id del usuario
+ * @param client Entrada para la nueva sesión
+ * @return Si el usuario es nuevo, se reconectó o el nombre está ocupado
+ */
+RegisterResult ClientRegistry::try_register(UserId user, ClientSession client) {
+    Shard& shard = shard_for(user);
+    std::unique_lock<std::shared_mutex> lock(shard.mutex);
+    if (shard.live.count(user)) return RegisterResult::Taken;
+
+    bool known = shard.offline.erase(user) > 0;
+    shard.live.emplace(user, std::move(client));
+    return known ? RegisterResult::Reconnected : RegisterResult::New;
+}
+
+/**
+ * Pasa a un usuario al directorio de desconectados, solo si la entrada
+ * todavía pertenece a la sesión indicada (una reconexión pudo haberla
+ * reemplazado). La entrada suelta la sesión y la IP.
+ *
+ * @param user Id del usuario
+ * @param owner Sesión que se está cerrando
+ * @return true si el estado cambió
+ */
+bool ClientRegistry::mark_disconnected(UserId user, const Session* owner) {
+    Shard& shard = shard_for(user);
+    std::unique_lock<std::shared_mutex> lock(shard.mutex);
+    auto it = shard.live.find(user);
+    if (it == shard.live.end() || it->second.session.get() != owner) return false;
+
+    auto now = std::chrono::steady_clock::now();
+    shard.offline[user] = OfflineUser{now, it->second.status};
+    shard.departures.emplace_back(user, now);
+    shard.live.erase(it);
+    return true;
+}
+
+/**
+ * Olvida a los usuarios desconectados antes de `cutoff` y, si en un
+ * fragmento hay más de su parte de `maxOffline`, a los más antiguos de él.
+ * También descarta de la cola de desconexiones a quienes ya volvieron.
+ *
+ * @param cutoff Se olvida a quien se desconectó antes (time_point::min(): nadie por antigüedad)
+ * @param maxOffline Desconectados que se conservan en total (0: sin límite)
+ * @return Usuarios olvidados
+ */
+std::vector<UserId> ClientRegistry::expire_offline(std::chrono::steady_clock::time_point cutoff,
+                                                   std::size_t maxOffline) {
+    std::size_t shardLimit = maxOffline == 0 ? 0 : std::max<std::size_t>(1, maxOffline / shardCount);
+    std::vector<UserId> expired;
+    for (std::size_t i = 0; i < shardCount; ++i) {
+        Shard& shard = shards[i];
+        std::unique_lock<std::shared_mutex> lock(shard.mutex);
+        while (!shard.departures.empty()) {
+            auto [user, when] = shard.departures.front();
+            auto it = shard.offline.find(user);
+            bool current = it != shard.offline.end() && it->second.lastSeen == when;
+            bool over = shardLimit > 0 && shard.offline.size() > shardLimit;
+            if (current && when >= cutoff && !over) break;
+            shard.departures.pop_front();
+            if (current) {
+                shard.offline.erase(it);
+                expired.push_back(user);
+            }
+        }
+
+        // Con muchas reconexiones la cola acumula entradas viejas detrás de
+        // la primera vigente: se reconstruye a partir del directorio
+        if (shard.departures.size() > 2 * shard.offline.size() + STALE_DEPARTURES) {
+            std::vector<Departure> current;
+            current.reserve(shard.offline.size());
+            for (const auto& [user, record] : shard.offline) current.emplace_back(user, record.lastSeen);
+            std::sort(current.begin(), current.end(),
+                      [](const Departure& a, const Departure& b) { return a.second < b.second; });
+            shard.departures.assign(current.begin(), current.end());
+        }
+    }
+    return expired;
+}
+
+/**
+ * Recorre todos los usuarios registrados con su estado: primero los
+ * conectados y luego los desconectados (estado 0), un fragmento a la vez.
+ *
+ * @param fn Función a ejecutar por cada usuario
+ */
+void ClientRegistry::for_each(const std::function<void(UserId, int)>& fn) const {
+    for (std::size_t i = 0; i < shardCount; ++i) {
+        std::shared_lock<std::shared_mutex> lock(shards[i].mutex);
+        for (const auto& [user, client] : shards[i].live) {
+            fn(user, client.status);
+        }
+    }
+    for (std::size_t i = 0; i < shardCount; ++i) {
+        std::shared_lock<std::shared_mutex> lock(shards[i].mutex);
+        for (const auto& entry : shards[i].offline) {
+            fn(entry.first, 0);
+        }
+    }
+}
+
+/**
+ * Recorre los usuarios conectados. No toca a los desconectados.
+ *
+ * @param fn Función a ejecutar por cada usuario conectado
+ */
+void ClientRegistry::for_each_online(const std::function<void(UserId, const ClientSession&)>& fn) const {
+    for (std::size_t i = 0; i < shardCount; ++i) {
+        std::shared_lock<std::shared_mutex> lock(shards[i].mutex);
+        for (const auto& [user, client] : shards[i].live) {
+            fn(user, client);
+        }
+    }
+}
+
+/**
+ * Cantidad total de usuarios registrados (conectados y desconectados).
+ */
+std::size_t ClientRegistry::size() const {
+    return online_size() + offline_size();
+}
+
+/**
+ * Cantidad de usuarios conectados.
+ */
+std::size_t ClientRegistry::online_size() const {
+    std::size_t total = 0;
+    for (std::size_t i = 0; i < shardCount; ++i) {
+        std::shared_lock<std::shared_mutex> lock(shards[i].mutex);
+        total += shards[i].live.size();
+    }
+    return total;
+}
+
+/**
+ * Cantidad de usuarios desconectados que todavía se recuerdan.
+ */
+std::size_t ClientRegistry::offline_size() const {
+    std::size_t total = 0;
+    for (std::size_t i = 0; i < shardCount; ++i) {
+        std::shared_lock<std::shared_mutex> lock(shards[i].mutex);
+        total += shards[i].offline.size();
+    }
+    return total;
+}
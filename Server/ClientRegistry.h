@@ -0,0 +1,110 @@
+#ifndef CLIENTREGISTRY_H
+#define CLIENTREGISTRY_H
+
+#include <chrono>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <shared_mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "Symbols.h"
+
+class Session;
+
+/**
+ * Estructura que representa una sesión de cliente.
+ * Mantiene la sesión WebSocket, el estado del usuario y su dirección IP.
+ */
+struct ClientSession {
+    std::shared_ptr<Session> session;                    // Sesión WebSocket para la comunicación
+    int status;                                          // Estado del usuario (0:Desconectado, 1:Activo, 2:Ocupado, 3:Inactivo)
+    std::string ipAddress;                               // Dirección IP del cliente
+};
+
+/**
+ * Lo que se recuerda de un usuario desconectado: sin sesión ni IP.
+ */
+struct OfflineUser {
+    std::chrono::steady_clock::time_point lastSeen;      // Cuándo se desconectó
+    int lastStatus;                                      // Estado que tenía al desconectarse
+};
+
+/**
+ * Sesión y estado de un usuario, sin el resto de la entrada.
+ * Es lo único que necesita el camino de reenvío de mensajes.
+ */
+struct SessionRef {
+    std::shared_ptr<Session> session;                    // Sesión WebSocket (puede ser nula)
+    int status;                                          // Estado del usuario
+};
+
+/**
+ * Resultado de registrar un usuario durante el handshake.
+ */
+enum class RegisterResult {
+    New,          // Usuario completamente nuevo
+    Reconnected,  // Usuario que estaba desconectado y volvió
+    Taken         // El nombre ya tiene una sesión activa
+};
+
+/**
+ * Registro concurrente de usuarios, indexado por id (ver SymbolTable).
+ * Los usuarios se reparten en fragmentos según su id; cada fragmento tiene
+ * su propio candado de lectura/escritura, así que consultas y cambios sobre
+ * usuarios distintos avanzan en paralelo.
+ *
+ * Los usuarios conectados y los desconectados van en tablas separadas: al
+ * desconectarse, la entrada pasa al directorio de desconectados (solo
+ * cuándo y con qué estado se fue) y suelta la sesión. Así las difusiones
+ * recorren solo sesiones vivas, por más usuarios que hayan pasado por el
+ * servidor. expire_offline() olvida a los desconectados más antiguos.
+ *
+ * Para quien consulta, un usuario desconectado sigue existiendo con estado
+ * 0 (Desconectado) y sin sesión; uno olvidado ya no existe.
+ *
+ * Las funciones que reciben un callback lo ejecutan con el candado del
+ * fragmento tomado: el callback debe ser corto y no debe volver a entrar
+ * al registro ni hacer E/S.
+ */
+class ClientRegistry {
+public:
+    explicit ClientRegistry(std::size_t shardCount = 64);
+
+    std::optional<ClientSession> lookup(UserId user) const;
+    std::optional<SessionRef> find_session(UserId user) const;
+    bool set_status(UserId user, int status);
+    bool replace_status(UserId user, int expected, int status);
+
+    RegisterResult try_register(UserId user, ClientSession client);
+    bool mark_disconnected(UserId user, const Session* owner);
+    std::vector<UserId> expire_offline(std::chrono::steady_clock::time_point cutoff, std::size_t maxOffline);
+
+    void for_each(const std::function<void(UserId, int)>& fn) const;
+    void for_each_online(const std::function<void(UserId, const ClientSession&)>& fn) const;
+    std::size_t size() const;
+    std::size_t online_size() const;
+    std::size_t offline_size() const;
+
+private:
+    using Departure = std::pair<UserId, std::chrono::steady_clock::time_point>;
+
+    struct alignas(64) Shard {
+        mutable std::shared_mutex mutex;
+        std::unordered_map<UserId, ClientSession> live;      // Usuarios conectados (estado 1-3)
+        std::unordered_map<UserId, OfflineUser> offline;     // Usuarios desconectados
+        // Desconexiones en orden, para olvidar primero a las más antiguas. Puede
+        // tener entradas de usuarios que ya volvieron; se saltan al recorrerla.
+        std::deque<Departure> departures;
+    };
+
+    Shard& shard_for(UserId user) const;
+
+    std::size_t shardCount;
+    std::unique_ptr<Shard[]> shards;
+};
+
+#endif // CLIENTREGISTRY_H
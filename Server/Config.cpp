@@ -0,0 +1,308 @@
+#include "Config.h"
+#include <algorithm>
+#include <charconv>
+#include <cstdlib>
+#include <fstream>
+#include <iterator>
+
+namespace {
+// Orden de los argumentos sin nombre (la forma original de la línea de comandos)
+const char* const POSITIONAL_KEYS[] = {
+    "hilos", "max_cola", "politica", "profundidad", "memoria_mb", "dir_historial", "lote_us",
+};
+
+// Claves que en la línea de comandos pueden ir sin valor (`--reuse_port` = `--reuse_port=si`)
+const char* const FLAG_KEYS[] = {"tcp_nodelay", "reuse_port"};
+
+/**
+ * Convierte un número entero completo (sin texto de más).
+ *
+ * @param text Texto
+ * @param value Destino (no cambia si el texto no es válido)
+ * @return false si no es un número válido para el tipo
+ */
+template <typename T>
+bool parse_number(std::string_view text, T& value) {
+    T parsed{};
+    auto result = std::from_chars(text.data(), text.data() + text.size(), parsed);
+    if (result.ec != std::errc() || result.ptr != text.data() + text.size()) return false;
+    value = parsed;
+    return true;
+}
+
+/**
+ * Convierte un sí/no ("si", "no", "true", "false", "on", "off", "1", "0").
+ *
+ * @param text Texto
+ * @param value Destino (no cambia si el texto no es válido)
+ * @return false si no es un valor reconocido
+ */
+bool parse_bool(std::string_view text, bool& value) {
+    if (text == "si" || text == "sí" || text == "true" || text == "on" || text == "1") {
+        value = true;
+        return true;
+    }
+    if (text == "no" || text == "false" || text == "off" || text == "0") {
+        value = false;
+        return true;
+    }
+    return false;
+}
+
+/**
+ * Quita espacios y tabuladores de los extremos.
+ */
+std::string_view trim(std::string_view text) {
+    std::size_t first = text.find_first_not_of(" \t\r");
+    if (first == std::string_view::npos) return {};
+    std::size_t last = text.find_last_not_of(" \t\r");
+    return text.substr(first, last - first + 1);
+}
+
+bool is_flag_key(std::string_view key) {
+    return std::find(std::begin(FLAG_KEYS), std::end(FLAG_KEYS), key) != std::end(FLAG_KEYS);
+}
+}
+
+/**
+ * Cambia una opción.
+ *
+ * @param key Nombre de la opción (ej. "puerto")
+ * @param value Valor como texto
+ * @param error Descripción del problema si el valor no es válido
+ * @return false si la clave no existe o el valor no es válido (la opción no cambia)
+ */
+bool ServerConfig::set(std::string_view key, std::string_view value, std::string& error) {
+    bool ok = true;
+    if (key == "direccion") {
+        ok = !value.empty();
+        if (ok) address = std::string(value);
+    } else if (key == "puerto") {
+        ok = parse_number(value, port) && port != 0;
+    } else if (key == "hilos") {
+        ok = parse_number(value, threads);
+    } else if (key == "aceptadores") {
+        ok = parse_number(value, acceptors);
+    } else if (key == "max_sesiones") {
+        ok = parse_number(value, maxSessions);
+    } else if (key == "max_usuarios") {
+        ok = parse_number(value, maxUsers);
+    } else if (key == "max_cola") {
+        ok = parse_number(value, outbound.maxMessages);
+        outbound.maxMessages = std::max<std::size_t>(1, outbound.maxMessages);
+    } else if (key == "politica") {
+        if (value == "drop-oldest") {
+            outbound.policy = OverflowPolicy::DropOldest;
+        } else if (value == "disconnect") {
+            outbound.policy = OverflowPolicy::Disconnect;
+        } else if (value == "coalesce") {
+            outbound.policy = OverflowPolicy::Coalesce;
+        } else {
+            ok = false;
+        }
+    } else if (key == "profundidad") {
+        ok = parse_number(value, historyDepth);
+    } else if (key == "memoria_mb") {
+        ok = parse_number(value, historyMegabytes);
+    } else if (key == "dir_historial") {
+        historyDir = value == "-" ? std::string() : std::string(value);
+    } else if (key == "max_bandeja") {
+        ok = parse_number(value, inboxCapacity);
+    } else if (key == "max_mensaje") {
+        ok = parse_number(value, maxMessageBytes) && maxMessageBytes > 0;
+    } else if (key == "lote_us") {
+        ok = parse_number(value, outbound.batchWindowUs);
+        outbound.batchWindowUs = std::max(-1L, outbound.batchWindowUs);
+    } else if (key == "log") {
+        auto level = Logger::parse_level(value);
+        ok = level.has_value();
+        if (ok) logLevel = *level;
+    } else if (key == "limites_tasa") {
+        ok = rateLimits.parse(value);
+    } else if (key == "tcp_nodelay") {
+        ok = parse_bool(value, socket.noDelay);
+    } else if (key == "reuse_port") {
+        ok = parse_bool(value, socket.reusePort);
+    } else if (key == "buffer_envio") {
+        ok = parse_number(value, socket.sendBuffer) && socket.sendBuffer >= 0;
+    } else if (key == "buffer_recepcion") {
+        ok = parse_number(value, socket.receiveBuffer) && socket.receiveBuffer >= 0;
+    } else if (key == "latido") {
+        ok = parse_number(value, keepalive.pingSeconds);
+    } else if (key == "tiempo_muerto") {
+        ok = parse_number(value, keepalive.deadSeconds);
+    } else if (key == "inactivo") {
+        ok = parse_number(value, keepalive.idleSeconds);
+    } else if (key == "retencion_desconectados") {
+        ok = parse_number(value, offline.seconds);
+    } else if (key == "max_desconectados") {
+        ok = parse_number(value, offline.maxUsers);
+    } else {
+        error = "opción desconocida: " + std::string(key);
+        return false;
+    }
+
+    if (!ok) {
+        error = "valor inválido para " + std::string(key) + ": " + std::string(value);
+    }
+    return ok;
+}
+
+/**
+ * Lee un archivo de configuración: una opción `clave = valor` por línea;
+ * las líneas vacías y lo que sigue a `#` se ignoran.
+ *
+ * @param path Ruta del archivo
+ * @param error Descripción del problema (con el número de línea)
+ * @return false si no se pudo abrir o tiene una línea inválida
+ */
+bool ServerConfig::load_file(const std::string& path, std::string& error) {
+    std::ifstream file(path);
+    if (!file) {
+        error = "no se pudo abrir " + path;
+        return false;
+    }
+
+    std::string line;
+    for (int number = 1; std::getline(file, line); ++number) {
+        std::string_view text = line;
+        text = trim(text.substr(0, text.find('#')));
+        if (text.empty()) continue;
+
+        std::size_t eq = text.find('=');
+        if (eq == std::string_view::npos) {
+            error = path + ":" + std::to_string(number) + ": se esperaba clave = valor";
+            return false;
+        }
+        if (!set(trim(text.substr(0, eq)), trim(text.substr(eq + 1)), error)) {
+            error = path + ":" + std::to_string(number) + ": " + error;
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * Aplica las variables de entorno CHAT_LOG_LEVEL y CHAT_RATE_LIMITS.
+ *
+ * @param error Descripción del problema
+ * @return false si alguna tiene un valor inválido
+ */
+bool ServerConfig::load_environment(std::string& error) {
+    if (const char* level = std::getenv("CHAT_LOG_LEVEL")) {
+        if (!set("log", level, error)) {
+            error = "CHAT_LOG_LEVEL: " + error;
+            return false;
+        }
+    }
+    if (const char* limits = std::getenv("CHAT_RATE_LIMITS")) {
+        if (!set("limites_tasa", limits, error)) {
+            error = "CHAT_RATE_LIMITS: " + error + " (ej. \"4=20/100,*=100/300\" u \"off\")";
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * Arma la configuración completa a partir de la línea de comandos: primero
+ * el archivo de --config (si hay), luego el entorno y al final el resto de
+ * los argumentos, en orden.
+ *
+ * @param argc Cantidad de argumentos
+ * @param argv Argumentos (argv[0] es el programa)
+ * @param error Descripción del problema
+ * @return false si algún argumento, el archivo o el entorno no son válidos
+ */
+bool ServerConfig::parse_args(int argc, char* argv[], std::string& error) {
+    for (int i = 1; i < argc; ++i) {
+        std::string_view arg = argv[i];
+        if (arg.rfind("--config=", 0) == 0) {
+            if (!load_file(std::string(arg.substr(9)), error)) return false;
+        } else if (arg == "--config") {
+            if (i + 1 >= argc) {
+                error = "falta el archivo de --config";
+                return false;
+            }
+            if (!load_file(argv[++i], error)) return false;
+        }
+    }
+
+    if (!load_environment(error)) return false;
+
+    std::size_t positional = 0;
+    for (int i = 1; i < argc; ++i) {
+        std::string_view arg = argv[i];
+        if (arg == "--help" || arg == "-h") {
+            help = true;
+            continue;
+        }
+        if (arg == "--config") {
+            ++i;
+            continue;
+        }
+        if (arg.rfind("--config=", 0) == 0) continue;
+
+        if (arg.rfind("--", 0) == 0) {
+            std::string_view key = arg.substr(2);
+            std::string_view value;
+            std::size_t eq = key.find('=');
+            if (eq != std::string_view::npos) {
+                value = key.substr(eq + 1);
+                key = key.substr(0, eq);
+            } else if (is_flag_key(key)) {
+                value = "si";
+            } else if (i + 1 < argc) {
+                value = argv[++i];
+            } else {
+                error = "falta el valor de --" + std::string(key);
+                return false;
+            }
+            if (!set(key, value, error)) return false;
+            continue;
+        }
+
+        if (positional >= std::size(POSITIONAL_KEYS)) {
+            error = "argumento de más: " + std::string(arg);
+            return false;
+        }
+        if (!set(POSITIONAL_KEYS[positional++], arg, error)) return false;
+    }
+    return true;
+}
+
+/**
+ * Texto de ayuda con las opciones disponibles.
+ */
+const char* ServerConfig::usage() {
+    return
+        "Uso: ./server [opciones] [hilos] [max_cola] [politica] [profundidad] [memoria_mb] [dir_historial|-] [lote_us]\n"
+        "\n"
+        "Opciones (en la línea de comandos como --clave=valor, en el archivo como clave = valor):\n"
+        "  --config ARCHIVO       Lee opciones de un archivo antes que el resto\n"
+        "  direccion              Dirección donde escuchar (0.0.0.0)\n"
+        "  puerto                 Puerto de los clientes y de /metrics (8080)\n"
+        "  hilos                  Hilos de trabajo (0: uno por núcleo)\n"
+        "  aceptadores            Sockets que aceptan conexiones, con SO_REUSEPORT si son varios (1; 0: uno por hilo)\n"
+        "  max_sesiones           Sesiones abiertas a la vez; las demás reciben 503 (0: sin límite)\n"
+        "  max_usuarios           Nombres distintos que se registran; los nuevos reciben 503 (0: ~16 millones)\n"
+        "  max_cola               Mensajes pendientes por sesión antes de aplicar la política (1024)\n"
+        "  politica               drop-oldest, disconnect o coalesce (drop-oldest)\n"
+        "  profundidad            Mensajes que se conservan por chat (1000)\n"
+        "  memoria_mb             Memoria máxima del historial (256)\n"
+        "  dir_historial          Directorio del historial persistente (- o vacío: sin persistencia)\n"
+        "  max_bandeja            Mensajes privados pendientes por usuario mientras no está Activo (1000; 0: sin bandejas)\n"
+        "  max_mensaje            Bytes máximos de un mensaje de chat; los más largos reciben el error 6 (4096)\n"
+        "  lote_us                Ventana de agrupación para clientes v2 en µs (-1: sin agrupar)\n"
+        "  log                    debug, info, warn, error u off (info; o CHAT_LOG_LEVEL)\n"
+        "  limites_tasa           tipo=tasa/ráfaga,...,*=tasa/ráfaga u off (o CHAT_RATE_LIMITS)\n"
+        "  tcp_nodelay            si/no: desactiva el algoritmo de Nagle (si)\n"
+        "  reuse_port             si/no: SO_REUSEPORT en el socket que escucha (no)\n"
+        "  buffer_envio           SO_SNDBUF en bytes (0: el del sistema)\n"
+        "  buffer_recepcion       SO_RCVBUF en bytes (0: el del sistema)\n"
+        "  latido                 Segundos sin recibir nada antes de enviar un ping (20; 0: sin pings)\n"
+        "  tiempo_muerto          Segundos sin recibir nada, ni un pong, antes de cerrar la conexión (60; 0: nunca)\n"
+        "  inactivo               Segundos sin solicitudes antes de pasar a Inactivo (300; 0: nunca)\n"
+        "  retencion_desconectados Segundos que se recuerda a un usuario desconectado (604800; 0: siempre)\n"
+        "  max_desconectados      Usuarios desconectados que se recuerdan; se olvida a los más antiguos (0: sin límite)\n";
+}
@@ -0,0 +1,98 @@
+#ifndef CONFIG_H
+#define CONFIG_H
+
+#include "Logger.h"
+#include "RateLimit.h"
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+/**
+ * Qué hacer cuando la cola de salida de una sesión está llena.
+ * DropOldest: descarta el mensaje pendiente más antiguo.
+ * Disconnect: cierra la conexión del cliente lento.
+ * Coalesce:   reemplaza un mensaje pendiente con la misma clave (ej. el estado
+ *             de un mismo usuario); si no hay ninguno, descarta el más antiguo.
+ */
+enum class OverflowPolicy { DropOldest, Disconnect, Coalesce };
+
+/**
+ * Límites de la cola de salida de cada sesión.
+ */
+struct OutboundLimits {
+    std::size_t maxMessages = 1024;                       // Mensajes pendientes por sesión
+    OverflowPolicy policy = OverflowPolicy::DropOldest;   // Política al llenarse la cola
+    // Agrupación de mensajes para clientes v2 (tipo 58): -1 desactivada; 0 junta
+    // solo lo que ya espera en la cola; >0 además espera hasta esos µs antes de escribir
+    long batchWindowUs = -1;
+};
+
+/**
+ * Opciones de los sockets. Los buffers se fijan en el socket que escucha
+ * (las conexiones aceptadas los heredan); 0 deja el valor del sistema.
+ */
+struct SocketOptions {
+    bool noDelay = true;          // TCP_NODELAY en cada conexión aceptada
+    bool reusePort = false;       // SO_REUSEPORT en el socket que escucha
+    int sendBuffer = 0;           // SO_SNDBUF en bytes
+    int receiveBuffer = 0;        // SO_RCVBUF en bytes
+};
+
+/**
+ * Plazos de las sesiones, en segundos (0 desactiva cada uno). Los revisa la
+ * rueda de temporizadores del servidor, que avanza una vez por segundo.
+ */
+struct KeepaliveOptions {
+    unsigned pingSeconds = 20;      // Ping a quien no envió nada en este tiempo
+    unsigned deadSeconds = 60;      // Cierra la conexión si no llega nada (ni un pong) en este tiempo
+    unsigned idleSeconds = 300;     // Pasa a Inactivo a quien no hace solicitudes en este tiempo
+};
+
+/**
+ * Cuánto se recuerda a los usuarios desconectados (0 en cada campo: sin
+ * límite). Un usuario olvidado sale de la lista de usuarios; si vuelve, se
+ * registra como nuevo (su historial se conserva).
+ */
+struct OfflineRetention {
+    unsigned seconds = 7 * 24 * 3600;   // Tiempo desde que se desconectó
+    std::size_t maxUsers = 0;           // Desconectados a la vez; se olvida primero a los más antiguos
+};
+
+/**
+ * Configuración del servidor.
+ *
+ * Se arma por capas, cada una sobre la anterior: valores por defecto,
+ * archivo de configuración (--config), variables de entorno
+ * (CHAT_LOG_LEVEL, CHAT_RATE_LIMITS) y por último la línea de comandos.
+ * Las claves son las mismas en el archivo (`clave = valor`) y en la línea
+ * de comandos (`--clave=valor` o `--clave valor`).
+ */
+struct ServerConfig {
+    std::string address = "0.0.0.0";     // Dirección donde escuchar
+    unsigned short port = 8080;          // Puerto (clientes y /metrics)
+    unsigned threads = 0;                // Hilos de trabajo (0: uno por núcleo)
+    std::size_t acceptors = 1;           // Sockets que escuchan en el puerto (0: uno por hilo)
+    std::size_t maxSessions = 0;         // Sesiones WebSocket abiertas a la vez (0: sin límite)
+    std::size_t maxUsers = 0;            // Nombres de usuario distintos que se registran (0: los que quepan)
+    std::size_t historyDepth = 1000;     // Mensajes que se conservan por chat
+    std::size_t historyMegabytes = 256;  // Memoria máxima del historial
+    std::string historyDir;              // Directorio del historial persistente (vacío: sin persistencia)
+    std::size_t inboxCapacity = 1000;    // Mensajes privados pendientes por usuario (0: sin bandejas)
+    std::size_t maxMessageBytes = 4096;  // Bytes máximos del cuerpo de un mensaje de chat
+    OutboundLimits outbound;
+    LogLevel logLevel = LogLevel::Info;
+    RateLimits rateLimits = RateLimits::defaults();
+    SocketOptions socket;
+    KeepaliveOptions keepalive;
+    OfflineRetention offline;
+    bool help = false;                   // Se pidió --help
+
+    bool set(std::string_view key, std::string_view value, std::string& error);
+    bool load_file(const std::string& path, std::string& error);
+    bool load_environment(std::string& error);
+    bool parse_args(int argc, char* argv[], std::string& error);
+
+    static const char* usage();
+};
+
+#endif // CONFIG_H
@@ -0,0 +1,28 @@
+#include "HandlerMemory.h"
+#include <new>
+
+/**
+ * Entrega el bloque si está libre y alcanza; si no, memoria del heap.
+ *
+ * @param size Bytes que necesita la operación
+ */
+void* HandlerMemory::allocate(std::size_t size) {
+    if (!inUse && size <= sizeof(storage)) {
+        inUse = true;
+        return storage;
+    }
+    return ::operator new(size);
+}
+
+/**
+ * Libera memoria entregada por allocate().
+ *
+ * @param pointer Memoria a liberar
+ */
+void HandlerMemory::deallocate(void* pointer) {
+    if (pointer == storage) {
+        inUse = false;
+    } else {
+        ::operator delete(pointer);
+    }
+}
@@ -0,0 +1,92 @@
+#ifndef HANDLERMEMORY_H
+#define HANDLERMEMORY_H
+
+#include <cstddef>
+#include <utility>
+
+/**
+ * Memoria reutilizable para una cadena de operaciones asíncronas.
+ *
+ * Las lecturas de una sesión son secuenciales (la siguiente empieza cuando
+ * termina la anterior) y lo mismo pasa con sus escrituras, así que un bloque
+ * fijo por cadena alcanza para que Asio no reserve memoria por cada mensaje.
+ * Si el bloque está ocupado o la operación no cabe, se usa el heap.
+ *
+ * No es seguro para usos concurrentes: cada cadena debe tener su propio bloque.
+ */
+class HandlerMemory {
+public:
+    HandlerMemory() = default;
+    HandlerMemory(const HandlerMemory&) = delete;
+    HandlerMemory& operator=(const HandlerMemory&) = delete;
+
+    void* allocate(std::size_t size);
+    void deallocate(void* pointer);
+
+private:
+    alignas(std::max_align_t) unsigned char storage[1024];
+    bool inUse = false;
+};
+
+/**
+ * Allocator que Asio usa para las operaciones de un handler envuelto con
+ * bind_handler_memory().
+ */
+template <typename T>
+class HandlerAllocator {
+public:
+    using value_type = T;
+
+    explicit HandlerAllocator(HandlerMemory& memory) : memory(&memory) {}
+
+    template <typename U>
+    HandlerAllocator(const HandlerAllocator<U>& other) noexcept : memory(other.memory) {}
+
+    T* allocate(std::size_t n) const { return static_cast<T*>(memory->allocate(sizeof(T) * n)); }
+    void deallocate(T* pointer, std::size_t) const { memory->deallocate(pointer); }
+
+    bool operator==(const HandlerAllocator& other) const noexcept { return memory == other.memory; }
+    bool operator!=(const HandlerAllocator& other) const noexcept { return memory != other.memory; }
+
+private:
+    template <typename> friend class HandlerAllocator;
+
+    HandlerMemory* memory;
+};
+
+/**
+ * Handler que anuncia un HandlerAllocator como su allocator asociado.
+ * Las operaciones compuestas de Beast lo heredan, así que también las
+ * operaciones internas del socket usan el mismo bloque.
+ */
+template <typename Handler>
+class MemoryBoundHandler {
+public:
+    using allocator_type = HandlerAllocator<Handler>;
+
+    MemoryBoundHandler(HandlerMemory& memory, Handler handler) : memory(&memory), handler(std::move(handler)) {}
+
+    allocator_type get_allocator() const noexcept { return allocator_type(*memory); }
+
+    template <typename... Args>
+    void operator()(Args&&... args) {
+        handler(std::forward<Args>(args)...);
+    }
+
+private:
+    HandlerMemory* memory;
+    Handler handler;
+};
+
+/**
+ * Envuelve un handler para que sus operaciones usen un bloque de memoria fijo.
+ *
+ * @param memory Bloque de la cadena de operaciones (debe vivir más que ellas)
+ * @param handler Handler a envolver
+ */
+template <typename Handler>
+MemoryBoundHandler<Handler> bind_handler_memory(HandlerMemory& memory, Handler handler) {
+    return MemoryBoundHandler<Handler>(memory, std::move(handler));
+}
+
+#endif // HANDLERMEMORY_H
@@ -0,0 +1,107 @@
+#include "Inbox.h"
+
+/**
+ * Crea las bandejas con la cantidad de fragmentos indicada. Empiezan
+ * desactivadas hasta configure().
+ *
+ * @param shardCount Número de fragmentos (al menos 1)
+ */
+InboxStore::InboxStore(std::size_t shardCount)
+    : shardCount(shardCount == 0 ? 1 : shardCount), shards(new Shard[this->shardCount]) {}
+
+/**
+ * Fija cuántas referencias guarda cada bandeja. Debe llamarse antes de
+ * aceptar conexiones.
+ *
+ * @param capacity Referencias por usuario (0: sin bandejas)
+ */
+void InboxStore::configure(std::size_t capacity) {
+    limit = capacity;
+}
+
+/**
+ * Devuelve el fragmento responsable de un usuario (ids consecutivos: sin hash).
+ *
+ * @param user Id del usuario
+ */
+InboxStore::Shard& InboxStore::shard_for(UserId user) const {
+    return shards[user % shardCount];
+}
+
+/**
+ * Anota un mensaje privado que el usuario no recibió. Con la bandeja llena
+ * se descarta la referencia más antigua.
+ *
+ * @param user Destinatario
+ * @param chat Chat del mensaje
+ * @param seq Secuencia del mensaje en el historial
+ * @return false si las bandejas están desactivadas
+ */
+bool InboxStore::push(UserId user, ChatKey chat, std::uint64_t seq) {
+    if (limit == 0) return false;
+    Shard& shard = shard_for(user);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    Inbox& inbox = shard.inboxes[user];
+
+    if (inbox.messages.size() - inbox.first == limit) {
+        ++inbox.first;
+        ++inbox.dropped;
+        // Compacta cuando lo descartado ocupa tanto como lo vigente
+        if (inbox.first >= limit) {
+            inbox.messages.erase(inbox.messages.begin(), inbox.messages.begin() + inbox.first);
+            inbox.first = 0;
+        }
+    } else {
+        stored.fetch_add(1, std::memory_order_relaxed);
+    }
+    inbox.messages.push_back(MessageRef{chat, static_cast<std::uint32_t>(seq)});
+    return true;
+}
+
+/**
+ * Anota desde dónde le falta el chat general a un usuario que deja de estar
+ * Activo. Si ya tenía una marca se conserva la anterior.
+ *
+ * @param user Usuario
+ * @param seq Próxima secuencia del chat general
+ */
+void InboxStore::mark_general(UserId user, std::uint64_t seq) {
+    if (limit == 0) return;
+    Shard& shard = shard_for(user);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    Inbox& inbox = shard.inboxes[user];
+    if (!inbox.generalSince) inbox.generalSince = seq;
+}
+
+/**
+ * Vacía la bandeja de un usuario.
+ *
+ * @param user Usuario
+ * @return Lo pendiente (vacío si no había nada)
+ */
+InboxBatch InboxStore::take(UserId user) {
+    InboxBatch batch;
+    if (limit == 0) return batch;
+    Shard& shard = shard_for(user);
+    {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        auto it = shard.inboxes.find(user);
+        if (it == shard.inboxes.end()) return batch;
+        Inbox& inbox = it->second;
+        batch.messages.assign(inbox.messages.begin() + inbox.first, inbox.messages.end());
+        batch.generalSince = inbox.generalSince;
+        batch.dropped = inbox.dropped;
+        shard.inboxes.erase(it);
+    }
+    stored.fetch_sub(batch.messages.size(), std::memory_order_relaxed);
+    return batch;
+}
+
+/**
+ * Descarta la bandeja de un usuario que ya no existe.
+ *
+ * @param user Usuario
+ */
+void InboxStore::forget(UserId user) {
+    take(user);
+}
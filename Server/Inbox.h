@@ -0,0 +1,85 @@
+#ifndef INBOX_H
+#define INBOX_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <unordered_map>
+#include <vector>
+#include "Symbols.h"
+
+/**
+ * Referencia a un mensaje del historial: el chat y su secuencia dentro de él.
+ */
+struct MessageRef {
+    ChatKey chat;
+    std::uint32_t seq;
+};
+
+/**
+ * Lo pendiente de un usuario al vaciar su bandeja.
+ */
+struct InboxBatch {
+    std::vector<MessageRef> messages;             // Mensajes privados, en orden de llegada
+    std::optional<std::uint64_t> generalSince;    // Primera secuencia del chat general que no recibió
+    std::size_t dropped = 0;                      // Referencias descartadas con la bandeja llena
+
+    bool empty() const { return messages.empty() && !generalSince && dropped == 0; }
+};
+
+/**
+ * Bandejas de entrada del servidor (store-and-forward).
+ *
+ * Guarda, por usuario, qué mensajes no recibió mientras estaba Ocupado,
+ * Inactivo o desconectado, para entregárselos juntos cuando vuelve a
+ * Activo: recuperarse cuesta lo que se perdió y no volver a pedir el
+ * historial de cada chat.
+ *
+ * No se copian mensajes: los privados se anotan como referencias al
+ * historial (chat, secuencia), a lo más `capacity` por usuario (al
+ * llenarse se descarta la más antigua). Del chat general basta con la
+ * secuencia que tenía cuando dejó de estar Activo, porque lo que le falta
+ * es todo lo que vino después.
+ *
+ * Los usuarios se reparten en fragmentos con su propio candado, como en
+ * ClientRegistry.
+ */
+class InboxStore {
+public:
+    explicit InboxStore(std::size_t shardCount = 64);
+
+    void configure(std::size_t capacity);
+    std::size_t capacity() const { return limit; }
+    bool enabled() const { return limit > 0; }
+
+    bool push(UserId user, ChatKey chat, std::uint64_t seq);
+    void mark_general(UserId user, std::uint64_t seq);
+    InboxBatch take(UserId user);
+    void forget(UserId user);
+    std::size_t size() const { return stored.load(std::memory_order_relaxed); }
+
+private:
+    struct Inbox {
+        std::vector<MessageRef> messages;             // Las vigentes empiezan en `first`
+        std::size_t first = 0;                        // Las anteriores ya se descartaron
+        std::optional<std::uint64_t> generalSince;
+        std::size_t dropped = 0;
+    };
+
+    struct alignas(64) Shard {
+        std::mutex mutex;
+        std::unordered_map<UserId, Inbox> inboxes;
+    };
+
+    Shard& shard_for(UserId user) const;
+
+    std::size_t limit = 0;                            // Referencias por usuario (0: desactivada)
+    std::size_t shardCount;
+    std::unique_ptr<Shard[]> shards;
+    std::atomic<std::size_t> stored{0};               // Referencias guardadas en todas las bandejas
+};
+
+#endif // INBOX_H
@@ -0,0 +1,197 @@
+#include "Logger.h"
+#include <chrono>
+#include <cstdio>
+#include <ctime>
+#include <string>
+
+namespace {
+// Líneas que caben en el anillo (potencia de dos); ~2 MB en total
+constexpr std::size_t LOG_CAPACITY = 4096;
+// Cada cuánto se vacía el anillo si nadie pide flush()
+constexpr auto FLUSH_INTERVAL = std::chrono::milliseconds(10);
+
+/**
+ * Número corto y estable para el hilo actual (1, 2, 3...), en vez del id
+ * del sistema.
+ */
+std::uint32_t thread_number() {
+    static std::atomic<std::uint32_t> next{1};
+    thread_local std::uint32_t number = next.fetch_add(1, std::memory_order_relaxed);
+    return number;
+}
+
+/**
+ * Agrega la hora de una línea con formato HH:MM:SS.mmm.
+ *
+ * @param out Buffer de salida
+ * @param timeMs Milisegundos desde epoch
+ */
+void append_time(std::string& out, std::int64_t timeMs) {
+    std::time_t seconds = static_cast<std::time_t>(timeMs / 1000);
+    std::tm local{};
+    localtime_r(&seconds, &local);
+    char stamp[16];
+    int n = std::snprintf(stamp, sizeof(stamp), "%02d:%02d:%02d.%03d", local.tm_hour, local.tm_min,
+                          local.tm_sec, static_cast<int>(timeMs % 1000));
+    out.append(stamp, n);
+}
+}
+
+/**
+ * Logger del proceso. Se crea (y arranca su hilo) en el primer uso.
+ */
+Logger& Logger::instance() {
+    static Logger logger(LOG_CAPACITY);
+    return logger;
+}
+
+/**
+ * Crea el anillo y arranca el hilo de fondo.
+ *
+ * @param capacity Líneas que caben en el anillo (potencia de dos)
+ */
+Logger::Logger(std::size_t capacity) : slots(new Slot[capacity]), mask(capacity - 1) {
+    for (std::size_t i = 0; i < capacity; ++i) {
+        slots[i].sequence.store(i, std::memory_order_relaxed);
+    }
+    flusher = std::thread([this]() { run(); });
+}
+
+/**
+ * Escribe lo que quede pendiente y detiene el hilo de fondo.
+ */
+Logger::~Logger() {
+    {
+        std::lock_guard<std::mutex> lock(wakeMutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    flusher.join();
+}
+
+/**
+ * Encola una línea. No bloquea ni hace E/S: si el anillo está lleno, la
+ * línea se descarta.
+ *
+ * @param level Nivel de la línea
+ * @param text Texto (se copia; se recorta a LOG_LINE_MAX bytes)
+ */
+void Logger::push(LogLevel level, std::string_view text) {
+    std::size_t pos = enqueuePos.load(std::memory_order_relaxed);
+    Slot* slot;
+    for (;;) {
+        slot = &slots[pos & mask];
+        std::size_t sequence = slot->sequence.load(std::memory_order_acquire);
+        auto diff = static_cast<std::intptr_t>(sequence) - static_cast<std::intptr_t>(pos);
+        if (diff == 0) {
+            if (enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+        } else if (diff < 0) {
+            droppedLines.fetch_add(1, std::memory_order_relaxed);  // Anillo lleno
+            return;
+        } else {
+            pos = enqueuePos.load(std::memory_order_relaxed);
+        }
+    }
+
+    slot->level = level;
+    slot->thread = thread_number();
+    slot->timeMs = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+    slot->size = static_cast<std::uint16_t>(text.copy(slot->text, LOG_LINE_MAX));
+    slot->sequence.store(pos + 1, std::memory_order_release);
+}
+
+/**
+ * Espera a que el hilo de fondo escriba todo lo encolado hasta ahora.
+ * Útil antes de terminar el proceso o tras un error grave.
+ */
+void Logger::flush() {
+    std::unique_lock<std::mutex> lock(wakeMutex);
+    std::uint64_t ticket = ++flushRequests;
+    wake.notify_all();
+    flushed.wait(lock, [&]() { return flushesDone >= ticket || stopping; });
+}
+
+/**
+ * Convierte el nombre de un nivel ("debug", "info", "warn", "error", "off").
+ *
+ * @param name Nombre del nivel
+ * @return El nivel, o vacío si el nombre no es válido
+ */
+std::optional<LogLevel> Logger::parse_level(std::string_view name) {
+    if (name == "debug") return LogLevel::Debug;
+    if (name == "info") return LogLevel::Info;
+    if (name == "warn") return LogLevel::Warn;
+    if (name == "error") return LogLevel::Error;
+    if (name == "off") return LogLevel::Off;
+    return std::nullopt;
+}
+
+/**
+ * Saca todas las líneas listas del anillo y las escribe con una sola
+ * llamada por stream. Solo la llama el hilo de fondo.
+ *
+ * @return Líneas escritas
+ */
+std::size_t Logger::drain() {
+    static const char* const LEVEL_TAGS[] = {"DEBUG", "INFO ", "WARN ", "ERROR"};
+    std::string out;
+    std::string err;
+    std::size_t lines = 0;
+
+    for (;;) {
+        Slot& slot = slots[dequeuePos & mask];
+        std::size_t sequence = slot.sequence.load(std::memory_order_acquire);
+        if (sequence != dequeuePos + 1) break;  // Vacío o todavía escribiéndose
+
+        std::string& target = slot.level >= LogLevel::Warn ? err : out;
+        append_time(target, slot.timeMs);
+        target += ' ';
+        target += LEVEL_TAGS[static_cast<int>(slot.level)];
+        target += " [";
+        target += std::to_string(slot.thread);
+        target += "] ";
+        target.append(slot.text, slot.size);
+        target += '\n';
+
+        slot.sequence.store(dequeuePos + mask + 1, std::memory_order_release);
+        ++dequeuePos;
+        ++lines;
+    }
+
+    std::uint64_t drops = droppedLines.load(std::memory_order_relaxed);
+    if (drops != reportedDrops) {
+        err += "⚠️ " + std::to_string(drops - reportedDrops) + " líneas de log descartadas (anillo lleno)\n";
+        reportedDrops = drops;
+    }
+
+    if (!out.empty()) {
+        std::fwrite(out.data(), 1, out.size(), stdout);
+        std::fflush(stdout);
+    }
+    if (!err.empty()) {
+        std::fwrite(err.data(), 1, err.size(), stderr);
+        std::fflush(stderr);
+    }
+    return lines;
+}
+
+/**
+ * Bucle del hilo de fondo: vacía el anillo cada FLUSH_INTERVAL o cuando
+ * alguien llama flush(), hasta que el logger se destruye.
+ */
+void Logger::run() {
+    std::unique_lock<std::mutex> lock(wakeMutex);
+    for (;;) {
+        std::uint64_t requested = flushRequests;
+        bool stop = stopping;
+        lock.unlock();
+        drain();
+        lock.lock();
+
+        flushesDone = requested;
+        flushed.notify_all();
+        if (stop) break;
+        wake.wait_for(lock, FLUSH_INTERVAL, [this]() { return stopping || flushRequests != flushesDone; });
+    }
+}
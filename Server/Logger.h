@@ -0,0 +1,159 @@
+#ifndef LOGGER_H
+#define LOGGER_H
+
+#include <atomic>
+#include <charconv>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string_view>
+#include <thread>
+#include <type_traits>
+
+/**
+ * Niveles de log, de menor a mayor importancia.
+ */
+enum class LogLevel : int { Debug = 0, Info = 1, Warn = 2, Error = 3, Off = 4 };
+
+// Nivel mínimo que se compila. Las llamadas de niveles menores desaparecen
+// del binario (ni siquiera se evalúan sus argumentos). Por defecto se quita
+// LOG_DEBUG; compilar con -DLOG_COMPILE_LEVEL=0 para tenerlo disponible.
+#ifndef LOG_COMPILE_LEVEL
+#define LOG_COMPILE_LEVEL 1
+#endif
+
+// Bytes máximos de una línea; lo que no cabe se recorta
+constexpr std::size_t LOG_LINE_MAX = 480;
+
+/**
+ * Logger asíncrono.
+ *
+ * Los hilos que registran una línea solo la copian a un anillo de tamaño
+ * fijo (una cola acotada sin candados, con un número de secuencia por
+ * posición); nunca hacen E/S ni esperan. Un hilo de fondo vacía el anillo
+ * cada pocos milisegundos y escribe todas las líneas pendientes de una vez:
+ * Debug/Info a stdout, Warn/Error a stderr.
+ *
+ * Si el anillo se llena, la línea nueva se descarta y se cuenta; el hilo de
+ * fondo avisa cuántas se perdieron.
+ */
+class Logger {
+public:
+    static Logger& instance();
+
+    ~Logger();
+    Logger(const Logger&) = delete;
+    Logger& operator=(const Logger&) = delete;
+
+    void set_level(LogLevel level) { minLevel.store(static_cast<int>(level), std::memory_order_relaxed); }
+    LogLevel level() const { return static_cast<LogLevel>(minLevel.load(std::memory_order_relaxed)); }
+    bool enabled(LogLevel level) const {
+        return static_cast<int>(level) >= minLevel.load(std::memory_order_relaxed);
+    }
+
+    void push(LogLevel level, std::string_view text);
+    void flush();
+    std::uint64_t dropped() const { return droppedLines.load(std::memory_order_relaxed); }
+
+    static std::optional<LogLevel> parse_level(std::string_view name);
+
+private:
+    struct Slot {
+        std::atomic<std::size_t> sequence;   // Indica si la posición está libre o lista para leerse
+        LogLevel level;
+        std::uint32_t thread;                // Número del hilo que la registró
+        std::int64_t timeMs;                 // Hora de registro (ms desde epoch)
+        std::uint16_t size;
+        char text[LOG_LINE_MAX];
+    };
+
+    explicit Logger(std::size_t capacity);
+    std::size_t drain();
+    void run();
+
+    std::unique_ptr<Slot[]> slots;
+    std::size_t mask;                                     // capacidad - 1 (potencia de dos)
+    alignas(64) std::atomic<std::size_t> enqueuePos{0};   // Siguiente posición para escribir
+    alignas(64) std::size_t dequeuePos = 0;               // Siguiente posición para leer (solo el hilo de fondo)
+    std::atomic<int> minLevel{static_cast<int>(LogLevel::Info)};
+    std::atomic<std::uint64_t> droppedLines{0};
+    std::uint64_t reportedDrops = 0;                      // Descartes ya avisados (solo el hilo de fondo)
+
+    // Solo para dormir y despertar al hilo de fondo; quien registra no los toca
+    std::mutex wakeMutex;
+    std::condition_variable wake;                         // Despierta al hilo de fondo
+    std::condition_variable flushed;                      // Avisa que terminó un vaciado
+    std::uint64_t flushRequests = 0;
+    std::uint64_t flushesDone = 0;
+    bool stopping = false;
+    std::thread flusher;
+};
+
+/**
+ * Arma una línea de log en la pila y la entrega al logger al destruirse.
+ * Se usa a través de las macros LOG_*: `LOG_INFO("✅ " << usuario << " conectado")`.
+ */
+class LogLine {
+public:
+    explicit LogLine(LogLevel level) : level(level) {}
+    ~LogLine() { Logger::instance().push(level, std::string_view(text, size)); }
+    LogLine(const LogLine&) = delete;
+    LogLine& operator=(const LogLine&) = delete;
+
+    LogLine& operator<<(std::string_view value) {
+        std::size_t n = value.size() < LOG_LINE_MAX - size ? value.size() : LOG_LINE_MAX - size;
+        value.copy(text + size, n);
+        size += n;
+        return *this;
+    }
+    LogLine& operator<<(const char* value) { return *this << std::string_view(value); }
+    LogLine& operator<<(char value) { return *this << std::string_view(&value, 1); }
+    LogLine& operator<<(bool value) { return *this << (value ? "true" : "false"); }
+
+    template <typename T, typename = std::enable_if_t<std::is_integral_v<T>>>
+    LogLine& operator<<(T value) {
+        char digits[24];
+        auto result = std::to_chars(digits, digits + sizeof(digits), value);
+        return *this << std::string_view(digits, result.ptr - digits);
+    }
+
+private:
+    LogLevel level;
+    std::size_t size = 0;
+    char text[LOG_LINE_MAX];
+};
+
+#define LOG_AT(level, expr)                                   \
+    do {                                                      \
+        if (Logger::instance().enabled(level)) {              \
+            LogLine(level) << expr;                           \
+        }                                                     \
+    } while (false)
+
+#if LOG_COMPILE_LEVEL <= 0
+#define LOG_DEBUG(expr) LOG_AT(LogLevel::Debug, expr)
+#else
+#define LOG_DEBUG(expr) do {} while (false)
+#endif
+
+#if LOG_COMPILE_LEVEL <= 1
+#define LOG_INFO(expr) LOG_AT(LogLevel::Info, expr)
+#else
+#define LOG_INFO(expr) do {} while (false)
+#endif
+
+#if LOG_COMPILE_LEVEL <= 2
+#define LOG_WARN(expr) LOG_AT(LogLevel::Warn, expr)
+#else
+#define LOG_WARN(expr) do {} while (false)
+#endif
+
+#define LOG_ERROR(expr) LOG_AT(LogLevel::Error, expr)
+
+// Si el nivel Debug está compilado y activo (para evitar trabajo que solo sirve al log)
+#define LOG_DEBUG_ENABLED() (LOG_COMPILE_LEVEL <= 0 && Logger::instance().enabled(LogLevel::Debug))
+
+#endif // LOGGER_H
@@ -0,0 +1,379 @@
+#include "MessageLog.h"
+#include "Logger.h"
+#include <algorithm>
+#include <charconv>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <stdexcept>
+#include <system_error>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace fs = std::filesystem;
+
+namespace {
+// Longitud y checksum al inicio de cada registro
+constexpr std::size_t RECORD_HEADER = 2 * sizeof(std::uint32_t);
+
+/**
+ * Checksum FNV-1a de 32 bits, suficiente para detectar registros a medio escribir.
+ */
+std::uint32_t checksum(const unsigned char* data, std::size_t size) {
+    std::uint32_t hash = 2166136261u;
+    for (std::size_t i = 0; i < size; ++i) {
+        hash ^= data[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+template <typename T>
+T load(const unsigned char* data) {
+    T value;
+    std::memcpy(&value, data, sizeof(T));
+    return value;
+}
+
+template <typename T>
+unsigned char* store(unsigned char* out, T value) {
+    std::memcpy(out, &value, sizeof(T));
+    return out + sizeof(T);
+}
+
+/**
+ * Campos de un registro ya validado.
+ */
+struct RecordView {
+    std::string_view chat;
+    std::string_view sender;
+    std::string_view body;
+};
+
+/**
+ * Interpreta el contenido de un registro verificando cada longitud.
+ *
+ * @param payload Inicio del contenido (después de la cabecera)
+ * @param size Tamaño del contenido
+ * @param out Campos del registro
+ * @return false si el registro está dañado
+ */
+bool parse_payload(const unsigned char* payload, std::size_t size, RecordView& out) {
+    std::size_t pos = 0;
+    auto field = [&](std::size_t lenBytes, std::string_view& view) {
+        if (pos + lenBytes > size) return false;
+        std::size_t len = lenBytes == 2 ? load<std::uint16_t>(payload + pos) : load<std::uint32_t>(payload + pos);
+        pos += lenBytes;
+        if (pos + len > size) return false;
+        view = std::string_view(reinterpret_cast<const char*>(payload + pos), len);
+        pos += len;
+        return true;
+    };
+    return field(2, out.chat) && field(2, out.sender) && field(4, out.body) && pos == size;
+}
+}
+
+/**
+ * Abre (o crea) el registro en el directorio indicado y reconstruye el índice
+ * recorriendo los segmentos existentes.
+ *
+ * @param directory Directorio de los segmentos
+ * @param segmentBytes Tamaño de cada segmento nuevo
+ * @param flushInterval Cada cuánto se sincronizan los segmentos modificados
+ */
+MessageLog::MessageLog(const std::string& directory, std::size_t segmentBytes,
+                       std::chrono::milliseconds flushInterval)
+    : directory(directory), segmentBytes(segmentBytes), flushInterval(flushInterval) {
+    fs::create_directories(directory);
+
+    // Los segmentos nuevos se numeran después del mayor en disco, aunque
+    // falten números o alguno no se pueda usar
+    std::vector<std::string> existing;
+    for (const auto& entry : fs::directory_iterator(directory)) {
+        std::string stem = entry.path().stem().string();
+        if (stem.rfind("segment-", 0) == 0 && entry.path().extension() == ".log") {
+            existing.push_back(entry.path().string());
+            std::size_t number = 0;
+            const char* digits = stem.data() + std::strlen("segment-");
+            if (std::from_chars(digits, stem.data() + stem.size(), number).ec == std::errc()) {
+                nextSegment = std::max(nextSegment, number + 1);
+            }
+        }
+    }
+    std::sort(existing.begin(), existing.end());
+
+    for (const auto& path : existing) {
+        if (!open_segment(path, 0, false)) continue;
+        scan_segment(static_cast<std::uint32_t>(segments.size() - 1));
+    }
+    if (segments.empty()) {
+        start_new_segment();
+    }
+
+    flusher = std::thread(&MessageLog::flush_loop, this);
+}
+
+/**
+ * Sincroniza lo pendiente y libera los mapeos.
+ */
+MessageLog::~MessageLog() {
+    {
+        std::lock_guard<std::mutex> lock(flushMutex);
+        stopping = true;
+    }
+    flushCv.notify_one();
+    flusher.join();
+
+    for (auto& segment : segments) {
+        if (segment.dirty) ::fdatasync(segment.fd);
+        ::munmap(segment.data, segment.capacity);
+        ::close(segment.fd);
+    }
+}
+
+/**
+ * Abre un archivo de segmento y lo mapea completo en memoria.
+ *
+ * @param path Ruta del archivo
+ * @param capacity Tamaño para un segmento nuevo (se ignora si ya existe)
+ * @param create Si el archivo debe crearse
+ * @return false si un segmento existente no se pudo usar (se salta con un aviso)
+ */
+bool MessageLog::open_segment(const std::string& path, std::size_t capacity, bool create) {
+    int fd = ::open(path.c_str(), O_RDWR | (create ? O_CREAT | O_EXCL : 0), 0644);
+    if (fd < 0) {
+        if (!create) {
+            LOG_WARN("⚠️ No se pudo abrir " << path << " (" << std::strerror(errno) << "), se omite");
+            return false;
+        }
+        throw std::system_error(errno, std::generic_category(), "No se pudo abrir " + path);
+    }
+
+    if (create) {
+        if (::ftruncate(fd, static_cast<off_t>(capacity)) != 0) {
+            int err = errno;
+            ::close(fd);
+            throw std::system_error(err, std::generic_category(), "No se pudo reservar " + path);
+        }
+    } else {
+        struct stat info;
+        if (::fstat(fd, &info) != 0) {
+            LOG_WARN("⚠️ No se pudo leer el tamaño de " << path << " (" << std::strerror(errno) << "), se omite");
+            ::close(fd);
+            return false;
+        }
+        capacity = static_cast<std::size_t>(info.st_size);
+        if (capacity < RECORD_HEADER) {
+            // Caída entre crearlo y reservarlo: no tiene registros, se reserva de nuevo en ceros
+            LOG_WARN("⚠️ Segmento " << path << " sin reservar (" << capacity << " bytes), se usa como nuevo");
+            if (::ftruncate(fd, 0) != 0 || ::ftruncate(fd, static_cast<off_t>(segmentBytes)) != 0) {
+                LOG_WARN("⚠️ No se pudo reservar " << path << " (" << std::strerror(errno) << "), se omite");
+                ::close(fd);
+                return false;
+            }
+            capacity = segmentBytes;
+        }
+    }
+
+    void* data = ::mmap(nullptr, capacity, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (data == MAP_FAILED) {
+        int err = errno;
+        ::close(fd);
+        throw std::system_error(err, std::generic_category(), "No se pudo mapear " + path);
+    }
+
+    Segment segment;
+    segment.path = path;
+    segment.fd = fd;
+    segment.data = static_cast<unsigned char*>(data);
+    segment.capacity = capacity;
+    segments.push_back(segment);
+    return true;
+}
+
+/**
+ * Recorre un segmento al arrancar y agrega sus registros al índice.
+ * Se detiene en el primer registro vacío o dañado; si el daño viene de una
+ * caída a medio escribir, limpia el resto del segmento para que no quede
+ * basura después de los registros nuevos.
+ *
+ * @param index Posición del segmento en `segments`
+ */
+void MessageLog::scan_segment(std::uint32_t index) {
+    Segment& segment = segments[index];
+    std::size_t offset = 0;
+    bool damaged = false;
+
+    while (offset + RECORD_HEADER <= segment.capacity) {
+        const unsigned char* record = segment.data + offset;
+        std::uint32_t length = load<std::uint32_t>(record);
+        if (length == 0) break;
+
+        RecordView view;
+        if (offset + RECORD_HEADER + length > segment.capacity ||
+            checksum(record + RECORD_HEADER, length) != load<std::uint32_t>(record + sizeof(std::uint32_t)) ||
+            !parse_payload(record + RECORD_HEADER, length, view)) {
+            damaged = true;
+            break;
+        }
+
+        this->index[std::string(view.chat)].push_back({index, static_cast<std::uint32_t>(offset)});
+        ++records;
+        offset += RECORD_HEADER + length;
+    }
+
+    segment.size = offset;
+    if (damaged) {
+        std::memset(segment.data + offset, 0, segment.capacity - offset);
+        segment.dirty = true;
+    }
+}
+
+/**
+ * Crea el siguiente segmento vacío y lo vuelve el segmento activo.
+ */
+void MessageLog::start_new_segment() {
+    char name[32];
+    std::snprintf(name, sizeof(name), "segment-%06zu.log", nextSegment++);
+    open_segment((fs::path(directory) / name).string(), segmentBytes, true);
+}
+
+/**
+ * Agrega un mensaje al final del registro.
+ *
+ * @param chatId Clave del chat
+ * @param sender Nombre del emisor
+ * @param body Contenido del mensaje
+ * @return Número de secuencia del mensaje dentro de su chat
+ */
+std::uint64_t MessageLog::append(const std::string& chatId, std::string_view sender, std::string_view body) {
+    std::size_t payload = sizeof(std::uint16_t) + chatId.size() + sizeof(std::uint16_t) + sender.size()
+                        + sizeof(std::uint32_t) + body.size();
+    std::size_t total = RECORD_HEADER + payload;
+    if (total > segmentBytes || chatId.size() > UINT16_MAX || sender.size() > UINT16_MAX) {
+        throw std::length_error("Mensaje demasiado grande para el registro");
+    }
+
+    std::unique_lock<std::shared_mutex> lock(mutex);
+    if (segments.back().size + total > segments.back().capacity) {
+        start_new_segment();
+    }
+
+    Segment& segment = segments.back();
+    unsigned char* record = segment.data + segment.size;
+    unsigned char* out = record + RECORD_HEADER;
+    out = store(out, static_cast<std::uint16_t>(chatId.size()));
+    out = std::copy(chatId.begin(), chatId.end(), out);
+    out = store(out, static_cast<std::uint16_t>(sender.size()));
+    out = std::copy(sender.begin(), sender.end(), out);
+    out = store(out, static_cast<std::uint32_t>(body.size()));
+    std::copy(body.begin(), body.end(), out);
+
+    // La longitud se escribe al final: un registro con longitud ya está completo
+    store(record + sizeof(std::uint32_t), checksum(record + RECORD_HEADER, payload));
+    store(record, static_cast<std::uint32_t>(payload));
+
+    auto& locations = index[chatId];
+    locations.push_back({static_cast<std::uint32_t>(segments.size() - 1), static_cast<std::uint32_t>(segment.size)});
+    segment.size += total;
+    segment.dirty = true;
+    ++records;
+    return locations.size() - 1;
+}
+
+/**
+ * Cantidad de mensajes guardados de un chat (la siguiente secuencia).
+ *
+ * @param chatId Clave del chat
+ */
+std::uint64_t MessageLog::count(const std::string& chatId) const {
+    std::shared_lock<std::shared_mutex> lock(mutex);
+    auto it = index.find(chatId);
+    return it == index.end() ? 0 : it->second.size();
+}
+
+/**
+ * Recorre los mensajes de un chat con secuencia en [from, to).
+ * Las vistas apuntan directo al segmento mapeado.
+ *
+ * @param chatId Clave del chat
+ * @param from Primera secuencia a incluir
+ * @param to Secuencia siguiente a la última a incluir
+ * @param fn Función a ejecutar por cada mensaje
+ * @return Cantidad de mensajes recorridos
+ */
+std::size_t MessageLog::read(const std::string& chatId, std::uint64_t from, std::uint64_t to,
+                             const Visitor& fn) const {
+    std::shared_lock<std::shared_mutex> lock(mutex);
+    auto it = index.find(chatId);
+    if (it == index.end()) return 0;
+
+    const auto& locations = it->second;
+    to = std::min<std::uint64_t>(to, locations.size());
+    std::size_t visited = 0;
+    for (std::uint64_t seq = from; seq < to; ++seq) {
+        const Segment& segment = segments[locations[seq].segment];
+        const unsigned char* record = segment.data + locations[seq].offset;
+        RecordView view;
+        parse_payload(record + RECORD_HEADER, load<std::uint32_t>(record), view);
+        fn(seq, view.sender, view.body);
+        ++visited;
+    }
+    return visited;
+}
+
+/**
+ * Recorre los chats del registro con el emisor de su primer mensaje (en un
+ * chat privado, uno de los dos participantes).
+ *
+ * @param fn Función a ejecutar por cada chat
+ */
+void MessageLog::for_each_chat(const ChatVisitor& fn) const {
+    std::shared_lock<std::shared_mutex> lock(mutex);
+    for (const auto& [chatId, locations] : index) {
+        if (locations.empty()) continue;
+        const unsigned char* record = segments[locations[0].segment].data + locations[0].offset;
+        RecordView view;
+        parse_payload(record + RECORD_HEADER, load<std::uint32_t>(record), view);
+        fn(chatId, view.sender);
+    }
+}
+
+/**
+ * Hilo que sincroniza con el disco los segmentos modificados. Todas las
+ * escrituras de un intervalo comparten un solo fdatasync.
+ */
+void MessageLog::flush_loop() {
+    std::unique_lock<std::mutex> flushLock(flushMutex);
+    while (!stopping) {
+        flushCv.wait_for(flushLock, flushInterval);
+
+        std::vector<int> dirty;
+        {
+            std::unique_lock<std::shared_mutex> lock(mutex);
+            for (auto& segment : segments) {
+                if (segment.dirty) {
+                    dirty.push_back(segment.fd);
+                    segment.dirty = false;
+                }
+            }
+        }
+        for (int fd : dirty) {
+            ::fdatasync(fd);
+        }
+    }
+}
+
+/**
+ * Devuelve las métricas actuales del registro.
+ */
+LogStats MessageLog::stats() const {
+    std::shared_lock<std::shared_mutex> lock(mutex);
+    std::size_t bytes = 0;
+    for (const auto& segment : segments) {
+        bytes += segment.size;
+    }
+    return {segments.size(), bytes, records, index.size()};
+}
@@ -0,0 +1,98 @@
+#ifndef MESSAGELOG_H
+#define MESSAGELOG_H
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * Métricas del registro persistente.
+ */
+struct LogStats {
+    std::size_t segments;   // Archivos de segmento abiertos
+    std::size_t bytes;      // Bytes escritos en todos los segmentos
+    std::size_t records;    // Mensajes guardados
+    std::size_t chats;      // Chats con al menos un mensaje
+};
+
+/**
+ * Registro de mensajes persistente, solo de escritura al final.
+ *
+ * Los mensajes se escriben en segmentos de tamaño fijo dentro de un
+ * directorio y cada segmento se mapea completo en memoria (mmap), así que
+ * leer historial devuelve vistas directas a la caché de páginas del sistema,
+ * sin copias. Un índice en memoria guarda, por chat, la ubicación de cada
+ * mensaje; la posición dentro del índice es el número de secuencia.
+ *
+ * Las escrituras no esperan al disco: un hilo aparte hace fdatasync de los
+ * segmentos modificados cada `flushInterval` (commit en grupo). Si el proceso
+ * cae, se pierden como mucho los mensajes de ese último intervalo.
+ *
+ * Formato de cada registro:
+ * [longitud u32][checksum u32][long_chat u16][chat][long_emisor u16][emisor][long_cuerpo u32][cuerpo]
+ */
+class MessageLog {
+public:
+    using Visitor = std::function<void(std::uint64_t seq, std::string_view sender, std::string_view body)>;
+    using ChatVisitor = std::function<void(std::string_view chatId, std::string_view firstSender)>;
+
+    explicit MessageLog(const std::string& directory,
+                        std::size_t segmentBytes = 64u << 20,
+                        std::chrono::milliseconds flushInterval = std::chrono::milliseconds(10));
+    ~MessageLog();
+
+    MessageLog(const MessageLog&) = delete;
+    MessageLog& operator=(const MessageLog&) = delete;
+
+    std::uint64_t append(const std::string& chatId, std::string_view sender, std::string_view body);
+    std::uint64_t count(const std::string& chatId) const;
+    std::size_t read(const std::string& chatId, std::uint64_t from, std::uint64_t to, const Visitor& fn) const;
+    void for_each_chat(const ChatVisitor& fn) const;
+    LogStats stats() const;
+
+private:
+    struct Segment {
+        std::string path;
+        int fd = -1;
+        unsigned char* data = nullptr;  // Mapeo completo del archivo
+        std::size_t capacity = 0;       // Tamaño del archivo
+        std::size_t size = 0;           // Bytes con registros válidos
+        bool dirty = false;             // Escrito desde el último fdatasync
+    };
+
+    struct Location {
+        std::uint32_t segment;
+        std::uint32_t offset;
+    };
+
+    bool open_segment(const std::string& path, std::size_t capacity, bool create);
+    void scan_segment(std::uint32_t index);
+    void start_new_segment();
+    void flush_loop();
+
+    std::string directory;
+    std::size_t segmentBytes;
+    std::chrono::milliseconds flushInterval;
+
+    mutable std::shared_mutex mutex;
+    std::vector<Segment> segments;
+    std::size_t nextSegment = 0;    // Número del próximo archivo (mayor en disco + 1)
+    std::unordered_map<std::string, std::vector<Location>> index;
+    std::size_t records = 0;
+
+    std::mutex flushMutex;
+    std::condition_variable flushCv;
+    bool stopping = false;
+    std::thread flusher;
+};
+
+#endif // MESSAGELOG_H
@@ -0,0 +1,110 @@
+#include "Metrics.h"
+#include <algorithm>
+#include <cstdio>
+
+/**
+ * Franja de contadores del hilo actual. Los hilos reciben franjas en orden
+ * de llegada; con más hilos que franjas, algunos comparten.
+ */
+std::size_t metric_stripe() {
+    static std::atomic<std::size_t> next{0};
+    thread_local std::size_t stripe = next.fetch_add(1, std::memory_order_relaxed) % METRIC_STRIPES;
+    return stripe;
+}
+
+/**
+ * Escribe las líneas HELP y TYPE de una métrica.
+ *
+ * @param name Nombre de la métrica
+ * @param help Descripción
+ * @param type counter, gauge o histogram
+ */
+void MetricsWriter::header(std::string_view name, std::string_view help, std::string_view type) {
+    out.append("# HELP ").append(name).append(" ").append(help).append("\n");
+    out.append("# TYPE ").append(name).append(" ").append(type).append("\n");
+}
+
+/**
+ * Escribe el nombre y, si hay, las etiquetas de una muestra.
+ *
+ * @param name Nombre de la métrica
+ * @param labels Etiquetas ya formateadas (ej. `type="4"`), o vacío
+ */
+void MetricsWriter::name_and_labels(std::string_view name, std::string_view labels) {
+    out.append(name);
+    if (!labels.empty()) {
+        out.append("{").append(labels).append("}");
+    }
+    out.append(" ");
+}
+
+/**
+ * Escribe una muestra con valor decimal.
+ *
+ * @param name Nombre de la métrica
+ * @param labels Etiquetas ya formateadas, o vacío
+ * @param value Valor
+ */
+void MetricsWriter::sample(std::string_view name, std::string_view labels, double value) {
+    name_and_labels(name, labels);
+    char number[32];
+    int n = std::snprintf(number, sizeof(number), "%.9g", value);
+    out.append(number, n).append("\n");
+}
+
+/**
+ * Escribe una muestra con valor entero.
+ *
+ * @param name Nombre de la métrica
+ * @param labels Etiquetas ya formateadas, o vacío
+ * @param value Valor
+ */
+void MetricsWriter::sample(std::string_view name, std::string_view labels, std::uint64_t value) {
+    name_and_labels(name, labels);
+    out.append(std::to_string(value)).append("\n");
+}
+
+/**
+ * Crea un histograma.
+ *
+ * @param bounds Límites superiores de las cubetas, en orden creciente (a lo más HISTOGRAM_MAX_BOUNDS)
+ * @param scale Factor con el que se muestran límites y suma
+ */
+Histogram::Histogram(std::initializer_list<std::uint64_t> bounds, double scale)
+    : boundCount(std::min(bounds.size(), HISTOGRAM_MAX_BOUNDS)), scale(scale) {
+    std::copy_n(bounds.begin(), boundCount, this->bounds);
+}
+
+/**
+ * Registra una observación.
+ *
+ * @param value Valor observado (en las unidades de los límites)
+ */
+void Histogram::observe(std::uint64_t value) {
+    std::size_t bucket = std::lower_bound(bounds, bounds + boundCount, value) - bounds;
+    counts.add(bucket);
+    counts.add(boundCount + 1, value);
+}
+
+/**
+ * Escribe las cubetas (acumuladas, como pide Prometheus), la suma y la cuenta.
+ *
+ * @param out Destino
+ * @param name Nombre de la métrica
+ * @param labels Etiquetas extra de la serie, o vacío
+ */
+void Histogram::render(MetricsWriter& out, std::string_view name, std::string_view labels) const {
+    std::string bucketName = std::string(name) + "_bucket";
+    std::string prefix = labels.empty() ? std::string() : std::string(labels) + ",";
+    std::uint64_t cumulative = 0;
+    char bound[32];
+    for (std::size_t i = 0; i < boundCount; ++i) {
+        cumulative += counts.value(i);
+        std::snprintf(bound, sizeof(bound), "%.9g", bounds[i] * scale);
+        out.sample(bucketName, prefix + "le=\"" + bound + "\"", cumulative);
+    }
+    cumulative += counts.value(boundCount);
+    out.sample(bucketName, prefix + "le=\"+Inf\"", cumulative);
+    out.sample(std::string(name) + "_sum", labels, counts.value(boundCount + 1) * scale);
+    out.sample(std::string(name) + "_count", labels, cumulative);
+}
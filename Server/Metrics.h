@@ -0,0 +1,86 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <initializer_list>
+#include <string>
+#include <string_view>
+
+// Franjas por contador. Cada hilo suma en su propia franja (una línea de
+// caché aparte), así que incrementar no compite con otros hilos; las
+// franjas solo se suman al leer /metrics.
+constexpr std::size_t METRIC_STRIPES = 16;
+
+// Máximo de límites de un histograma (sin contar +Inf)
+constexpr std::size_t HISTOGRAM_MAX_BOUNDS = 16;
+
+std::size_t metric_stripe();
+
+/**
+ * Grupo de N contadores repartidos por hilo.
+ * Sirve también como gauge: sub() resta y la suma de las franjas (módulo
+ * 2^64) da el valor correcto aunque una franja quede "negativa".
+ */
+template <std::size_t N>
+class StripedCounters {
+public:
+    void add(std::size_t index, std::uint64_t n = 1) {
+        stripes[metric_stripe()].values[index].fetch_add(n, std::memory_order_relaxed);
+    }
+    void sub(std::size_t index, std::uint64_t n = 1) {
+        stripes[metric_stripe()].values[index].fetch_sub(n, std::memory_order_relaxed);
+    }
+    std::uint64_t value(std::size_t index) const {
+        std::uint64_t total = 0;
+        for (const Stripe& stripe : stripes) {
+            total += stripe.values[index].load(std::memory_order_relaxed);
+        }
+        return total;
+    }
+
+private:
+    struct alignas(64) Stripe {
+        std::atomic<std::uint64_t> values[N] = {};
+    };
+    Stripe stripes[METRIC_STRIPES];
+};
+
+/**
+ * Escribe métricas con el formato de texto de Prometheus.
+ */
+class MetricsWriter {
+public:
+    void header(std::string_view name, std::string_view help, std::string_view type);
+    void sample(std::string_view name, std::string_view labels, double value);
+    void sample(std::string_view name, std::string_view labels, std::uint64_t value);
+
+    const std::string& text() const { return out; }
+
+private:
+    void name_and_labels(std::string_view name, std::string_view labels);
+
+    std::string out;
+};
+
+/**
+ * Histograma de límites fijos. observe() cuesta una búsqueda entre los
+ * límites y dos incrementos sin candados.
+ */
+class Histogram {
+public:
+    Histogram(std::initializer_list<std::uint64_t> bounds, double scale = 1.0);
+
+    void observe(std::uint64_t value);
+    void render(MetricsWriter& out, std::string_view name, std::string_view labels) const;
+
+private:
+    std::uint64_t bounds[HISTOGRAM_MAX_BOUNDS];
+    std::size_t boundCount;
+    double scale;   // Factor para mostrar los valores (ej. 1e-9 para pasar de ns a segundos)
+    // [0, boundCount): cubetas, [boundCount]: +Inf, [boundCount + 1]: suma
+    StripedCounters<HISTOGRAM_MAX_BOUNDS + 2> counts;
+};
+
+#endif // METRICS_H
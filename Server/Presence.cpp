@@ -0,0 +1,53 @@
+#include "Presence.h"
+
+// Estado con el que los clientes conocen a un usuario nuevo (el aviso tipo 53)
+constexpr int INITIAL_STATUS = 1;
+
+/**
+ * Marca que el estado de un usuario cambió durante el intervalo actual.
+ *
+ * @param user Usuario cuyo estado cambió
+ */
+void PresenceBatcher::mark(UserId user) {
+    std::lock_guard<std::mutex> lock(mutex);
+    marked.insert(user);
+}
+
+/**
+ * Saca los usuarios marcados y empieza un intervalo nuevo.
+ *
+ * @return Usuarios con cambios desde la última llamada
+ */
+std::vector<UserId> PresenceBatcher::take_marked() {
+    std::unordered_set<UserId> taken;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        taken.swap(marked);
+    }
+    return std::vector<UserId>(taken.begin(), taken.end());
+}
+
+/**
+ * Registra el estado que se va a anunciar de un usuario.
+ * Solo debe llamarla quien anuncia los cambios (un hilo a la vez).
+ *
+ * @param user Usuario
+ * @param status Estado actual en el registro
+ * @return false si es el mismo que ya se anunció (no hay nada que enviar)
+ */
+bool PresenceBatcher::announce(UserId user, int status) {
+    auto [it, inserted] = announced.try_emplace(user, INITIAL_STATUS);
+    if (it->second == status) return false;
+    it->second = status;
+    return true;
+}
+
+/**
+ * Olvida el último estado anunciado de un usuario que ya no existe.
+ * Solo debe llamarla quien anuncia los cambios.
+ *
+ * @param user Usuario
+ */
+void PresenceBatcher::forget(UserId user) {
+    announced.erase(user);
+}
@@ -0,0 +1,33 @@
+#ifndef PRESENCE_H
+#define PRESENCE_H
+
+#include <cstddef>
+#include <mutex>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include "Symbols.h"
+
+/**
+ * Agrupa los cambios de estado de los usuarios para anunciarlos una vez por
+ * intervalo en lugar de uno por evento.
+ *
+ * Los cambios solo marcan al usuario; el estado real sigue en el registro.
+ * Al cerrar el intervalo, quien anuncia compara el estado actual de cada
+ * usuario marcado con el último anunciado: si volvió al mismo (ej.
+ * Activo → Inactivo → Activo dentro del intervalo), no se anuncia nada.
+ */
+class PresenceBatcher {
+public:
+    void mark(UserId user);
+    std::vector<UserId> take_marked();
+    bool announce(UserId user, int status);
+    void forget(UserId user);
+
+private:
+    std::mutex mutex;                                  // Protege `marked`
+    std::unordered_set<UserId> marked;                 // Usuarios con cambios en este intervalo
+    std::unordered_map<UserId, int> announced;         // Último estado anunciado (solo quien anuncia)
+};
+
+#endif // PRESENCE_H
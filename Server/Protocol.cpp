@@ -0,0 +1,223 @@
+#include "Protocol.h"
+#include <algorithm>
+#include <limits>
+
+namespace {
+// Una longitud o cantidad en v2 cabe en un u32: como mucho 5 bytes de varint
+constexpr int MAX_VARINT_BYTES = 5;
+// Máximo que cabe en un campo de un byte (v1)
+constexpr std::size_t MAX_V1_FIELD = 255;
+// Buffer donde cada hilo arma sus mensajes; conserva su capacidad entre mensajes
+thread_local std::vector<unsigned char> scratchBuffer;
+}
+
+/**
+ * Crea un mensaje vacío para la versión indicada.
+ *
+ * @param version Versión del protocolo (PROTOCOL_V1 o PROTOCOL_V2)
+ */
+FrameWriter::FrameWriter(int version) : ver(version) {}
+
+/**
+ * Máximo de elementos que se pueden anunciar en una cantidad.
+ * En v1 la cantidad ocupa un byte; quien arma una lista debe cortarla ahí.
+ */
+std::size_t FrameWriter::max_count() const {
+    return ver == PROTOCOL_V1 ? MAX_V1_FIELD : std::numeric_limits<std::uint32_t>::max();
+}
+
+/**
+ * Agrega un byte (código, estado o bandera).
+ *
+ * @param value Valor a escribir
+ */
+void FrameWriter::u8(std::uint8_t value) {
+    out.push_back(value);
+}
+
+/**
+ * Agrega un entero de 32 bits en orden de red (big-endian).
+ *
+ * @param value Valor a escribir
+ */
+void FrameWriter::u32(std::uint32_t value) {
+    out.push_back(static_cast<unsigned char>(value >> 24));
+    out.push_back(static_cast<unsigned char>(value >> 16));
+    out.push_back(static_cast<unsigned char>(value >> 8));
+    out.push_back(static_cast<unsigned char>(value));
+}
+
+/**
+ * Agrega un varint LEB128: 7 bits por byte, el bit alto indica que sigue otro.
+ *
+ * @param value Valor a escribir
+ */
+void FrameWriter::varint(std::uint64_t value) {
+    while (value >= 0x80) {
+        out.push_back(static_cast<unsigned char>(value | 0x80));
+        value >>= 7;
+    }
+    out.push_back(static_cast<unsigned char>(value));
+}
+
+/**
+ * Agrega una cantidad de elementos.
+ *
+ * @param value Cantidad (en v1 debe ser a lo más max_count())
+ */
+void FrameWriter::count(std::size_t value) {
+    if (ver == PROTOCOL_V1) {
+        out.push_back(static_cast<unsigned char>(std::min(value, MAX_V1_FIELD)));
+    } else {
+        varint(value);
+    }
+}
+
+/**
+ * Agrega una cadena precedida por su longitud en bytes.
+ * En v1 las cadenas de más de 255 bytes se recortan.
+ *
+ * @param value Cadena en UTF-8
+ */
+void FrameWriter::str(std::string_view value) {
+    if (ver == PROTOCOL_V1) {
+        value = value.substr(0, MAX_V1_FIELD);
+        out.push_back(static_cast<unsigned char>(value.size()));
+    } else {
+        varint(value.size());
+    }
+    out.insert(out.end(), value.begin(), value.end());
+}
+
+/**
+ * Agrega una cadena formada por varias partes, sin unirlas antes en otro
+ * buffer. Se codifica igual que str() con la concatenación.
+ *
+ * @param parts Partes de la cadena, en orden
+ */
+void FrameWriter::str(std::initializer_list<std::string_view> parts) {
+    std::size_t total = 0;
+    for (std::string_view part : parts) total += part.size();
+
+    std::size_t left = total;
+    if (ver == PROTOCOL_V1) {
+        left = std::min(total, MAX_V1_FIELD);
+        out.push_back(static_cast<unsigned char>(left));
+    } else {
+        varint(total);
+    }
+    for (std::string_view part : parts) {
+        part = part.substr(0, left);
+        out.insert(out.end(), part.begin(), part.end());
+        left -= part.size();
+    }
+}
+
+/**
+ * Agrega el contenido de otro mensaje de la misma versión (útil cuando la
+ * cantidad de elementos solo se conoce después de recorrerlos).
+ *
+ * @param other Mensaje a copiar al final
+ */
+void FrameWriter::append(const FrameWriter& other) {
+    out.insert(out.end(), other.out.begin(), other.out.end());
+}
+
+/**
+ * Crea un mensaje sobre el buffer de trabajo del hilo. Se termina con
+ * finish(), que devuelve el buffer para el siguiente mensaje.
+ *
+ * @param version Versión del protocolo
+ */
+FrameWriter FrameWriter::scratch(int version) {
+    FrameWriter writer(version);
+    writer.out = std::move(scratchBuffer);
+    writer.out.clear();
+    return writer;
+}
+
+/**
+ * Copia el mensaje a un vector de tamaño exacto y devuelve el buffer de
+ * trabajo al hilo: armar un mensaje cuesta una sola asignación, sin importar
+ * cuántas veces habría crecido el vector.
+ */
+std::vector<unsigned char> FrameWriter::finish() {
+    std::vector<unsigned char> frame(out.begin(), out.end());
+    scratchBuffer = std::move(out);
+    return frame;
+}
+
+/**
+ * Crea un lector sobre un mensaje recibido.
+ *
+ * @param data Inicio del mensaje (o del primer campo a leer)
+ * @param size Bytes disponibles
+ * @param version Versión del protocolo de la sesión
+ */
+FrameReader::FrameReader(const unsigned char* data, std::size_t size, int version)
+    : pos(data), end(data + size), ver(version) {}
+
+/**
+ * Lee un byte.
+ *
+ * @param value Valor leído
+ */
+bool FrameReader::u8(std::uint8_t& value) {
+    if (pos == end) return false;
+    value = *pos++;
+    return true;
+}
+
+/**
+ * Lee un entero de 32 bits big-endian.
+ *
+ * @param value Valor leído
+ */
+bool FrameReader::u32(std::uint32_t& value) {
+    if (remaining() < 4) return false;
+    value = (std::uint32_t(pos[0]) << 24) | (std::uint32_t(pos[1]) << 16) |
+            (std::uint32_t(pos[2]) << 8) | std::uint32_t(pos[3]);
+    pos += 4;
+    return true;
+}
+
+/**
+ * Lee una cantidad o longitud: un byte en v1, varint LEB128 en v2.
+ *
+ * @param value Valor leído
+ * @return false si el mensaje se termina o el varint es demasiado largo
+ */
+bool FrameReader::count(std::size_t& value) {
+    if (ver == PROTOCOL_V1) {
+        std::uint8_t byte;
+        if (!u8(byte)) return false;
+        value = byte;
+        return true;
+    }
+
+    std::uint64_t result = 0;
+    for (int i = 0; i < MAX_VARINT_BYTES; ++i) {
+        if (pos == end) return false;
+        unsigned char byte = *pos++;
+        result |= std::uint64_t(byte & 0x7F) << (7 * i);
+        if (!(byte & 0x80)) {
+            if (result > std::numeric_limits<std::uint32_t>::max()) return false;
+            value = static_cast<std::size_t>(result);
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * Lee una cadena precedida por su longitud.
+ *
+ * @param value Vista sobre los bytes de la cadena (válida mientras viva el buffer)
+ */
+bool FrameReader::str(std::string_view& value) {
+    std::size_t len;
+    if (!count(len) || len > remaining()) return false;
+    value = std::string_view(reinterpret_cast<const char*>(pos), len);
+    pos += len;
+    return true;
+}
@@ -0,0 +1,89 @@
+#ifndef PROTOCOL_H
+#define PROTOCOL_H
+
+#include <cstddef>
+#include <cstdint>
+#include <initializer_list>
+#include <string_view>
+#include <vector>
+
+// Versiones del protocolo binario. Se negocian en el handshake: la respuesta
+// HTTP previa anuncia la versión más nueva en `X-Chat-Protocol` y el cliente
+// la pide con `&v=2` en la URL del WebSocket. Sin `v`, se usa la versión 1.
+constexpr int PROTOCOL_V1 = 1;                 // Longitudes y cantidades de un byte
+constexpr int PROTOCOL_V2 = 2;                 // Longitudes y cantidades como varint LEB128
+constexpr int PROTOCOL_LATEST = PROTOCOL_V2;
+
+/**
+ * Serializa un mensaje con el formato de una versión del protocolo.
+ *
+ * Los códigos, estados y banderas ocupan un byte y las secuencias 4 bytes
+ * (big-endian) en ambas versiones. Lo que cambia son las longitudes de texto
+ * y las cantidades: un byte en v1, varint LEB128 en v2. Las longitudes
+ * siempre son en bytes UTF-8.
+ */
+class FrameWriter {
+public:
+    explicit FrameWriter(int version);
+
+    int version() const { return ver; }
+    std::size_t max_count() const;
+
+    void u8(std::uint8_t value);
+    void u32(std::uint32_t value);
+    void count(std::size_t value);
+    void str(std::string_view value);
+    void str(std::initializer_list<std::string_view> parts);
+    void append(const FrameWriter& other);
+
+    std::vector<unsigned char> take() { return std::move(out); }
+
+    static FrameWriter scratch(int version);
+    std::vector<unsigned char> finish();
+
+private:
+    void varint(std::uint64_t value);
+
+    int ver;
+    std::vector<unsigned char> out;
+};
+
+/**
+ * Lee los campos de un mensaje recibido, verificando cada longitud.
+ * Las cadenas se devuelven como vistas sobre el buffer original.
+ * Cada método devuelve false si el mensaje se termina antes de tiempo.
+ */
+class FrameReader {
+public:
+    FrameReader(const unsigned char* data, std::size_t size, int version);
+
+    int version() const { return ver; }
+    std::size_t remaining() const { return end - pos; }
+
+    bool u8(std::uint8_t& value);
+    bool u32(std::uint32_t& value);
+    bool count(std::size_t& value);
+    bool str(std::string_view& value);
+
+private:
+    const unsigned char* pos;
+    const unsigned char* end;
+    int ver;
+};
+
+/**
+ * Serializa un mensaje para una versión del protocolo.
+ * La función que escribe los campos se recibe como plantilla: un lambda con
+ * varias capturas no se copia a un std::function (que reservaría memoria).
+ *
+ * @param version Versión del protocolo
+ * @param encode Función que escribe los campos del mensaje
+ */
+template <typename Encoder>
+std::vector<unsigned char> encode_frame(int version, const Encoder& encode) {
+    FrameWriter writer = FrameWriter::scratch(version);
+    encode(writer);
+    return writer.finish();
+}
+
+#endif // PROTOCOL_H
@@ -0,0 +1,103 @@
+#include "RateLimit.h"
+#include <algorithm>
+#include <cstdlib>
+#include <string>
+
+/**
+ * Límites por defecto: holgados para una persona escribiendo o desplazándose
+ * por el historial, pero cortan a un cliente que inunda al servidor.
+ */
+RateLimits RateLimits::defaults() {
+    RateLimits limits;
+    limits.session = {100, 300};
+    limits.perType[1] = {5, 20};     // Lista de usuarios
+    limits.perType[2] = {10, 30};    // Información de usuario
+    limits.perType[3] = {5, 20};     // Cambio de estado
+    limits.perType[4] = {20, 100};   // Mensaje de chat
+    limits.perType[5] = {10, 50};    // Historial
+    limits.perType[6] = {10, 50};    // Página de historial
+    limits.perType[7] = {10, 50};    // Historial desde una secuencia
+    limits.perType[8] = {5, 20};     // Sincronización de la lista de usuarios
+    return limits;
+}
+
+/**
+ * Aplica una especificación de límites sobre los actuales.
+ * Formato: "tipo=tasa/ráfaga,..." donde tipo es un número o "*" para la
+ * sesión completa, y tasa 0 quita el límite (ej. "4=5/10,*=50/100").
+ * "off" quita todos los límites.
+ *
+ * @param spec Especificación
+ * @return false si tiene un formato inválido (los límites no cambian)
+ */
+bool RateLimits::parse(std::string_view spec) {
+    if (spec == "off") {
+        *this = RateLimits{};
+        return true;
+    }
+
+    RateLimits parsed = *this;
+    while (!spec.empty()) {
+        std::size_t comma = spec.find(',');
+        std::string item(spec.substr(0, comma));
+        spec = comma == std::string_view::npos ? std::string_view() : spec.substr(comma + 1);
+
+        std::size_t eq = item.find('=');
+        std::size_t slash = item.find('/');
+        if (eq == std::string::npos || slash == std::string::npos || slash < eq) return false;
+
+        std::string key = item.substr(0, eq);
+        char* end = nullptr;
+        double rate = std::strtod(item.c_str() + eq + 1, &end);
+        if (end != item.c_str() + slash || rate < 0) return false;
+        double burst = std::strtod(item.c_str() + slash + 1, &end);
+        if (*end != '\0' || burst < 0) return false;
+        RateLimit limit{rate, std::max(burst, 1.0)};
+
+        if (key == "*") {
+            parsed.session = limit;
+        } else {
+            unsigned long type = std::strtoul(key.c_str(), &end, 10);
+            if (key.empty() || *end != '\0' || type == 0 || type >= RATE_LIMIT_TYPES) return false;
+            parsed.perType[type] = limit;
+        }
+    }
+    *this = parsed;
+    return true;
+}
+
+/**
+ * Intenta gastar una ficha.
+ *
+ * @param limit Límite del cubo
+ * @param now Hora actual
+ * @return false si el cubo está vacío (la solicitud se rechaza)
+ */
+bool TokenBucket::take(const RateLimit& limit, Clock::time_point now) {
+    if (!limit.enabled()) return true;
+
+    if (last == Clock::time_point{}) {
+        tokens = limit.burst;
+    } else {
+        double elapsed = std::chrono::duration<double>(now - last).count();
+        tokens = std::min(limit.burst, tokens + elapsed * limit.rate);
+    }
+    last = now;
+
+    if (tokens < 1) return false;
+    tokens -= 1;
+    return true;
+}
+
+/**
+ * Decide si se atiende una solicitud: debe haber ficha en el cubo de su
+ * tipo y en el de la sesión.
+ *
+ * @param limits Límites configurados
+ * @param type Tipo de la solicitud
+ * @param now Hora actual
+ */
+bool SessionLimiter::allow(const RateLimits& limits, std::uint8_t type, TokenBucket::Clock::time_point now) {
+    if (type < RATE_LIMIT_TYPES && !perType[type].take(limits.perType[type], now)) return false;
+    return session.take(limits.session, now);
+}
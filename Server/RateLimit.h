@@ -0,0 +1,62 @@
+#ifndef RATELIMIT_H
+#define RATELIMIT_H
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+// Tipos de solicitud con límite propio; los demás solo cuentan para el límite de la sesión
+constexpr std::size_t RATE_LIMIT_TYPES = 16;
+
+/**
+ * Límite de un cubo de fichas: `rate` solicitudes por segundo en promedio,
+ * con ráfagas de hasta `burst`. Con rate 0 no hay límite.
+ */
+struct RateLimit {
+    double rate = 0;
+    double burst = 0;
+
+    bool enabled() const { return rate > 0; }
+};
+
+/**
+ * Límites por sesión: uno para todas las solicitudes y uno por tipo.
+ */
+struct RateLimits {
+    RateLimit session;
+    RateLimit perType[RATE_LIMIT_TYPES];
+
+    static RateLimits defaults();
+    bool parse(std::string_view spec);
+};
+
+/**
+ * Cubo de fichas. Se llena a `rate` fichas por segundo hasta `burst`; cada
+ * solicitud gasta una. Empieza lleno.
+ */
+class TokenBucket {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    bool take(const RateLimit& limit, Clock::time_point now);
+
+private:
+    double tokens = 0;
+    Clock::time_point last{};   // Última recarga (vacío: todavía no se usó)
+};
+
+/**
+ * Cubos de una sesión. No es seguro entre hilos: lo usa solo el strand de
+ * la sesión.
+ */
+class SessionLimiter {
+public:
+    bool allow(const RateLimits& limits, std::uint8_t type, TokenBucket::Clock::time_point now);
+
+private:
+    TokenBucket session;
+    TokenBucket perType[RATE_LIMIT_TYPES];
+};
+
+#endif // RATELIMIT_H
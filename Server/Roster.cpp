@@ -0,0 +1,57 @@
+#include "Roster.h"
+#include <random>
+#include <unordered_set>
+
+/**
+ * Crea el registro de cambios con una época inicial al azar.
+ *
+ * @param capacity Cambios que se conservan para responder con diferencias
+ */
+RosterLog::RosterLog(std::size_t capacity) : current(std::random_device{}()), capacity(capacity) {}
+
+/**
+ * Registra que un usuario se agregó o cambió de estado.
+ *
+ * @param user Usuario que cambió
+ */
+void RosterLog::record(UserId user) {
+    std::lock_guard<std::mutex> lock(mutex);
+    ++current;
+    changes.push_back(user);
+    if (changes.size() > capacity) {
+        changes.pop_front();
+    }
+}
+
+/**
+ * Época actual, para acompañar una lista completa.
+ */
+std::uint32_t RosterLog::epoch() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return current;
+}
+
+/**
+ * Usuarios que cambiaron después de una época (cada uno una sola vez).
+ *
+ * @param since Última época que conoce el cliente (0 si no conoce ninguna)
+ * @param current Recibe la época actual
+ * @return Los usuarios, o vacío si hace falta la lista completa
+ */
+std::optional<std::vector<UserId>> RosterLog::changes_since(std::uint32_t since, std::uint32_t& current) const {
+    std::lock_guard<std::mutex> lock(mutex);
+    current = this->current;
+
+    // Diferencia módulo 2^32: funciona aunque la época dé la vuelta
+    std::uint32_t behind = this->current - since;
+    if (since == 0 || behind > changes.size()) return std::nullopt;
+
+    std::vector<UserId> users;
+    std::unordered_set<UserId> seen;
+    for (std::size_t i = changes.size() - behind; i < changes.size(); ++i) {
+        if (seen.insert(changes[i]).second) {
+            users.push_back(changes[i]);
+        }
+    }
+    return users;
+}
@@ -0,0 +1,43 @@
+#ifndef ROSTER_H
+#define ROSTER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <optional>
+#include <vector>
+#include "Symbols.h"
+
+// Estado que indica, en una diferencia de la lista, que el usuario ya no está
+constexpr unsigned char ROSTER_REMOVED = 255;
+
+/**
+ * Versiones de la lista de usuarios.
+ *
+ * Cada alta o cambio de estado incrementa la época y guarda qué usuario
+ * cambió (no su estado: el estado actual se lee del registro al responder).
+ * Un cliente que conoce la época E solo necesita los usuarios que cambiaron
+ * después de E. El registro guarda los últimos `capacity` cambios; si el
+ * cliente está más atrás, o su época es de otra ejecución del servidor, hay
+ * que mandarle la lista completa.
+ *
+ * La época arranca en un valor al azar para que una época de una ejecución
+ * anterior casi nunca caiga dentro de la ventana actual.
+ */
+class RosterLog {
+public:
+    explicit RosterLog(std::size_t capacity = 4096);
+
+    void record(UserId user);
+    std::uint32_t epoch() const;
+    std::optional<std::vector<UserId>> changes_since(std::uint32_t since, std::uint32_t& current) const;
+
+private:
+    mutable std::mutex mutex;
+    std::deque<UserId> changes;        // Usuario de cada época, de la más vieja (current - size + 1) a current
+    std::uint32_t current;             // Época del último cambio
+    std::size_t capacity;
+};
+
+#endif // ROSTER_H
@@ -0,0 +1,93 @@
+#include "Symbols.h"
+#include <algorithm>
+#include <mutex>
+#include <stdexcept>
+
+/**
+ * Libera los bloques de nombres.
+ */
+SymbolTable::~SymbolTable() {
+    for (auto& block : blocks) {
+        delete[] block.load(std::memory_order_relaxed);
+    }
+}
+
+/**
+ * Fija cuántos nombres acepta la tabla. Los que ya tiene se conservan
+ * aunque pasen el límite.
+ *
+ * @param names Máximo de nombres (0: toda la capacidad de la tabla)
+ */
+void SymbolTable::set_limit(std::size_t names) {
+    std::unique_lock<std::shared_mutex> lock(mutex);
+    maxNames = names == 0 ? CAPACITY : std::min(names, CAPACITY);
+}
+
+/**
+ * Devuelve el id de un nombre, asignándole el siguiente si es nuevo.
+ *
+ * @param name Nombre de usuario
+ * @throws std::length_error si el nombre es nuevo y la tabla llegó al límite
+ */
+UserId SymbolTable::intern(std::string_view name) {
+    if (auto id = find(name)) return *id;
+
+    std::unique_lock<std::shared_mutex> lock(mutex);
+    auto it = ids.find(name);
+    if (it != ids.end()) return it->second;
+
+    std::size_t next = count.load(std::memory_order_relaxed);
+    if (next >= maxNames) {
+        throw std::length_error("tabla de símbolos llena");
+    }
+    std::size_t blockIndex = next >> BLOCK_BITS;
+    std::string* block = blocks[blockIndex].load(std::memory_order_relaxed);
+    if (!block) {
+        block = new std::string[BLOCK_SIZE];
+        blocks[blockIndex].store(block, std::memory_order_release);
+    }
+
+    std::string& stored = block[next & (BLOCK_SIZE - 1)];
+    stored.assign(name.data(), name.size());
+    UserId id = static_cast<UserId>(next);
+    ids.emplace(stored, id);
+    count.store(next + 1, std::memory_order_release);
+    return id;
+}
+
+/**
+ * Busca el id de un nombre sin registrarlo. No reserva memoria, así que
+ * sirve con nombres que todavía están en el buffer de lectura.
+ *
+ * @param name Nombre de usuario
+ * @return El id, o vacío si el nombre nunca se registró
+ */
+std::optional<UserId> SymbolTable::find(std::string_view name) const {
+    std::shared_lock<std::shared_mutex> lock(mutex);
+    auto it = ids.find(name);
+    if (it == ids.end()) return std::nullopt;
+    return it->second;
+}
+
+/**
+ * Nombre de un id ya asignado. No toma candados.
+ *
+ * @param id Id devuelto por intern() o find()
+ */
+const std::string& SymbolTable::name(UserId id) const {
+    return blocks[id >> BLOCK_BITS].load(std::memory_order_acquire)[id & (BLOCK_SIZE - 1)];
+}
+
+/**
+ * Nombre con el que se guarda un chat en el registro persistente: "~" para
+ * el general y "usuario1-usuario2" (en orden lexicográfico) para privados,
+ * el mismo formato de siempre, así los segmentos ya escritos siguen sirviendo.
+ *
+ * @param chat Clave del chat
+ */
+std::string SymbolTable::chat_name(ChatKey chat) const {
+    if (chat == GENERAL_CHAT) return "~";
+    const std::string& first = name(static_cast<UserId>(chat >> 32));
+    const std::string& second = name(static_cast<UserId>(chat & UINT32_MAX));
+    return first < second ? first + "-" + second : second + "-" + first;
+}
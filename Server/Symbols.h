@@ -0,0 +1,75 @@
+#ifndef SYMBOLS_H
+#define SYMBOLS_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+// Id denso de un usuario (0, 1, 2...), asignado la primera vez que se ve su nombre
+using UserId = std::uint32_t;
+// Clave de un chat: GENERAL_CHAT o el par (id_menor, id_mayor) empaquetado
+using ChatKey = std::uint64_t;
+
+constexpr UserId NO_USER = UINT32_MAX;
+constexpr ChatKey GENERAL_CHAT = UINT64_MAX;
+
+/**
+ * Clave del chat privado entre dos usuarios (la misma en ambos sentidos).
+ */
+inline ChatKey direct_chat(UserId a, UserId b) {
+    return a < b ? (ChatKey(a) << 32) | b : (ChatKey(b) << 32) | a;
+}
+
+/**
+ * Tabla de símbolos de los nombres de usuario.
+ *
+ * Cada nombre recibe un id al registrarse y lo conserva mientras corra el
+ * servidor; los ids no se reutilizan. Así el registro, el historial, las
+ * épocas de la lista y la presencia se indexan con enteros, y el camino de
+ * reenvío no vuelve a calcular hashes de nombres ni a armar claves.
+ *
+ * Los nombres viven en bloques que nunca se mueven, así que name() no toma
+ * candados y la referencia que devuelve es válida para siempre. Buscar un
+ * nombre (find, intern) usa un candado de lectura; solo un nombre nuevo
+ * toma el de escritura.
+ *
+ * Como los ids no se reutilizan, la tabla solo crece: set_limit() fija
+ * cuántos nombres acepta y, al llegar ahí, intern() rechaza los nuevos.
+ */
+class SymbolTable {
+public:
+    SymbolTable() = default;
+    ~SymbolTable();
+    SymbolTable(const SymbolTable&) = delete;
+    SymbolTable& operator=(const SymbolTable&) = delete;
+
+    void set_limit(std::size_t names);
+    std::size_t limit() const { return maxNames; }
+
+    UserId intern(std::string_view name);
+    std::optional<UserId> find(std::string_view name) const;
+    const std::string& name(UserId id) const;
+    std::size_t size() const { return count.load(std::memory_order_acquire); }
+
+    std::string chat_name(ChatKey chat) const;
+
+private:
+    // Nombres por bloque (potencia de dos) y bloques como máximo: ~16 millones de usuarios
+    static constexpr std::size_t BLOCK_BITS = 12;
+    static constexpr std::size_t BLOCK_SIZE = std::size_t(1) << BLOCK_BITS;
+    static constexpr std::size_t MAX_BLOCKS = 4096;
+    static constexpr std::size_t CAPACITY = MAX_BLOCKS * BLOCK_SIZE;
+
+    mutable std::shared_mutex mutex;                          // Protege `ids` y la creación de nombres
+    std::unordered_map<std::string_view, UserId> ids;         // Las vistas apuntan a los bloques
+    std::atomic<std::string*> blocks[MAX_BLOCKS] = {};
+    std::atomic<std::size_t> count{0};
+    std::size_t maxNames = CAPACITY;                          // Nombres que se aceptan (protegido por `mutex`)
+};
+
+#endif // SYMBOLS_H
@@ -0,0 +1,72 @@
+#include "TimerWheel.h"
+#include <algorithm>
+
+/**
+ * @param slots Ranuras de la rueda (se redondea a potencia de dos). Con
+ *              plazos más largos que las ranuras, el elemento da vueltas.
+ */
+TimerWheel::TimerWheel(std::size_t slots) {
+    std::size_t count = 1;
+    while (count < slots) count <<= 1;
+    this->slots = std::vector<Slot>(count);
+    mask = count - 1;
+}
+
+/**
+ * Agrega un elemento a la rueda. Puede llamarse desde cualquier hilo.
+ * El elemento sale solo cuando on_tick() devuelve 0 o cuando se destruye.
+ *
+ * @param entry Elemento (la rueda no lo mantiene vivo)
+ * @param deadline Tick en que se le llama; si ya pasó, en el siguiente
+ */
+void TimerWheel::schedule(std::weak_ptr<Entry> entry, Tick deadline) {
+    entries.fetch_add(1, std::memory_order_relaxed);
+    for (;;) {
+        Tick tick = std::max<Tick>(deadline, now() + 1);
+        Slot& slot = slots[tick & mask];
+        std::lock_guard<std::mutex> lock(slot.mutex);
+        // advance() cambia el tick con el candado de la ranura nueva: si ya
+        // llegó a esta, se perdería una vuelta entera, así que se reintenta
+        if (tick > now()) {
+            slot.timers.push_back(Timer{std::move(entry), tick});
+            return;
+        }
+    }
+}
+
+/**
+ * Avanza un tick y atiende los elementos cuyo plazo venció. Solo un hilo a
+ * la vez (el temporizador que mueve la rueda).
+ *
+ * @return Elementos a los que se llamó
+ */
+std::size_t TimerWheel::advance() {
+    Tick tick = now() + 1;
+    Slot& slot = slots[tick & mask];
+    {
+        std::lock_guard<std::mutex> lock(slot.mutex);
+        current.store(tick, std::memory_order_relaxed);
+        due.swap(slot.timers);
+    }
+
+    std::size_t fired = 0;
+    for (Timer& timer : due) {
+        Tick next = timer.deadline;
+        if (next <= tick) {
+            auto entry = timer.entry.lock();
+            next = entry ? entry->on_tick(tick) : 0;
+            if (entry) ++fired;
+            if (next == 0) {
+                entries.fetch_sub(1, std::memory_order_relaxed);
+                continue;
+            }
+            next = std::max<Tick>(next, tick + 1);
+        }
+        // Plazo más adelante (o de otra vuelta): a su ranura, sin volver a contarlo
+        Slot& target = slots[next & mask];
+        std::lock_guard<std::mutex> lock(target.mutex);
+        target.timers.push_back(Timer{std::move(timer.entry), next});
+    }
+    due.clear();
+    return fired;
+}
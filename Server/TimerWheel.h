@@ -0,0 +1,65 @@
+#ifndef TIMERWHEEL_H
+#define TIMERWHEEL_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+/**
+ * Rueda de temporizadores (hashed timer wheel) para los plazos de las
+ * sesiones: latidos, conexiones muertas e inactividad.
+ *
+ * El tiempo avanza en ticks (advance() una vez por resolución). Cada
+ * elemento espera en la ranura de su plazo (plazo % ranuras); al llegar a
+ * ella se le llama on_tick() y devuelve su próximo plazo. Así la actividad
+ * de una sesión no toca la rueda: basta con que anote cuándo fue, y al
+ * vencer el plazo el elemento decide si de verdad hay algo que hacer o
+ * solo se vuelve a programar más adelante.
+ *
+ * Un millón de sesiones cuestan un vector de entradas por ranura y ningún
+ * temporizador del sistema por sesión.
+ */
+class TimerWheel {
+public:
+    using Tick = std::uint32_t;
+
+    /**
+     * Algo con plazos en la rueda. on_tick() se llama desde el hilo que
+     * avanza la rueda, no desde el strand del elemento.
+     */
+    class Entry {
+    public:
+        virtual ~Entry() = default;
+        // Próximo tick en que quiere revisarse, o 0 para salir de la rueda
+        virtual Tick on_tick(Tick now) = 0;
+    };
+
+    explicit TimerWheel(std::size_t slots = 256);
+
+    void schedule(std::weak_ptr<Entry> entry, Tick deadline);
+    std::size_t advance();
+    Tick now() const { return current.load(std::memory_order_relaxed); }
+    std::size_t size() const { return entries.load(std::memory_order_relaxed); }
+
+private:
+    struct Timer {
+        std::weak_ptr<Entry> entry;
+        Tick deadline;
+    };
+
+    struct Slot {
+        std::mutex mutex;
+        std::vector<Timer> timers;
+    };
+
+    std::vector<Slot> slots;          // Cantidad potencia de dos
+    std::size_t mask;
+    std::atomic<Tick> current{1};     // Tick actual (0 significa "fuera de la rueda")
+    std::atomic<std::size_t> entries{0};
+    std::vector<Timer> due;           // Ranura en proceso (solo quien llama a advance)
+};
+
+#endif // TIMERWHEEL_H
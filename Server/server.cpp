@@ -2,12 +2,31 @@
 #include <boost/beast.hpp>
 #include <boost/beast/core.hpp>
 #include <boost/beast/http.hpp>
-#include <boost/asio.hpp>
-#include <iostream>
+#include "ClientRegistry.h"
+#include "ChatHistory.h"
+#include "Config.h"
+#include "HandlerMemory.h"
+#include "Inbox.h"
+#include "Logger.h"
+#include "Metrics.h"
+#include "Presence.h"
+#include "Roster.h"
+#include "Protocol.h"
+#include "RateLimit.h"
+#include "Symbols.h"
+#include "TimerWheel.h"
+#include <cstdio>
+#include <cstdlib>
 #include <unordered_map>
 #include <mutex>
 #include <thread>
 #include <string>
+#include <deque>
+#include <atomic>
+#include <memory>
+#include <algorithm>
+#include <chrono>
+#include <optional>
 
 // Definiendo alias para espacios de nombres comúnmente utilizados
 namespace beast = boost::beast;
@@ -17,41 +36,279 @@ namespace http = boost::beast::http;
 using tcp = boost::asio::ip::tcp;
 using namespace std;
 
+// Strand de cada sesión. El stream lo usa como tipo concreto de executor (en
+// lugar de any_io_executor): así iniciar una lectura o escritura no tiene que
+// copiar el strand a memoria dinámica.
+using SessionStrand = net::strand<net::io_context::executor_type>;
+using SessionSocket = tcp::socket::rebind_executor<SessionStrand>::other;
+using SessionStream = beast::basic_stream<tcp, SessionStrand>;
+
+// Límites de solicitudes por sesión (cubos de fichas); se ajustan con CHAT_RATE_LIMITS
+RateLimits rate_limits = RateLimits::defaults();
+
+// Sesiones WebSocket abiertas a la vez como máximo (0: sin límite) y las abiertas ahora
+std::size_t max_sessions = 0;
+std::atomic<std::size_t> live_sessions{0};
+
+// Bytes máximos del cuerpo de un mensaje de chat (error 6 si se pasa). Un
+// mensaje WebSocket más grande que esto más FRAME_OVERHEAD cierra la conexión
+std::size_t max_message_bytes = 4096;
+constexpr std::size_t FRAME_OVERHEAD = 1024;  // Tipo, destinatario y longitudes
+
+// Tiempo mínimo entre dos avisos de límite (error 5) a la misma sesión
+constexpr auto THROTTLE_NOTICE_INTERVAL = std::chrono::seconds(1);
+
+// Bytes máximos de un mensaje agrupado; al llegar aquí se escribe sin esperar la ventana
+constexpr std::size_t BATCH_MAX_BYTES = 16 * 1024;
+
+OutboundLimits outbound_limits;
+
+// Plazos de latido, conexión muerta e inactividad (en ticks de SESSION_TICK)
+KeepaliveOptions keepalive;
+
+// Rueda con los plazos de todas las sesiones; avanza un tick por SESSION_TICK
+TimerWheel sessionTimers;
+constexpr auto SESSION_TICK = std::chrono::seconds(1);
+
+// Ticks para completar el handshake HTTP/WebSocket antes de cerrar la conexión
+constexpr TimerWheel::Tick HANDSHAKE_TICKS = 10;
+
+/**
+ * Ticks hasta la primera revisión de una sesión: el menor de sus plazos,
+ * para que una sesión recién aceptada no espere todo el del handshake.
+ */
+TimerWheel::Tick first_check_ticks() {
+    TimerWheel::Tick ticks = HANDSHAKE_TICKS;
+    for (unsigned seconds : {keepalive.pingSeconds, keepalive.deadSeconds, keepalive.idleSeconds}) {
+        if (seconds > 0 && seconds < ticks) ticks = seconds;
+    }
+    return ticks;
+}
+
+// Tipos de solicitud con serie propia en las métricas; el resto se agrupa
+constexpr std::size_t METRIC_REQUEST_TYPES = 16;
+
+/**
+ * Contadores sueltos del servidor (índices de ServerMetrics::counters).
+ */
+enum ServerCounter : std::size_t {
+    ConnectionsAccepted,   // Conexiones TCP aceptadas
+    AcceptErrors,          // Errores al aceptar (sin descriptores, sin memoria...)
+    OutboundQueued,        // Mensajes en colas de salida ahora mismo (gauge)
+    OutboundDropped,       // Mensajes descartados por colas llenas
+    OutboundCoalesced,     // Mensajes reemplazados por uno más nuevo (Coalesce)
+    SlowDisconnects,       // Clientes desconectados por cola llena
+    FrameEncodings,        // Serializaciones hechas por las difusiones
+    OutboundWrites,        // Escrituras al WebSocket (una por mensaje, o por grupo tipo 58)
+    BatchedFrames,         // Mensajes que salieron dentro de un grupo tipo 58
+    PresenceChanges,       // Cambios de estado recibidos (cambios, conexiones, desconexiones)
+    PresenceAnnounced,     // Cambios de estado que sí se anunciaron tras agrupar
+    RosterSnapshots,       // Listas de usuarios completas (tipo 60 completo)
+    RosterDeltas,          // Listas de usuarios enviadas como diferencia (tipo 60)
+    SessionsRejected,      // Upgrades rechazados por llegar a max_sesiones
+    NamesRejected,         // Upgrades rechazados porque la tabla de nombres está llena
+    KeepalivePings,        // Pings enviados a sesiones en silencio
+    DeadSessionsClosed,    // Conexiones cerradas por no responder (o no completar el handshake)
+    IdleTransitions,       // Usuarios que el servidor pasó a Inactivo
+    OfflineExpired,        // Usuarios desconectados olvidados por la retención
+    InboxDelivered,        // Mensajes entregados desde las bandejas (tipo 61)
+    InboxLost,             // Mensajes pendientes que ya no se pudieron entregar
+    WelcomeBundles,        // Estados iniciales enviados al conectar (tipo 62)
+    SERVER_COUNTERS
+};
+
+/**
+ * Métricas que se exponen en /metrics.
+ * Todo se actualiza sin candados, sumando en la franja del hilo actual.
+ */
+struct ServerMetrics {
+    StripedCounters<SERVER_COUNTERS> counters;
+    StripedCounters<256> framesReceived;        // Mensajes recibidos por tipo
+    StripedCounters<256> framesSent;            // Mensajes encolados por tipo (uno por destinatario)
+    StripedCounters<256> framesThrottled;       // Solicitudes rechazadas por límite, por tipo
+    std::deque<Histogram> handleLatency;        // Tiempo de handle_message por tipo, en ns
+    // Destinatarios por difusión
+    Histogram fanout{{1, 2, 4, 8, 16, 32, 64, 128, 256, 512, 1024, 2048, 4096, 8192, 16384, 65536}};
+    // Mensajes que ya esperaban en la cola al encolar uno nuevo
+    Histogram queueDepth{{0, 1, 2, 4, 8, 16, 32, 64, 128, 256, 512, 1024, 2048, 4096, 8192, 16384}};
+
+    ServerMetrics() {
+        for (std::size_t i = 0; i < METRIC_REQUEST_TYPES; ++i) {
+            // De 1 µs a 100 ms
+            handleLatency.emplace_back(std::initializer_list<std::uint64_t>{
+                1000, 2500, 5000, 10000, 25000, 50000, 100000, 250000, 500000,
+                1000000, 2500000, 5000000, 10000000, 25000000, 50000000, 100000000}, 1e-9);
+        }
+    }
+};
+
+ServerMetrics metrics;
+
+/**
+ * Mensaje ya serializado y de solo lectura.
+ * Una difusión lo construye una sola vez y todas las colas de salida apuntan
+ * al mismo buffer: enviar a 10k usuarios cuesta una asignación, no 10k.
+ */
+using SharedFrame = std::shared_ptr<const std::vector<unsigned char>>;
+
+/**
+ * Convierte un mensaje recién construido en un SharedFrame.
+ *
+ * @param message Mensaje binario ya serializado
+ */
+SharedFrame make_frame(std::vector<unsigned char> message) {
+    return std::make_shared<const std::vector<unsigned char>>(std::move(message));
+}
+
 /**
- * Estructura que representa una sesión de cliente.
- * Mantiene el socket WebSocket, el estado del usuario y su dirección IP.
+ * Mensaje pendiente en la cola de salida de una sesión.
  */
-struct ClientSession {
-    std::shared_ptr<websocket::stream<tcp::socket>> ws;  // Socket WebSocket para la comunicación
-    int status;                                          // Estado del usuario (0:Desconectado, 1:Activo, 2:Ocupado, 3:Inactivo)
-    std::string ipAddress;                               // Dirección IP del cliente
+struct OutboundFrame {
+    SharedFrame data;                 // Mensaje binario compartido
+    std::uint64_t key = 0;            // Clave para la política Coalesce (0 si no aplica)
 };
 
-// Mapa que almacena todas las sesiones de clientes conectados, indexado por nombre de usuario
-std::unordered_map<std::string, ClientSession> clients;
-// Mutex para proteger el acceso concurrente al mapa de clientes
-std::mutex clients_mutex;
+/**
+ * Sesión asíncrona de un cliente.
+ * Todas las operaciones sobre el socket se ejecutan en el strand de la sesión,
+ * así que un número fijo de hilos puede atender miles de conexiones sin que
+ * dos hilos toquen el mismo stream al mismo tiempo.
+ *
+ * Sus plazos (handshake, latido, conexión muerta, inactividad) viven en la
+ * rueda sessionTimers: leer un mensaje solo anota el tick, y on_tick()
+ * decide al vencer el plazo si hay que actuar.
+ */
+class Session : public std::enable_shared_from_this<Session>, public TimerWheel::Entry {
+public:
+    explicit Session(SessionSocket&& socket);
+    ~Session();
+
+    void run();                                       // Inicia la lectura de la solicitud HTTP
+    void send(SharedFrame frame, std::uint64_t key = 0);  // Encola un mensaje (seguro desde cualquier hilo)
+    void send(std::vector<unsigned char> message) { send(make_frame(std::move(message))); }
+    bool is_open() const { return open.load(); }
+    int protocol() const { return protocolVersion; }    // Versión negociada en el handshake
+    UserId user() const { return userId; }              // Usuario dueño (NO_USER antes de registrarse)
+    TimerWheel::Tick on_tick(TimerWheel::Tick now) override;  // Revisa los plazos (desde la rueda)
+
+private:
+    void on_http_read(beast::error_code ec, std::size_t bytes);
+    void reply_http(http::status status, const std::string& body, const char* contentType = nullptr);
+    void on_accept(beast::error_code ec);
+    void do_read();
+    void on_read(beast::error_code ec, std::size_t bytes);
+    void enqueue(OutboundFrame frame);
+    void schedule_write(std::size_t bytes);
+    void on_batch_timer(beast::error_code ec);
+    void combine_outbox();
+    void do_write();
+    void on_write(beast::error_code ec, std::size_t bytes);
+    void on_close();
+    void send_ping();
+    void close_dead();
+    void mark_idle();
+
+    websocket::stream<SessionStream> ws;                  // Stream WebSocket sobre el socket TCP
+    beast::flat_buffer buffer;                            // Buffer de lectura; se reutiliza entre mensajes
+    HandlerMemory readMemory;                             // Memoria de la operación de lectura en curso
+    HandlerMemory writeMemory;                            // Memoria de la operación de escritura en curso
+    http::request<http::string_body> req;                 // Solicitud HTTP inicial
+    std::deque<OutboundFrame> outbox;                     // Mensajes pendientes de escritura
+    bool writing = false;                                 // Si hay una escritura en curso (outbox.front())
+    net::steady_timer batchTimer;                         // Ventana de agrupación (batchWindowUs > 0)
+    bool batchPending = false;                            // Si batchTimer está esperando
+    std::size_t batchBytes = 0;                           // Bytes encolados durante la ventana
+    std::size_t dropped = 0;                              // Mensajes descartados desde que se llenó la cola
+    SessionLimiter limiter;                               // Cubos de fichas de las solicitudes del cliente
+    std::chrono::steady_clock::time_point throttleNotice{};  // Último aviso de límite enviado
+    std::size_t throttled = 0;                            // Solicitudes rechazadas desde el último aviso
+    std::string username;                                 // Usuario dueño de la sesión
+    UserId userId = NO_USER;                              // Id del usuario en la tabla de símbolos
+    std::string clientIP;                                 // Dirección IP del cliente
+    bool newRegister = false;                             // Si el usuario se registró por primera vez
+    int protocolVersion = PROTOCOL_V1;                    // Versión del protocolo (fija tras el handshake)
+    std::atomic<bool> open{false};                        // Si el WebSocket está aceptado y abierto
+    std::atomic<bool> closed{false};                      // Si la sesión ya terminó (no se encola más)
+    bool admitted = false;                                // Si ocupa un lugar de max_sessions
+    std::atomic<TimerWheel::Tick> lastReceived{0};        // Tick del último dato recibido (incluye pings y pongs)
+    std::atomic<TimerWheel::Tick> lastRequest{0};         // Tick de la última solicitud del cliente
+    TimerWheel::Tick pingedAt = 0;                        // Tick del último ping (solo la rueda)
+    TimerWheel::Tick idleSince = 0;                       // lastRequest ya marcado como inactivo (solo la rueda)
+    bool pinging = false;                                 // Si hay un ping en curso
+    bool autoInactive = false;                            // Si el servidor la pasó a Inactivo (vuelve a Activo sola)
+};
+
+// Id de cada nombre de usuario; se asigna al registrarse y no cambia
+SymbolTable symbols;
+
+// Registro de todas las sesiones de clientes, indexado por id de usuario.
+// Fragmentado internamente: usuarios distintos no compiten por el mismo candado.
+ClientRegistry clients;
+
+// Historial de chat acotado: anillo por chat y límite global de memoria
+// La clave es GENERAL_CHAT o el par de ids de un chat privado (ver direct_chat)
+ChatHistory chatHistory{symbols};
+
+// Cambios de estado pendientes de anunciar; se envían juntos cada PRESENCE_TICK
+PresenceBatcher presence;
+constexpr auto PRESENCE_TICK = std::chrono::milliseconds(250);
+
+// Cuánto se recuerda a los usuarios desconectados, y cada cuánto se revisa
+OfflineRetention offline_retention;
+constexpr auto OFFLINE_SWEEP_INTERVAL = std::chrono::seconds(5);
+
+// Épocas de la lista de usuarios, para sincronizarla por diferencias (tipo 8)
+RosterLog roster;
+
+// Mensajes que cada usuario no recibió por no estar Activo; se entregan al volver (tipo 61)
+InboxStore inbox;
 
-// Mapa que almacena el historial de chat
-// La clave es un ID del chat, 
-unordered_map<string, vector<pair<string, string>>> chatHistory; 
-// Mutex para proteger el acceso concurrente al historial
-mutex history_mutex;
+/**
+ * Busca un parámetro en la parte de consulta de la URL ("?a=1&b=2").
+ *
+ * @param target Ruta de la solicitud HTTP
+ * @param key Nombre del parámetro
+ * @return El valor del parámetro, o vacío si no está
+ */
+std::optional<std::string> query_param(const std::string& target, const std::string& key) {
+    size_t query = target.find('?');
+    if (query == std::string::npos) return std::nullopt;
+
+    size_t pos = query + 1;
+    while (pos <= target.size()) {
+        size_t end = target.find('&', pos);
+        if (end == std::string::npos) end = target.size();
+        if (target.compare(pos, key.size(), key) == 0 && pos + key.size() < target.size() &&
+            target[pos + key.size()] == '=') {
+            size_t value = pos + key.size() + 1;
+            return target.substr(value, end - value);
+        }
+        pos = end + 1;
+    }
+    return std::nullopt;
+}
 
 /**
  * Extrae el nombre de usuario de la URL de la solicitud HTTP.
- * Busca el parámetro "?name=" en la URL.
+ * Busca el parámetro "name" en la URL.
  * 
  * @param target Solicitud HTTP recibida
  * @return El nombre de usuario extraído o "Desconocido" si no se encuentra
  */
 std::string extract_username(const std::string& target) {
-    size_t pos = target.find("?name=");
+    return query_param(target, "name").value_or("Desconocido");
+}
 
-    if (pos != std::string::npos) {
-        return target.substr(pos + 6);
-    }
-    return "Desconocido";
+/**
+ * Versión del protocolo que pide el cliente con el parámetro "v".
+ * Sin el parámetro se usa v1; una versión desconocida se limita a la más nueva.
+ *
+ * @param target Ruta de la solicitud HTTP
+ */
+int requested_protocol(const std::string& target) {
+    auto version = query_param(target, "v");
+    if (!version || *version == "1") return PROTOCOL_V1;
+    return PROTOCOL_LATEST;
 }
 
 
@@ -72,279 +329,1023 @@ std::string get_status_string(int status) {
 }
 
 /**
- * Imprime en la consola la lista de usuarios registrados y su estado actual.
- * Útil para depuración y monitoreo del servidor.
+ * Registra en el log (nivel Debug) la lista de usuarios y su estado actual.
+ * Útil para depuración y monitoreo del servidor; si el nivel Debug no está
+ * activo no se recorre el registro.
  */
 void print_users() {
-    std::lock_guard<std::mutex> lock(clients_mutex);
-    cout << "Usuarios registrados [" << clients.size() << "]: ";
-    for (const auto& [username, session] : clients) {
-        cout << username << " (Estado: " << get_status_string(session.status)
-                  << ", WebSocket: " << (session.ws && session.ws->is_open() ? "Abierto" : "Cerrado") 
-                  << ") | ";
+    if (!LOG_DEBUG_ENABLED()) return;
+
+    LOG_DEBUG("Usuarios conectados [" << clients.online_size() << "] (desconectados: " << clients.offline_size()
+              << "):");
+    clients.for_each_online([]([[maybe_unused]] UserId user, [[maybe_unused]] const ClientSession& session) {
+        LOG_DEBUG("  " << symbols.name(user) << " (Estado: " << get_status_string(session.status)
+                  << ", WebSocket: " << (session.session && session.session->is_open() ? "Abierto" : "Cerrado")
+                  << ")");
+    });
+
+    [[maybe_unused]] HistoryStats history = chatHistory.stats();
+    LOG_DEBUG("Historial: " << history.messages << " mensajes en " << history.chats << " chats, "
+              << (history.bytesUsed >> 10) << " KB de " << (history.maxBytes >> 10) << " KB"
+              << " (" << history.evictedChats << " chats descartados)");
+}
+
+/**
+ * Arma la respuesta de /metrics con el formato de texto de Prometheus.
+ * Los contadores se suman al momento; los usuarios por estado y el
+ * historial se leen del registro y de ChatHistory.
+ */
+std::string render_metrics() {
+    MetricsWriter out;
+
+    static const char* const STATUS_NAMES[] = {"desconectado", "activo", "ocupado", "inactivo"};
+    std::uint64_t byStatus[4] = {};
+    std::uint64_t openSessions = 0;
+    clients.for_each_online([&](UserId, const ClientSession& client) {
+        if (client.status >= 0 && client.status < 4) ++byStatus[client.status];
+        if (client.session && client.session->is_open()) ++openSessions;
+    });
+    byStatus[0] += clients.offline_size();
+    out.header("chat_users", "Usuarios registrados por estado", "gauge");
+    for (int status = 0; status < 4; ++status) {
+        out.sample("chat_users", std::string("status=\"") + STATUS_NAMES[status] + "\"", byStatus[status]);
+    }
+    out.header("chat_offline_expired_total", "Usuarios desconectados olvidados por la retención", "counter");
+    out.sample("chat_offline_expired_total", "", metrics.counters.value(OfflineExpired));
+    out.header("chat_sessions_open", "Sesiones WebSocket abiertas", "gauge");
+    out.sample("chat_sessions_open", "", openSessions);
+    out.header("chat_connections_accepted_total", "Conexiones TCP aceptadas", "counter");
+    out.sample("chat_connections_accepted_total", "", metrics.counters.value(ConnectionsAccepted));
+    out.header("chat_accept_errors_total", "Errores al aceptar conexiones", "counter");
+    out.sample("chat_accept_errors_total", "", metrics.counters.value(AcceptErrors));
+    out.header("chat_sessions_rejected_total", "Sesiones rechazadas por el límite de sesiones abiertas", "counter");
+    out.sample("chat_sessions_rejected_total", "", metrics.counters.value(SessionsRejected));
+    out.header("chat_names_rejected_total", "Usuarios nuevos rechazados por el límite de nombres", "counter");
+    out.sample("chat_names_rejected_total", "", metrics.counters.value(NamesRejected));
+    out.header("chat_names", "Nombres de usuario registrados desde el inicio", "gauge");
+    out.sample("chat_names", "", symbols.size());
+
+    out.header("chat_frames_received_total", "Mensajes recibidos de los clientes por tipo", "counter");
+    for (std::size_t type = 0; type < 256; ++type) {
+        if (std::uint64_t count = metrics.framesReceived.value(type)) {
+            out.sample("chat_frames_received_total", "type=\"" + std::to_string(type) + "\"", count);
+        }
     }
-    cout << endl;
+    out.header("chat_frames_sent_total", "Mensajes encolados hacia los clientes por tipo", "counter");
+    for (std::size_t type = 0; type < 256; ++type) {
+        if (std::uint64_t count = metrics.framesSent.value(type)) {
+            out.sample("chat_frames_sent_total", "type=\"" + std::to_string(type) + "\"", count);
+        }
+    }
+
+    out.header("chat_frames_throttled_total", "Solicitudes rechazadas por límite de tasa por tipo", "counter");
+    for (std::size_t type = 0; type < 256; ++type) {
+        if (std::uint64_t count = metrics.framesThrottled.value(type)) {
+            out.sample("chat_frames_throttled_total", "type=\"" + std::to_string(type) + "\"", count);
+        }
+    }
+
+    out.header("chat_handle_seconds", "Tiempo de handle_message por tipo de solicitud", "histogram");
+    for (std::size_t type = 0; type < METRIC_REQUEST_TYPES; ++type) {
+        if (metrics.framesReceived.value(type) == 0 && type != 0) continue;
+        metrics.handleLatency[type].render(out, "chat_handle_seconds",
+            type == 0 ? std::string("type=\"otro\"") : "type=\"" + std::to_string(type) + "\"");
+    }
+
+    out.header("chat_broadcast_fanout", "Destinatarios por difusión", "histogram");
+    metrics.fanout.render(out, "chat_broadcast_fanout", "");
+    out.header("chat_frame_encodings_total", "Serializaciones hechas por las difusiones (una por versión)", "counter");
+    out.sample("chat_frame_encodings_total", "", metrics.counters.value(FrameEncodings));
+
+    out.header("chat_outbound_queued", "Mensajes esperando en colas de salida", "gauge");
+    out.sample("chat_outbound_queued", "", metrics.counters.value(OutboundQueued));
+    out.header("chat_outbound_queue_depth", "Mensajes que ya esperaban en la cola al encolar uno nuevo", "histogram");
+    metrics.queueDepth.render(out, "chat_outbound_queue_depth", "");
+    out.header("chat_outbound_writes_total", "Escrituras al WebSocket", "counter");
+    out.sample("chat_outbound_writes_total", "", metrics.counters.value(OutboundWrites));
+    out.header("chat_outbound_batched_frames_total", "Mensajes enviados dentro de un grupo (tipo 58)", "counter");
+    out.sample("chat_outbound_batched_frames_total", "", metrics.counters.value(BatchedFrames));
+    out.header("chat_outbound_dropped_total", "Mensajes descartados por colas de salida llenas", "counter");
+    out.sample("chat_outbound_dropped_total", "", metrics.counters.value(OutboundDropped));
+    out.header("chat_outbound_coalesced_total", "Mensajes reemplazados por uno más nuevo (coalesce)", "counter");
+    out.sample("chat_outbound_coalesced_total", "", metrics.counters.value(OutboundCoalesced));
+    out.header("chat_slow_disconnects_total", "Clientes desconectados por cola de salida llena", "counter");
+    out.sample("chat_slow_disconnects_total", "", metrics.counters.value(SlowDisconnects));
+
+    out.header("chat_session_timers", "Sesiones con plazos en la rueda de temporizadores", "gauge");
+    out.sample("chat_session_timers", "", std::uint64_t(sessionTimers.size()));
+    out.header("chat_keepalive_pings_total", "Pings enviados a sesiones en silencio", "counter");
+    out.sample("chat_keepalive_pings_total", "", metrics.counters.value(KeepalivePings));
+    out.header("chat_dead_sessions_closed_total", "Conexiones cerradas por no responder o no completar el handshake", "counter");
+    out.sample("chat_dead_sessions_closed_total", "", metrics.counters.value(DeadSessionsClosed));
+    out.header("chat_idle_transitions_total", "Usuarios que el servidor pasó a Inactivo", "counter");
+    out.sample("chat_idle_transitions_total", "", metrics.counters.value(IdleTransitions));
+
+    out.header("chat_inbox_pending", "Mensajes privados pendientes en las bandejas", "gauge");
+    out.sample("chat_inbox_pending", "", std::uint64_t(inbox.size()));
+    out.header("chat_inbox_delivered_total", "Mensajes entregados desde las bandejas (tipo 61)", "counter");
+    out.sample("chat_inbox_delivered_total", "", metrics.counters.value(InboxDelivered));
+    out.header("chat_inbox_lost_total", "Mensajes pendientes que no se entregaron (bandeja llena o fuera del historial)", "counter");
+    out.sample("chat_inbox_lost_total", "", metrics.counters.value(InboxLost));
+
+    HistoryStats history = chatHistory.stats();
+    out.header("chat_presence_changes_total", "Cambios de estado recibidos", "counter");
+    out.sample("chat_presence_changes_total", "", metrics.counters.value(PresenceChanges));
+    out.header("chat_presence_announced_total", "Cambios de estado anunciados tras agrupar", "counter");
+    out.sample("chat_presence_announced_total", "", metrics.counters.value(PresenceAnnounced));
+
+    out.header("chat_welcome_bundles_total", "Estados iniciales enviados al conectar (tipo 62)", "counter");
+    out.sample("chat_welcome_bundles_total", "", metrics.counters.value(WelcomeBundles));
+    out.header("chat_roster_syncs_total", "Sincronizaciones de la lista de usuarios (tipo 8 o 62)", "counter");
+    out.sample("chat_roster_syncs_total", "tipo=\"completa\"", metrics.counters.value(RosterSnapshots));
+    out.sample("chat_roster_syncs_total", "tipo=\"diferencia\"", metrics.counters.value(RosterDeltas));
+
+    out.header("chat_history_bytes", "Memoria reservada por el historial", "gauge");
+    out.sample("chat_history_bytes", "", std::uint64_t(history.bytesUsed));
+    out.header("chat_history_max_bytes", "Límite de memoria del historial", "gauge");
+    out.sample("chat_history_max_bytes", "", std::uint64_t(history.maxBytes));
+    out.header("chat_history_chats", "Chats con historial en memoria", "gauge");
+    out.sample("chat_history_chats", "", std::uint64_t(history.chats));
+    out.header("chat_history_messages", "Mensajes en el historial en memoria", "gauge");
+    out.sample("chat_history_messages", "", std::uint64_t(history.messages));
+    out.header("chat_history_evicted_chats_total", "Chats descartados por falta de memoria", "counter");
+    out.sample("chat_history_evicted_chats_total", "", history.evictedChats);
+
+    out.header("chat_log_dropped_lines_total", "Líneas de log descartadas con el anillo lleno", "counter");
+    out.sample("chat_log_dropped_lines_total", "", Logger::instance().dropped());
+    return out.text();
 }
 
-/** 
- * Genere una clave única para cada conversación
- * 
- * @param user1 uno de los usuarios en la conversación
- * @param user2 uno de los usuarios en la conversación
-*/
-string get_chat_id(const string& user1, const string& user2) {
-    if (user1 < user2) {
-        return user1 + "-" + user2;  // Orden lexicográfico
-    } else {
-        return user2 + "-" + user1;
+/**
+ * Si la ruta de una solicitud HTTP es /metrics (con o sin parámetros).
+ *
+ * @param target Ruta de la solicitud HTTP
+ */
+bool is_metrics_path(const std::string& target) {
+    return target.compare(0, 8, "/metrics") == 0 && (target.size() == 8 || target[8] == '?');
+}
+
+/**
+ * Clave del chat que nombra un usuario: GENERAL_CHAT para "~", o la de la
+ * conversación privada entre ambos. Solo busca el nombre en la tabla de
+ * símbolos; no arma ninguna cadena.
+ *
+ * @param user Usuario que envía o consulta
+ * @param chatName Chat tal como lo nombró el cliente
+ * @return La clave, o vacío si el otro usuario no existe
+ */
+std::optional<ChatKey> chat_key(UserId user, std::string_view chatName) {
+    if (chatName == "~") return GENERAL_CHAT;
+    auto other = symbols.find(chatName);
+    if (!other) return std::nullopt;
+    return direct_chat(user, *other);
+}
+
+/**
+ * Encola el mismo mensaje en varias sesiones.
+ * Se llama después de recorrer el registro: sus candados solo se usan para
+ * elegir destinatarios, nunca mientras se entregan los mensajes.
+ * El mensaje se serializa una vez por versión del protocolo y todas las
+ * sesiones de esa versión comparten el buffer.
+ *
+ * @param targets Sesiones destino
+ * @param encode Función que escribe los campos del mensaje
+ * @param key Clave para la política Coalesce (opcional)
+ */
+template <typename Encoder>
+void send_to_all(const vector<shared_ptr<Session>>& targets, const Encoder& encode, std::uint64_t key = 0) {
+    SharedFrame frames[PROTOCOL_LATEST + 1];
+    for (const auto& target : targets) {
+        SharedFrame& frame = frames[target->protocol()];
+        if (!frame) {
+            frame = make_frame(encode_frame(target->protocol(), encode));
+            metrics.counters.add(FrameEncodings);
+        }
+        target->send(frame, key);
     }
+    metrics.fanout.observe(targets.size());
+}
+
+/**
+ * Serializa un mensaje con la versión del protocolo de una sesión y lo encola.
+ *
+ * @param session Sesión destino
+ * @param encode Función que escribe los campos del mensaje
+ */
+template <typename Encoder>
+void send_frame(Session& session, const Encoder& encode) {
+    session.send(encode_frame(session.protocol(), encode));
+}
+
+/**
+ * Envía un código de error a una sesión.
+ * Formato: [50, código]
+ *
+ * @param session Sesión destino
+ * @param code Código de error
+ */
+void send_error(Session& session, unsigned char code) {
+    send_frame(session, [code](FrameWriter& out) {
+        out.u8(50);    // ERROR
+        out.u8(code);
+    });
+}
+
+/**
+ * Agrega a `targets` las sesiones abiertas de los usuarios conectados.
+ *
+ * @param targets Vector donde se agregan las sesiones
+ * @param except Usuario a excluir (NO_USER para no excluir a nadie)
+ * @param activeOnly Si solo se incluyen usuarios con estado Activo
+ */
+void collect_online_sessions(vector<shared_ptr<Session>>& targets, UserId except, bool activeOnly) {
+    clients.for_each_online([&](UserId user, const ClientSession& client) {
+        if (user == except || !client.session || !client.session->is_open()) return;
+        if (activeOnly && client.status != 1) return;
+        targets.push_back(client.session);
+    });
+}
+
+/**
+ * Recolecta las sesiones abiertas de los usuarios conectados.
+ *
+ * @param except Usuario a excluir (NO_USER para no excluir a nadie)
+ * @param activeOnly Si solo se incluyen usuarios con estado Activo
+ * @return Sesiones a las que enviar un mensaje
+ */
+vector<shared_ptr<Session>> online_sessions(UserId except = NO_USER, bool activeOnly = false) {
+    vector<shared_ptr<Session>> targets;
+    collect_online_sessions(targets, except, activeOnly);
+    return targets;
+}
+
+/**
+ * Clave de agrupación para las notificaciones de estado de un usuario:
+ * con la política Coalesce solo se conserva la más reciente.
+ * El tipo va en la parte alta para que nunca sea 0 (sin clave).
+ *
+ * @param user Usuario cuyo estado cambió
+ */
+std::uint64_t presence_key(UserId user) {
+    return (std::uint64_t(54) << 32) | user;
+}
+
+/**
+ * Notifica a varias sesiones el estado de un usuario.
+ * Formato del mensaje: [54, longitud_nombre, nombre, estado]
+ *
+ * @param targets Sesiones destino
+ * @param user Usuario cuyo estado cambió
+ * @param status Nuevo estado
+ */
+void broadcast_status(const vector<shared_ptr<Session>>& targets, UserId user, unsigned char status) {
+    send_to_all(targets, [&](FrameWriter& out) {
+        out.u8(54);                  // Tipo de mensaje 54: Notificación de cambio de estado
+        out.str(symbols.name(user)); // Nombre de usuario
+        out.u8(status);              // Nuevo estado
+    }, presence_key(user));
 }
 
 
+/**
+ * Escribe la lista completa de usuarios: [longitud_nombre, nombre, estado], ...
+ * En v1 se corta en 255 usuarios (la cantidad ocupa un byte).
+ *
+ * @param users Mensaje donde se escriben las entradas
+ * @return Usuarios escritos
+ */
+std::size_t put_all_users(FrameWriter& users) {
+    std::size_t limit = users.max_count();
+    std::size_t count = 0;
+    clients.for_each([&](UserId user, int status) {
+        if (count == limit) return;
+        users.str(symbols.name(user));
+        users.u8(static_cast<unsigned char>(status));
+        ++count;
+    });
+    return count;
+}
+
 /**
  * Envía la lista de usuarios conectados al cliente solicitante.
  * Formato del mensaje: [51, número_usuarios, [longitud_nombre, nombre, estado], ...]
+ * En v1 el número de usuarios ocupa un byte, así que la lista se corta en 255.
  * 
- * @param ws Socket WebSocket del cliente al que enviar la información
+ * @param session Sesión del cliente al que enviar la información
  */
-void send_users_list_unlocked(websocket::stream<tcp::socket>& ws) {
-    // Same as send_users_list but without locking the mutex
-    // The caller must ensure the mutex is already locked
+void send_users_list(Session& session) {
+    // Las entradas se escriben aparte: la cantidad se conoce al terminar el recorrido
+    FrameWriter users(session.protocol());
+    std::size_t count = put_all_users(users);
+
+    FrameWriter response(session.protocol());
+    response.u8(51);  // Code 51: User list
+    response.count(count);
+    response.append(users);
     
-    vector<unsigned char> response;
-    response.push_back(static_cast<unsigned char>(51));  // Code 51: User list
-    response.push_back(static_cast<unsigned char>(clients.size()));  // Number of users
-    
-    // Add each user's information
-    for (const auto& [user, client] : clients) {
-        response.push_back(static_cast<unsigned char>(user.size()));
-        response.insert(response.end(), user.begin(), user.end());
-        response.push_back(static_cast<unsigned char>(client.status));
+    LOG_DEBUG("📜 Sending list of " << count << " users...");
+    session.send(response.take());
+    LOG_DEBUG("📜📢 Response queued successfully");
+}
+
+
+
+
+/**
+ * Marca un cambio de estado para anunciarlo en el próximo intervalo y
+ * lo registra en las épocas de la lista de usuarios.
+ *
+ * @param user Usuario cuyo estado cambió
+ */
+void presence_changed(UserId user) {
+    roster.record(user);
+    presence.mark(user);
+    metrics.counters.add(PresenceChanges);
+}
+
+/**
+ * Anuncia los cambios de estado acumulados en el intervalo.
+ * Formato v2: [59, cantidad, [longitud_nombre, nombre, estado], ...]
+ * Los clientes v1 reciben un tipo 54 por cada cambio.
+ *
+ * Solo se anuncian los usuarios cuyo estado actual es distinto del último
+ * anunciado: los que cambiaron y volvieron al mismo dentro del intervalo
+ * no generan tráfico.
+ */
+void flush_presence() {
+    std::vector<UserId> changed = presence.take_marked();
+    if (changed.empty()) return;
+
+    std::vector<std::pair<UserId, unsigned char>> updates;
+    for (UserId user : changed) {
+        auto entry = clients.find_session(user);
+        if (entry && presence.announce(user, entry->status)) {
+            updates.emplace_back(user, static_cast<unsigned char>(entry->status));
+        }
     }
-    
-    try {
-        cout << "📜 Sending list of " << clients.size() << " users..." << endl;
-        ws.write(net::buffer(response));
-        cout << "📜📢 Response sent successfully" << endl;
-    } 
-    catch (const std::exception& e) {
-        cerr << "❌ Error sending user list: " << e.what() << endl;
+    if (updates.empty()) return;
+    metrics.counters.add(PresenceAnnounced, updates.size());
+
+    vector<shared_ptr<Session>> latest;
+    vector<shared_ptr<Session>> legacy;
+    for (auto& session : online_sessions()) {
+        (session->protocol() >= PROTOCOL_V2 ? latest : legacy).push_back(std::move(session));
+    }
+
+    send_to_all(latest, [&](FrameWriter& out) {
+        out.u8(59);  // Código 59: Cambios de estado agrupados
+        out.count(updates.size());
+        for (const auto& [user, status] : updates) {
+            out.str(symbols.name(user));
+            out.u8(status);
+        }
+    });
+    if (!legacy.empty()) {
+        for (const auto& [user, status] : updates) {
+            broadcast_status(legacy, user, status);
+        }
+    }
+    LOG_DEBUG("🫥📢 " << updates.size() << " cambios de estado anunciados de " << changed.size());
+}
+
+/**
+ * Olvida a los usuarios desconectados según offline_retention. Salen de la
+ * lista de usuarios: quien sincroniza por épocas los recibe como
+ * ROSTER_REMOVED, y una solicitud de información de ellos da error 1.
+ *
+ * Corre en el mismo temporizador que el anuncio de estados (el único que
+ * toca el último estado anunciado), a lo más cada OFFLINE_SWEEP_INTERVAL.
+ */
+void forget_offline_users() {
+    static auto nextSweep = std::chrono::steady_clock::now();
+    auto now = std::chrono::steady_clock::now();
+    if (now < nextSweep) return;
+    nextSweep = now + OFFLINE_SWEEP_INTERVAL;
+
+    auto cutoff = offline_retention.seconds == 0 ? std::chrono::steady_clock::time_point::min()
+                                                 : now - std::chrono::seconds(offline_retention.seconds);
+    std::vector<UserId> expired = clients.expire_offline(cutoff, offline_retention.maxUsers);
+    if (expired.empty()) return;
+
+    for (UserId user : expired) {
+        roster.record(user);
+        presence.forget(user);
+        inbox.forget(user);
+    }
+    metrics.counters.add(OfflineExpired, expired.size());
+    LOG_INFO("🧹 " << expired.size() << " usuarios desconectados olvidados");
+}
+
+/**
+ * Anuncia los cambios de estado cada PRESENCE_TICK mientras corra el servidor.
+ *
+ * @param timer Temporizador del anuncio
+ */
+void schedule_presence_flush(net::steady_timer& timer) {
+    timer.expires_after(PRESENCE_TICK);
+    timer.async_wait([&timer](beast::error_code ec) {
+        if (ec) return;
+        flush_presence();
+        forget_offline_users();
+        schedule_presence_flush(timer);
+    });
+}
+
+/**
+ * Avanza la rueda de plazos de las sesiones cada SESSION_TICK.
+ *
+ * @param timer Temporizador de la rueda
+ */
+void schedule_session_ticks(net::steady_timer& timer) {
+    timer.expires_after(SESSION_TICK);
+    timer.async_wait([&timer](beast::error_code ec) {
+        if (ec) return;
+        sessionTimers.advance();
+        schedule_session_ticks(timer);
+    });
+}
+
+/**
+ * Sincroniza la lista de usuarios de un cliente desde la última época que conoce.
+ * Formato solicitud: [8, época (u32)]
+ * Formato respuesta: [60, época_actual (u32), completa, num_usuarios, [longitud_nombre, nombre, estado], ...]
+ *
+ * Si el servidor todavía tiene los cambios desde esa época, solo se envían
+ * los usuarios que cambiaron (estado ROSTER_REMOVED si ya no existen). Si no
+ * (época 0, muy vieja o de otra ejecución), `completa` es 1 y va la lista
+ * entera; en v1 se corta en 255 usuarios, como la tipo 51.
+ *
+ * @param in Campos del mensaje recibido (después del tipo)
+ * @param session Sesión del cliente
+ */
+void send_roster(FrameReader& in, Session& session) {
+    std::uint32_t since = 0;
+    in.u32(since);  // Sin época: lista completa
+
+    std::uint32_t epoch = 0;
+    auto changed = roster.changes_since(since, epoch);
+
+    FrameWriter users(session.protocol());
+    std::size_t count = 0;
+    bool full = !changed || changed->size() > users.max_count();
+    if (full) {
+        count = put_all_users(users);
+        metrics.counters.add(RosterSnapshots);
+    } else {
+        for (UserId user : *changed) {
+            auto entry = clients.find_session(user);
+            users.str(symbols.name(user));
+            users.u8(entry ? static_cast<unsigned char>(entry->status) : ROSTER_REMOVED);
+            ++count;
+        }
+        metrics.counters.add(RosterDeltas);
+    }
+
+    FrameWriter response(session.protocol());
+    response.u8(60);  // Código 60: Lista de usuarios por épocas
+    response.u32(epoch);
+    response.u8(full ? 1 : 0);
+    response.count(count);
+    response.append(users);
+
+    LOG_DEBUG("📜 Lista de usuarios " << (full ? "completa" : "parcial") << " con " << count << " usuarios (época "
+              << epoch << ")");
+    session.send(response.take());
+}
+
+/**
+ * Anota desde dónde le falta el chat general a un usuario que deja de estar
+ * Activo (los mensajes del general solo se envían a los Activos).
+ *
+ * @param user Usuario que pasó a Ocupado, Inactivo o Desconectado
+ */
+void leave_active(UserId user) {
+    inbox.mark_general(user, chatHistory.next_seq(GENERAL_CHAT));
+}
+
+/**
+ * Rangos de secuencias [desde, hasta) de cada chat con privados pendientes,
+ * en el orden en que llegó el primero de cada chat. Las secuencias
+ * consecutivas quedan en un solo rango, para leerlas juntas del historial.
+ *
+ * @param messages Referencias de una bandeja
+ */
+std::vector<std::pair<ChatKey, std::vector<std::pair<std::uint64_t, std::uint64_t>>>>
+pending_ranges(const std::vector<MessageRef>& messages) {
+    std::vector<std::pair<ChatKey, std::vector<std::uint32_t>>> byChat;
+    for (const MessageRef& ref : messages) {
+        auto it = std::find_if(byChat.begin(), byChat.end(), [&](const auto& group) { return group.first == ref.chat; });
+        if (it == byChat.end()) it = byChat.insert(byChat.end(), {ref.chat, {}});
+        it->second.push_back(ref.seq);
     }
+
+    std::vector<std::pair<ChatKey, std::vector<std::pair<std::uint64_t, std::uint64_t>>>> result;
+    result.reserve(byChat.size());
+    for (auto& [chat, seqs] : byChat) {
+        std::sort(seqs.begin(), seqs.end());
+        seqs.erase(std::unique(seqs.begin(), seqs.end()), seqs.end());
+        auto& ranges = result.emplace_back(chat, std::vector<std::pair<std::uint64_t, std::uint64_t>>()).second;
+        for (std::uint32_t seq : seqs) {
+            if (!ranges.empty() && ranges.back().second == seq) {
+                ++ranges.back().second;
+            } else {
+                ranges.emplace_back(seq, std::uint64_t(seq) + 1);
+            }
+        }
+    }
+    return result;
 }
 
-// Keep the original function but make it use the unlocked version:
-void send_users_list(websocket::stream<tcp::socket>& ws) {
-    lock_guard<mutex> lock(clients_mutex);
-    send_users_list_unlocked(ws);
+/**
+ * El otro usuario de un chat privado, que es el nombre con que lo ve `user`.
+ *
+ * @param chat Clave del chat privado
+ * @param user Uno de sus dos usuarios
+ */
+UserId other_member(ChatKey chat, UserId user) {
+    UserId first = static_cast<UserId>(chat >> 32);
+    return first == user ? static_cast<UserId>(chat & UINT32_MAX) : first;
 }
 
+/**
+ * Entrega de una vez lo que el usuario no recibió mientras no estaba Activo.
+ * Formato (solo v2): [61, descartados, num_chats, [longitud_chat, chat, num_mensajes,
+ *                     [longitud_emisor, emisor, longitud_mensaje, mensaje, seq (u32)], ...], ...]
+ *
+ * Los mensajes se leen del historial a partir de las referencias de la
+ * bandeja; cada chat lleva los suyos en orden de secuencia y el general va
+ * al final. `descartados` cuenta los que ya no se pudieron entregar (bandeja
+ * llena, fuera del historial o más del general de los que caben): el
+ * cliente lo nota por los huecos de secuencia y los pide al historial.
+ *
+ * Los clientes v1 no conocen el tipo 61: su bandeja se vacía sin enviar
+ * nada y siguen recuperándose con el historial, como siempre. Al
+ * reconectarse, un cliente v2 recibe en cambio el estado inicial (tipo 62).
+ *
+ * @param user Usuario que volvió a Activo (o un cliente v1 que se reconectó)
+ */
+void deliver_inbox(UserId user) {
+    if (!inbox.enabled()) return;
+    auto entry = clients.find_session(user);
+    if (!entry || entry->status != 1 || !entry->session) return;
+    InboxBatch pending = inbox.take(user);
+    if (pending.empty() || entry->session->protocol() < PROTOCOL_V2) return;
+    Session& session = *entry->session;
+
+    FrameWriter chats(session.protocol());
+    std::size_t numChats = 0;
+    std::size_t delivered = 0;
+    std::size_t lost = pending.dropped;
+
+    // Agrega un chat con los mensajes de los rangos [desde, hasta) que sigan en el historial
+    auto put_chat = [&](std::string_view name, ChatKey chat, const std::vector<std::pair<std::uint64_t, std::uint64_t>>& ranges) {
+        FrameWriter messages(session.protocol());
+        std::size_t count = 0;
+        for (const auto& [from, to] : ranges) {
+            std::size_t read = chatHistory.read(chat, from, to,
+                [&messages](std::uint64_t seq, std::string_view sender, std::string_view msg) {
+                    messages.str(sender);
+                    messages.str(msg);
+                    messages.u32(static_cast<std::uint32_t>(seq));
+                });
+            count += read;
+            lost += (to - from) - read;
+        }
+        if (count == 0) return;
+        chats.str(name);
+        chats.count(count);
+        chats.append(messages);
+        ++numChats;
+        delivered += count;
+    };
+
+    for (const auto& [chat, ranges] : pending_ranges(pending.messages)) {
+        put_chat(symbols.name(other_member(chat, user)), chat, ranges);
+    }
 
+    if (pending.generalSince) {
+        // Del general solo los últimos `capacity`; lo anterior queda para el historial
+        std::uint64_t next = chatHistory.next_seq(GENERAL_CHAT);
+        std::uint64_t from = std::min(*pending.generalSince, next);
+        if (next - from > inbox.capacity()) {
+            lost += next - from - inbox.capacity();
+            from = next - inbox.capacity();
+        }
+        if (from < next) put_chat("~", GENERAL_CHAT, {{from, next}});
+    }
 
+    metrics.counters.add(InboxDelivered, delivered);
+    metrics.counters.add(InboxLost, lost);
+    if (numChats == 0 && lost == 0) return;
+
+    FrameWriter response(session.protocol());
+    response.u8(61);  // Código 61: Bandeja de entrada
+    response.count(lost);
+    response.count(numChats);
+    response.append(chats);
+    session.send(response.take());
+    LOG_DEBUG("📬 " << delivered << " mensajes pendientes entregados a " << symbols.name(user) << " en " << numChats
+              << " chats (" << lost << " descartados)");
+}
 
 /**
  * Procesa la solicitud de cambio de estado de un usuario.
  * Formato del mensaje: [3, longitud_nombre, nombre, nuevo_estado]
- * Actualiza el estado del usuario y notifica a todos los clientes.
+ * Actualiza el estado del usuario. Quien lo pidió recibe la confirmación
+ * (tipo 54) de inmediato; el resto se entera en el próximo anuncio agrupado.
+ * Al volver a Activo, el usuario recibe su bandeja (ver deliver_inbox).
  * 
- * @param data Buffer con el mensaje recibido
+ * @param sender Usuario que envió la solicitud
+ * @param in Campos del mensaje recibido (después del tipo)
  */
- void change_state(const std::vector<unsigned char>& data) {
-    std::vector<unsigned char> message;
+ void change_state(UserId sender, FrameReader& in) {
+    std::string_view received_username;
+    std::uint8_t new_status;
 
-    // Validar longitud mínima del mensaje
-    if (data.size() < 3) {
-        cerr << "❌ Error: Mensaje demasiado corto para cambiar estado." << endl;
+    // Validar que el mensaje contiene el nombre completo y el estado
+    if (!in.str(received_username) || !in.u8(new_status)) {
+        LOG_WARN("❌ Error: El tamaño del nombre de usuario es incorrecto.");
+        return;
+    }
+    if (new_status > 3) {
+        LOG_WARN("❌ Error: Estado del usuario inválido.");
         return;
     }
 
-    unsigned char username_len = data[1];
-
-    // Validar que el mensaje contiene el nombre completo
-    if (username_len + 2 > data.size()) {
-        cerr << "❌ Error: El tamaño del nombre de usuario es incorrecto." << endl;
+    // Cambiar el estado del usuario
+    auto user = symbols.find(received_username);
+    if (!user || !clients.set_status(*user, new_status)) {
+        LOG_WARN("❌ Error: Usuario no encontrado.");
         return;
     }
+    const std::string& username = symbols.name(*user);
 
-    // Obtener el nombre de usuario
-    std::string received_username(reinterpret_cast<const char*>(&data[2]), username_len);
+    LOG_INFO("📢 El usuario " << username << " cambió su estado a " << static_cast<int>(new_status));
 
-    // El último byte es el nuevo estado
-    unsigned char new_status = data[2 + username_len];
-    if (!(new_status >= 0 && new_status <= 3)) {
-        message.push_back(50);                  // Código 50: Error
-        message.push_back(2);                   // Estado inválido
-        
-        cerr << "❌ Error: Estado del usuario inválido." << endl;
-    }
+    presence_changed(*user);
+    if (new_status != 1) leave_active(*user);
 
-    // Cambiar el estado del usuario
-    std::lock_guard<std::mutex> lock(clients_mutex);
-    auto it = clients.find(received_username);
-    if (it != clients.end()) {
-        it->second.status = new_status;
-        cout << "📢 El usuario " << received_username << " cambió su estado a " 
-                  << static_cast<int>(new_status) << endl;
-
-        // Construir el mensaje para el cambio de estado
-        message.push_back(54);  // Tipo de mensaje 54: Notificación de cambio de estado
-        message.push_back(static_cast<unsigned char>(received_username.size()));  // Longitud del nombre de usuario
-        message.insert(message.end(), received_username.begin(), received_username.end());  // Nombre de usuario
-        message.push_back(new_status);  // Nuevo estado
-
-        // Enviar el mensaje a todos los clientes conectados
-        for (auto& client : clients) {
-            if (client.second.ws->is_open()) {
-                client.second.ws->write(net::buffer(message));  // Enviar el mensaje
-            }
-        }
-        cout << "🫥📢 Respuesta enviada" << endl;
-    } else {
-        cerr << "❌ Error: Usuario no encontrado." << endl;
+    // Confirmar al solicitante sin esperar el anuncio
+    auto requester = clients.find_session(sender);
+    if (requester && requester->session) {
+        send_frame(*requester->session, [&](FrameWriter& out) {
+            out.u8(54);
+            out.str(username);
+            out.u8(new_status);
+        });
     }
+    LOG_DEBUG("🫥📢 Respuesta enviada");
+
+    // De vuelta en Activo: lo pendiente llega después de la confirmación
+    if (new_status == 1) deliver_inbox(*user);
 }
 
 
+// Máximo de mensajes en una página de historial (tipo 57)
+constexpr std::size_t MAX_HISTORY_PAGE = 100;
+
+/**
+ * Agrega un mensaje del historial con el formato del protocolo.
+ *
+ * @param out Mensaje de salida
+ * @param sender Nombre del emisor
+ * @param msg Contenido del mensaje
+ */
+void put_history_entry(FrameWriter& out, std::string_view sender, std::string_view msg) {
+    out.str(sender);  // Emisor
+    out.str(msg);     // Contenido del mensaje
+}
+
 /**
  * Envía el historial de chat al cliente solicitante.
  * Formato solicitud: [5, longitud_nombre_chat, nombre_chat]
  * Formato respuesta: [56, num_mensajes, [longitud_emisor, emisor, longitud_mensaje, mensaje], ...]
+ *
+ * En v1 la cantidad ocupa un byte, así que solo se envían los últimos 255
+ * mensajes; los clientes que necesiten más deben usar las páginas (tipo 6).
  * 
- * @param requester Nombre del usuario que solicita el historial
- * @param data Buffer con el mensaje recibido
- * @param ws Socket WebSocket del cliente
+ * @param requester Usuario que solicita el historial
+ * @param in Campos del mensaje recibido (después del tipo)
+ * @param session Sesión del cliente
  */
- void get_chat_history(const string& requester, const vector<unsigned char>& data, websocket::stream<tcp::socket>& ws) {
-    // Validar longitud mínima del mensaje
-    if (data.size() < 2) return;
-
-    unsigned char chatLen = static_cast<unsigned char>(data[1]);
-    if (data.size() < 2 + chatLen) return;
-
+ void get_chat_history(UserId requester, FrameReader& in, Session& session) {
     // Extraer nombre del chat solicitado
-    string chatName(data.begin() + 2, data.begin() + 2 + chatLen);
+    std::string_view chatName;
+    if (!in.str(chatName)) return;
     
-    // Generar la clave del chat
-    string chat_id = chatName != "~" ? get_chat_id(requester, chatName) : chatName;
+    // Agregar los últimos mensajes del historial (ninguno si el otro usuario no existe)
+    FrameWriter messages(session.protocol());
+    std::size_t numMessages = 0;
+    if (auto chat = chat_key(requester, chatName)) {
+        std::uint64_t next = chatHistory.next_seq(*chat);
+        std::uint64_t depth = std::min<std::uint64_t>(chatHistory.max_depth(), messages.max_count());
+        numMessages = chatHistory.read(*chat, next > depth ? next - depth : 0, next,
+            [&messages](std::uint64_t, std::string_view sender, std::string_view msg) {
+                put_history_entry(messages, sender, msg);
+            });
+    }
 
     // Construir respuesta
-    vector<unsigned char> response;
-    response.push_back(static_cast<unsigned char>(56));  // Código 56: Historial de chat
+    FrameWriter response(session.protocol());
+    response.u8(56);  // Código 56: Historial de chat
+    response.count(numMessages);
+    response.append(messages);
+
+    // Enviar respuesta
+    session.send(response.take());
+    LOG_DEBUG("🕘📢 Respuesta con historial enviada " << chatName);
+}
+
+/**
+ * Envía una página con los mensajes de un chat con secuencia en [from, to),
+ * del más antiguo al más nuevo.
+ * Formato respuesta: [57, longitud_nombre_chat, nombre_chat, primera_seq (u32), num_mensajes, hay_mas,
+ *                     [longitud_emisor, emisor, longitud_mensaje, mensaje], ...]
+ *
+ * Las secuencias de la página son consecutivas a partir de `primera_seq`.
+ * Sin registro persistente la página puede empezar después de `from`.
+ *
+ * @param chatName Nombre del chat tal como lo pidió el cliente
+ * @param chat Clave del chat (vacía si el otro usuario no existe: página vacía)
+ * @param from Primera secuencia a incluir
+ * @param to Secuencia siguiente a la última a incluir
+ * @param session Sesión del cliente
+ */
+void send_history_page(std::string_view chatName, std::optional<ChatKey> chat, std::uint64_t from, std::uint64_t to,
+                       Session& session) {
+    FrameWriter messages(session.protocol());
+    std::uint64_t firstSeq = to;
+    std::size_t numMessages = 0;
+    if (chat) {
+        numMessages = chatHistory.read(*chat, from, to,
+            [&](std::uint64_t seq, std::string_view sender, std::string_view msg) {
+                if (seq < firstSeq) firstSeq = seq;
+                put_history_entry(messages, sender, msg);
+            });
+    }
 
-    {
-        lock_guard<mutex> lock(history_mutex);
+    FrameWriter response(session.protocol());
+    response.u8(57);  // Código 57: Página de historial
+    response.str(chatName);
+    response.u32(static_cast<std::uint32_t>(firstSeq));
+    response.count(numMessages);
+    // Hay mensajes anteriores que todavía se pueden pedir
+    response.u8((numMessages > 0 && firstSeq > chatHistory.oldest_seq(*chat)) ? 1 : 0);
+    response.append(messages);
+
+    session.send(response.take());
+    LOG_DEBUG("🕘📄 Página de historial enviada " << chatName << " [" << firstSeq << ", " << to << ")");
+}
 
-        unsigned char numMessages = static_cast<unsigned char>(chatHistory[chat_id].size());
-        response.push_back(numMessages);  // Número de mensajes
+/**
+ * Envía una página del historial de un chat: hasta `limite` mensajes
+ * anteriores a la secuencia indicada.
+ * Formato solicitud: [6, longitud_nombre_chat, nombre_chat, antes_de (u32), limite]
+ * Formato respuesta: página tipo 57 (ver send_history_page)
+ *
+ * `antes_de` = 0xFFFFFFFF pide la página más reciente.
+ *
+ * @param requester Usuario que solicita el historial
+ * @param in Campos del mensaje recibido (después del tipo)
+ * @param session Sesión del cliente
+ */
+void get_history_page(UserId requester, FrameReader& in, Session& session) {
+    std::string_view chatName;
+    std::uint32_t before;
+    std::uint8_t requested;
+    if (!in.str(chatName) || !in.u32(before) || !in.u8(requested)) return;
+
+    std::size_t limit = std::min<std::size_t>(requested, MAX_HISTORY_PAGE);
+    if (limit == 0) limit = MAX_HISTORY_PAGE;
+
+    auto chat = chat_key(requester, chatName);
+    std::uint64_t to = chat ? std::min<std::uint64_t>(before, chatHistory.next_seq(*chat)) : 0;
+    send_history_page(chatName, chat, to > limit ? to - limit : 0, to, session);
+}
 
-        // Agregar cada mensaje del historial
-        for (const auto& [sender, msg] : chatHistory[chat_id]) {
-            response.push_back(static_cast<unsigned char>(sender.size()));  // Longitud del emisor
-            response.insert(response.end(), sender.begin(), sender.end());  // Nombre del emisor
-            response.push_back(static_cast<unsigned char>(msg.size()));     // Longitud del mensaje
-            response.insert(response.end(), msg.begin(), msg.end());        // Contenido del mensaje
+/**
+ * Envía los mensajes de un chat a partir de una secuencia, para que un
+ * cliente que ya tiene lo anterior solo reciba lo que le falta.
+ * Formato solicitud: [7, longitud_nombre_chat, nombre_chat, desde (u32)]
+ * Formato respuesta: página tipo 57 (ver send_history_page)
+ *
+ * Si faltan más mensajes de los que caben en una página (o `desde` no
+ * corresponde a este servidor), se envía la página más reciente; el cliente
+ * lo nota porque `primera_seq` no coincide con `desde`.
+ *
+ * @param requester Usuario que solicita el historial
+ * @param in Campos del mensaje recibido (después del tipo)
+ * @param session Sesión del cliente
+ */
+void get_history_since(UserId requester, FrameReader& in, Session& session) {
+    std::string_view chatName;
+    std::uint32_t sinceSeq;
+    if (!in.str(chatName) || !in.u32(sinceSeq)) return;
+
+    auto chat = chat_key(requester, chatName);
+    std::uint64_t since = sinceSeq;
+    std::uint64_t to = chat ? chatHistory.next_seq(*chat) : 0;
+    if (since > to || to - since > MAX_HISTORY_PAGE) {
+        since = to > MAX_HISTORY_PAGE ? to - MAX_HISTORY_PAGE : 0;
+    }
+    send_history_page(chatName, chat, since, to, session);
+}
+
+// Mensajes del chat general que lleva el estado inicial (tipo 62)
+constexpr std::size_t WELCOME_GENERAL_MESSAGES = 50;
+
+/**
+ * Envía a un cliente v2 recién conectado todo lo que necesita para mostrar
+ * la interfaz, en un solo mensaje, sin que tenga que pedirlo.
+ * Formato: [62, época (u32), num_usuarios, [longitud_nombre, nombre, estado], ...,
+ *           estado_propio,
+ *           primera_seq (u32), num_mensajes, hay_mas, [longitud_emisor, emisor, longitud_mensaje, mensaje], ...,
+ *           num_chats, [longitud_chat, chat, no_leídos], ...]
+ *
+ * - La lista de usuarios es la completa, como un tipo 60 desde la época 0.
+ * - Los mensajes son la página más reciente del chat general, como un tipo 57.
+ * - `no_leídos` cuenta, por chat privado, los mensajes de otros que quedaron
+ *   en su bandeja mientras estaba desconectado. La bandeja se vacía: esos
+ *   mensajes llegan con el historial cuando abre el chat.
+ *
+ * Reemplaza las solicitudes de lista (tipo 8) e historial del general
+ * (tipo 6) que el cliente hacía al conectarse.
+ *
+ * @param session Sesión recién aceptada
+ * @param user Usuario de la sesión
+ */
+void send_welcome(Session& session, UserId user) {
+    FrameWriter response(session.protocol());
+    response.u8(62);  // Código 62: Estado inicial
+
+    // Época antes de recorrer el registro: un cambio que se cuele en medio
+    // se vuelve a enviar en la próxima sincronización, no se pierde
+    std::uint32_t epoch = roster.epoch();
+    FrameWriter users(session.protocol());
+    std::size_t numUsers = put_all_users(users);
+    response.u32(epoch);
+    response.count(numUsers);
+    response.append(users);
+    metrics.counters.add(RosterSnapshots);
+
+    auto entry = clients.find_session(user);
+    response.u8(static_cast<unsigned char>(entry ? entry->status : 1));
+
+    FrameWriter messages(session.protocol());
+    std::uint64_t next = chatHistory.next_seq(GENERAL_CHAT);
+    std::uint64_t firstSeq = next;
+    std::size_t numMessages = chatHistory.read(GENERAL_CHAT,
+        next > WELCOME_GENERAL_MESSAGES ? next - WELCOME_GENERAL_MESSAGES : 0, next,
+        [&](std::uint64_t seq, std::string_view sender, std::string_view msg) {
+            if (seq < firstSeq) firstSeq = seq;
+            put_history_entry(messages, sender, msg);
+        });
+    response.u32(static_cast<std::uint32_t>(firstSeq));
+    response.count(numMessages);
+    // Hay mensajes anteriores que todavía se pueden pedir
+    response.u8((numMessages > 0 && firstSeq > chatHistory.oldest_seq(GENERAL_CHAT)) ? 1 : 0);
+    response.append(messages);
+
+    // Del general ya va la página más reciente; de los privados, cuántos hay
+    InboxBatch pending = inbox.take(user);
+    const std::string& own = symbols.name(user);
+    FrameWriter unread(session.protocol());
+    std::size_t numChats = 0;
+    for (const auto& [chat, ranges] : pending_ranges(pending.messages)) {
+        std::size_t count = 0;
+        for (const auto& [from, to] : ranges) {
+            chatHistory.read(chat, from, to, [&](std::uint64_t, std::string_view sender, std::string_view) {
+                if (sender != own) ++count;  // Sus propios mensajes (enviados Ocupado) no cuentan
+            });
         }
+        if (count == 0) continue;
+        unread.str(symbols.name(other_member(chat, user)));
+        unread.count(count);
+        ++numChats;
     }
+    response.count(numChats);
+    response.append(unread);
 
-    // Enviar respuesta
-    ws.write(net::buffer(response));
-    cout << "🕘📢 Respuesta con historial enviada " << chat_id << endl;
+    session.send(response.take());
+    metrics.counters.add(WelcomeBundles);
+    LOG_DEBUG("👋📦 Estado inicial enviado a " << own << ": " << numUsers << " usuarios, " << numMessages
+              << " mensajes del general, " << numChats << " chats con pendientes");
 }
 
 /**
  * Procesa un mensaje de chat y lo reenvía al destinatario.
  * Formato del mensaje: [4, longitud_destinatario, destinatario, longitud_mensaje, mensaje]
- * También almacena el mensaje en el historial de chat.
+ * Formato reenvío: [55, longitud_emisor, emisor, longitud_mensaje, mensaje, seq (u32)]
+ * También almacena el mensaje en el historial de chat; `seq` es su secuencia
+ * dentro del chat, la misma que usan las páginas de historial. Los mensajes
+ * a un usuario que nunca se registró no se guardan.
+ *
+ * Un privado para alguien desconectado, o para un cliente v2 Ocupado, no se
+ * reenvía: queda anotado en su bandeja y lo recibe al volver a Activo.
  * 
- * @param sender Nombre del usuario que envía el mensaje
- * @param data Buffer con el mensaje recibido
+ * @param senderId Usuario que envía el mensaje
+ * @param in Campos del mensaje recibido (después del tipo)
  */
- void process_chat_message(const string& sender, const vector<unsigned char>& data) {
-    // Validar longitud mínima del mensaje
-    if (data.size() < 3) return;
+ void process_chat_message(UserId senderId, FrameReader& in) {
+    // Destinatario y contenido se leen como vistas sobre el buffer de lectura:
+    // solo se copian al guardarse en el historial
+    std::string_view recipient, message;
+    if (!in.str(recipient) || !in.str(message)) return;
+
+    auto senderEntry = clients.find_session(senderId);
+    if (message.empty()) {
+        if (senderEntry && senderEntry->session) {
+            send_error(*senderEntry->session, 3);  // Mensaje vacío
+        }
+        return;
+    }
+    if (message.size() > max_message_bytes) {
+        if (senderEntry && senderEntry->session) {
+            send_error(*senderEntry->session, 6);  // Mensaje demasiado largo
+        }
+        return;
+    }
 
-    unsigned char usernameLen = static_cast<unsigned char>(data[1]);
-    if (data.size() < 2 + usernameLen + 1) return;
+    const std::string& sender = symbols.name(senderId);
+    LOG_DEBUG("💬 " << sender << " → " << recipient << ": " << message);
 
-    // Extraer destinatario
-    string recipient(data.begin() + 2, data.begin() + 2 + usernameLen);
-    
-    unsigned char messageLen = static_cast<unsigned char>(data[2 + usernameLen]);
-    if (data.size() < 3 + usernameLen + messageLen) return;
+    // Única búsqueda por nombre del reenvío: de aquí en adelante todo va por id
+    bool general = recipient == "~";
+    std::optional<UserId> recipientId;
+    if (!general) recipientId = symbols.find(recipient);
 
-    // Extraer contenido del mensaje
-    if (messageLen == 0) {
-        vector<unsigned char> response;
-        response.push_back(50); // ERROR
-        response.push_back(3);  // Mensaje vacío
+    // Guardar en historial
+    std::uint64_t seq = 0;
+    ChatKey chat = general ? GENERAL_CHAT : recipientId ? direct_chat(senderId, *recipientId) : 0;
+    if (general || recipientId) {
+        seq = chatHistory.append(chat, senderId, message);
     }
-    
-    string message(data.begin() + 3 + usernameLen, data.begin() + 3 + usernameLen + messageLen);
 
-    cout << "💬 " << sender << " → " << recipient << ": " << message << endl;
+    // Elegir destinatarios y enviar una vez terminado el recorrido.
+    // El vector se reutiliza entre mensajes del mismo hilo.
+    thread_local vector<shared_ptr<Session>> targets;
+    targets.clear();
+    shared_ptr<Session> senderSession;
+    unsigned char errorCode = 0;
+    bool inboxed = false;
 
-    // Guardar en historial
-    {
-        lock_guard<mutex> lock(history_mutex);
-        // Usa el id del chat, solamente el chat general usa su nombre como id
-        string chat_id = recipient != "~" ? get_chat_id(sender, recipient) : recipient;
-        chatHistory[chat_id].emplace_back(sender, message);
-    }    
-
-    // Trabajar con chat general
-    string New_sender = sender;
-    if (recipient == "~"){
-        New_sender = recipient;
-        message = sender + ": " + message;
-        messageLen = static_cast<unsigned char>(message.size());
+    // Si el destinatario es "~", es un mensaje para todos (broadcast)
+    if (general) {
+        collect_online_sessions(targets, senderId, true);
+    } else {
+        // Enviar al destinatario específico
+        auto recipientEntry = recipientId ? clients.find_session(*recipientId) : std::nullopt;
+        if (!recipientEntry) {
+            errorCode = 1;  // usuario inexistente
+        } else if (recipientEntry->status == 0 || !recipientEntry->session) {
+            errorCode = 4;  // usuario con estatus desconectado (lo recibe al volver, desde su bandeja)
+            inboxed = inbox.push(*recipientId, chat, seq);
+        } else if (recipientEntry->status == 2 && recipientEntry->session->protocol() >= PROTOCOL_V2 &&
+                   inbox.push(*recipientId, chat, seq)) {
+            inboxed = true;  // Ocupado: lo recibe junto con lo demás al volver a Activo
+        } else {
+            targets.push_back(std::move(recipientEntry->session));
+        }
     }
 
-    // Preparar mensaje para reenvío
-    vector<unsigned char> response;
-    response.push_back(static_cast<unsigned char>(55));  // Código 55: Mensaje de chat
-    response.push_back(static_cast<unsigned char>(New_sender.size()));
-    response.insert(response.end(), New_sender.begin(), New_sender.end());
-    response.push_back(messageLen);
-    response.insert(response.end(), message.begin(), message.end());
-
-    lock_guard<mutex> lock(clients_mutex);
-    
-    // Enviar copia al emisor
-    if (clients.find(sender) != clients.end() && clients[sender].status == 1) {
-        clients[sender].ws->write(net::buffer(response));
-        cout << "💬📢 Mensaje enviado al emisor" << endl;
+    // Copia para el emisor (no si el destinatario no existe: el mensaje no se guardó).
+    // Si no está Activo, un cliente v2 la recibe con su bandeja
+    if (senderEntry && senderEntry->session) {
+        senderSession = senderEntry->session;
+        if (senderEntry->status == 1 && errorCode != 1) {
+            targets.push_back(senderSession);
+        } else if (!general && errorCode != 1 && senderSession->protocol() >= PROTOCOL_V2) {
+            inbox.push(senderId, chat, seq);
+        }
     }
 
-    // Si el destinatario es "~", es un mensaje para todos (broadcast)
-    if (recipient == "~") {
-        for (auto& [user, client] : clients) {
-            if (client.status == 1 && user != sender) {
-                client.ws->write(net::buffer(response));
-            }
+    send_to_all(targets, [&](FrameWriter& out) {
+        out.u8(55);  // Código 55: Mensaje de chat
+        if (general) {
+            // Chat general: el emisor es "~" y el texto lleva el nombre de quien lo escribió
+            out.str(recipient);
+            out.str({sender, ": ", message});
+        } else {
+            out.str(sender);
+            out.str(message);
         }
-        cout << "💬📢 Mensaje enviado al todos" << endl;
+        out.u32(static_cast<std::uint32_t>(seq));  // Secuencia dentro del chat
+    });
+    targets.clear();  // Sin retener las sesiones hasta el próximo mensaje
+
+    // Si el destinatario volvió a Activo mientras se anotaba, su bandeja ya se
+    // vació: se le entrega ahora para que el mensaje no espere al próximo cambio
+    if (inboxed) deliver_inbox(*recipientId);
+
+    if (general) {
+        LOG_DEBUG("💬📢 Mensaje enviado al todos");
+    } else if (errorCode == 0) {
+        LOG_DEBUG("💬📢 Mensaje enviado al receptor");
     } else {
-        // Enviar al destinatario específico
-        if (clients.find(recipient) != clients.end() && clients[recipient].status != 0) {
-            clients[recipient].ws->write(net::buffer(response));
-            cout << "💬📢 Mensaje enviado al receptor" << endl;
-        } else {
-            vector<unsigned char> error;
-            if (clients.find(recipient) == clients.end())
-            {
-                error.push_back(50); // ERROR
-                error.push_back(1);  // usuario inexistente
-                clients[sender].ws->write(net::buffer(error));
-            }
-            
-            int actualStatus = clients[recipient].status;
-            if (actualStatus == 0) {
-                error.push_back(50); // ERROR
-                error.push_back(4);  // usuario con estatus desconectado
-                clients[sender].ws->write(net::buffer(error));
-            }
-            
-            cerr << "⚠️ Usuario no disponible: " << recipient << endl;
+        if (senderSession) {
+            send_error(*senderSession, errorCode);  // 1: usuario inexistente, 4: usuario desconectado
         }
+        LOG_WARN("⚠️ Usuario no disponible: " << recipient);
     }
 }
 
@@ -352,60 +1353,55 @@ void send_users_list(websocket::stream<tcp::socket>& ws) {
 /**
  * Envía información sobre un usuario específico al solicitante.
  * Formato solicitud: [2, longitud_nombre, nombre]
- * Formato respuesta: [52, exito, longitud_nombre, nombre, estado]
+ * Formato respuesta: [52, longitud_nombre, nombre, estado]
+ * Si el usuario no existe: [50, 1, 0]
  * 
- * @param requester Nombre del usuario que solicita la información
- * @param data Buffer con el mensaje recibido
+ * @param requester Usuario que solicita la información
+ * @param in Campos del mensaje recibido (después del tipo)
  */
- void send_info(const string& requester, const vector<unsigned char>& data) {
-    // Validación de datos entrantes
-    if (data.size() < 2) {
-        cerr << "❌ Error: Datos insuficientes para obtener información de usuario." << endl;
+ void send_info(UserId requester, FrameReader& in) {
+    // Extracción del nombre de usuario solicitado
+    std::string_view targetUsername;
+    if (!in.str(targetUsername)) {
+        LOG_WARN("❌ Error: Longitud del nombre de usuario incorrecta.");
         return;
     }
+    LOG_DEBUG("🔍 " << symbols.name(requester) << " solicita información de: " << targetUsername);
 
-    unsigned char usernameLen = static_cast<unsigned char>(data[1]);
-    if (data.size() < 2 + usernameLen) {
-        cerr << "❌ Error: Longitud del nombre de usuario incorrecta." << endl;
-        return;
+    // Búsqueda de información del usuario
+    bool found = false;
+    int targetStatus = 0;
+    shared_ptr<Session> requesterSession;
+    auto targetId = symbols.find(targetUsername);
+    if (auto target = targetId ? clients.find_session(*targetId) : std::nullopt) {
+        found = true;
+        targetStatus = target->status;
+    }
+    if (auto requesterEntry = clients.find_session(requester)) {
+        requesterSession = requesterEntry->session;
     }
 
-    // Extracción del nombre de usuario solicitado
-    string targetUsername(data.begin() + 2, data.begin() + 2 + usernameLen);
-    cout << "🔍 " << requester << " solicita información de: " << targetUsername << endl;
-
-    // Creación del paquete de respuesta
-    vector<unsigned char> response;
-    response.push_back(static_cast<unsigned char>(52));  // Tipo 52: Información de usuario
+    // Envío de respuesta al solicitante
+    if (!requesterSession || !requesterSession->is_open()) return;
 
-    // Búsqueda de información del usuario
-    lock_guard<mutex> lock(clients_mutex);
-    auto it = clients.find(targetUsername);
-    
-    if (it != clients.end()) {
+    if (found) {
         // Usuario encontrado - incluir información
-       // response.push_back(static_cast<unsigned char>(1));  // Indicador de éxito
-        response.push_back(usernameLen);
-        response.insert(response.end(), targetUsername.begin(), targetUsername.end());
-        response.push_back(it->second.status);
-        
-        cout << "ℹ️ Información de usuario " << targetUsername << " enviada a " << requester << endl;
+        send_frame(*requesterSession, [&](FrameWriter& out) {
+            out.u8(52);  // Tipo 52: Información de usuario
+            out.str(targetUsername);
+            out.u8(static_cast<unsigned char>(targetStatus));
+        });
+        LOG_DEBUG("ℹ️ Información de usuario " << targetUsername << " enviada a " << symbols.name(requester));
     } else {
-        response.clear();  // Limpiar la respuesta anterior
-        response.push_back(static_cast<unsigned char>(50));  // Código 50: Error
-        response.push_back(static_cast<unsigned char>(1));   // Usuario no existente
-
         // Usuario no encontrado
-        response.push_back(static_cast<unsigned char>(0));   // Indicador de fallo
-        cout << "⚠️ Usuario " << targetUsername << " no encontrado" << endl;
-    }
-
-    // Envío de respuesta al solicitante
-    auto requester_it = clients.find(requester);
-    if (requester_it != clients.end() && requester_it->second.ws->is_open()) {
-        requester_it->second.ws->write(net::buffer(response));
-        cout << "ℹ️📢 Respuesta enviada a " << requester << endl;
+        send_frame(*requesterSession, [](FrameWriter& out) {
+            out.u8(50);  // Código 50: Error
+            out.u8(1);   // Usuario no existente
+            out.u8(0);   // Indicador de fallo
+        });
+        LOG_DEBUG("⚠️ Usuario " << targetUsername << " no encontrado");
     }
+    LOG_DEBUG("ℹ️📢 Respuesta enviada a " << symbols.name(requester));
 }
 
 
@@ -413,31 +1409,16 @@ void send_users_list(websocket::stream<tcp::socket>& ws) {
  * Notifica a todos los usuarios conectados que hay un nuevo usuario en línea.
  * Formato mensaje: [53, longitud_nombre, nombre, estado]
  * 
- * @param username Nombre del nuevo usuario
+ * @param user Nuevo usuario
  */
- void broadcast_new_user(const std::string& username) {
-    std::vector<unsigned char> message;
-
-    message.push_back(static_cast<unsigned char>(53));  // Tipo 53: Nuevo usuario
-    message.push_back(static_cast<unsigned char>(username.size()));  // Longitud del nombre
-
-    // Agregar el nombre de usuario
-    message.insert(message.end(), username.begin(), username.end());
-
-    message.push_back(static_cast<unsigned char>(1));  // Estado inicial: Activo
-
+ void broadcast_new_user(UserId user) {
     // Enviar a todos los usuarios activos
-    std::lock_guard<std::mutex> lock(clients_mutex);
-    for (auto& [user, client] : clients) {
-        if (client.status == 1 && client.ws && client.ws->is_open()) {
-            try {
-                client.ws->write(net::buffer(message));
-            } catch (const boost::system::system_error& e) {
-                cerr << "⚠️ No se pudo enviar mensaje a " << user << ": " << e.what() << endl;
-            }
-        }
-    }
-    cout << "😁📢 Respuesta enviada a todos los usuarios"<< endl;
+    send_to_all(online_sessions(NO_USER, true), [&](FrameWriter& out) {
+        out.u8(53);                  // Tipo 53: Nuevo usuario
+        out.str(symbols.name(user)); // Nombre de usuario
+        out.u8(1);                   // Estado inicial: Activo
+    });
+    LOG_DEBUG("😁📢 Respuesta enviada a todos los usuarios");
 }
 
 /**
@@ -448,55 +1429,92 @@ void send_users_list(websocket::stream<tcp::socket>& ws) {
  * 3: Cambio de estado
  * 4: Mensaje de chat
  * 5: Solicitud de historial de chat
+ * 6: Solicitud de una página de historial
+ * 7: Solicitud de historial desde una secuencia
+ * 8: Sincronización de la lista de usuarios por épocas
  * 
- * @param sender Nombre del usuario que envía el mensaje
- * @param data Buffer con el mensaje recibido
+ * Los handlers leen directo del buffer de lectura de la sesión: los datos
+ * solo son válidos durante la llamada.
+ *
+ * @param sender Usuario que envía el mensaje
+ * @param data Inicio del mensaje recibido
+ * @param size Bytes del mensaje
+ * @param version Versión del protocolo de la sesión
  */
- void handle_message(const string& sender, const vector<unsigned char>& data) {
-    if (data.empty()) return;
+ void handle_message(UserId sender, const unsigned char* data, std::size_t size, int version) {
+    if (size == 0) return;
 
     unsigned char messageType = data[0];
+    FrameReader in(data + 1, size - 1, version);
 
     switch (messageType) {
         case 1:  // Solicitud de lista de usuarios
             {
-                cout << "📜 [" << std::this_thread::get_id() << "] User list request from: " << sender << endl;
-                lock_guard<mutex> lock(clients_mutex);
-                
-                auto it = clients.find(sender);
-                if (it != clients.end() && it->second.ws->is_open()) {
-                    send_users_list_unlocked(*it->second.ws);
+                LOG_DEBUG("📜 User list request from: " << symbols.name(sender));
+                auto entry = clients.lookup(sender);
+                if (entry && entry->session && entry->session->is_open()) {
+                    send_users_list(*entry->session);
                 } else {
-                    cout << "📜🔴 Cannot send user list (user not found or disconnected)" << endl;
+                    LOG_DEBUG("📜🔴 Cannot send user list (user not found or disconnected)");
                 }
             }
             break;
         case 2:  // Solicitud de información de usuario
-            cout << "ℹ️ [" << std::this_thread::get_id() << "] Solicitud de info de usuario de: " << sender << endl;
-            send_info(sender, data);
+            LOG_DEBUG("ℹ️ Solicitud de info de usuario de: " << symbols.name(sender));
+            send_info(sender, in);
             break;
         case 3:  // Cambio de estado
-            cout << "🫥 [" << std::this_thread::get_id() << "] Cambio de estado solicitado por: " << sender << endl;
-            change_state(data);
+            LOG_DEBUG("🫥 Cambio de estado solicitado por: " << symbols.name(sender));
+            change_state(sender, in);
             break;
         case 4:  // Mensaje de chat
-            cout << "💬 [" << std::this_thread::get_id() << "] Mensaje de chat recibido de: " << sender << endl;
-            process_chat_message(sender, data);
+            LOG_DEBUG("💬 Mensaje de chat recibido de: " << symbols.name(sender));
+            process_chat_message(sender, in);
             break;
         case 5:  // Solicitud de historial de chat
             {
-                cout << "🕘 [" << std::this_thread::get_id() << "] Solicitud de historial de: " << sender << endl;
-                lock_guard<mutex> lock(clients_mutex);
-                if (clients.find(sender) != clients.end() && clients[sender].status == 1) {
-                    get_chat_history(sender, data, *clients[sender].ws);
+                LOG_DEBUG("🕘 Solicitud de historial de: " << symbols.name(sender));
+                auto entry = clients.lookup(sender);
+                if (entry && entry->status == 1 && entry->session) {
+                    get_chat_history(sender, in, *entry->session);
+                } else {
+                    LOG_DEBUG("🕘🔴 No se pudo recuperar historial de chat (usuario no encontrado o no disponible).");
+                }
+            }
+            break;
+        case 6:  // Solicitud de una página de historial
+            {
+                LOG_DEBUG("🕘 Solicitud de página de historial de: " << symbols.name(sender));
+                auto entry = clients.lookup(sender);
+                if (entry && entry->status == 1 && entry->session) {
+                    get_history_page(sender, in, *entry->session);
+                } else {
+                    LOG_DEBUG("🕘🔴 No se pudo recuperar historial de chat (usuario no encontrado o no disponible).");
+                }
+            }
+            break;
+        case 7:  // Solicitud de historial desde una secuencia
+            {
+                LOG_DEBUG("🕘 Sincronización de historial de: " << symbols.name(sender));
+                auto entry = clients.lookup(sender);
+                if (entry && entry->status == 1 && entry->session) {
+                    get_history_since(sender, in, *entry->session);
                 } else {
-                    cout << "🕘🔴 [" << std::this_thread::get_id() << "] No se pudo recuperar historial de chat (usuario no encontrado o no disponible)." << endl;
+                    LOG_DEBUG("🕘🔴 No se pudo recuperar historial de chat (usuario no encontrado o no disponible).");
+                }
+            }
+            break;
+        case 8:  // Sincronización de la lista de usuarios
+            {
+                LOG_DEBUG("📜 Sincronización de lista de usuarios de: " << symbols.name(sender));
+                auto entry = clients.find_session(sender);
+                if (entry && entry->session && entry->session->is_open()) {
+                    send_roster(in, *entry->session);
                 }
             }
-            cout << "🔓 Mutex liberado" << endl;
             break;
         default:
-            cerr << "⚠️ [" << std::this_thread::get_id() << "] Mensaje no reconocido: " << (int)messageType << endl;
+            LOG_WARN("⚠️ Mensaje no reconocido: " << (int)messageType);
             break;
     }    
 }
@@ -532,189 +1550,783 @@ bool verificarEncabezadosWebSocket(const http::request<http::string_body>& req,
     res.body() = "Encabezados WebSocket incorrectos.";
     res.prepare_payload();
     http::write(socket, res);
-    cout << "❌ Encabezados WebSocket incorrectos." << endl;
+    LOG_WARN("❌ Encabezados WebSocket incorrectos.");
     return false;
 }
 
 /**
- * Maneja una sesión completa para un cliente conectado.
- * Gestiona la conexión inicial, el intercambio de mensajes y el cierre.
- * 
+ * Crea la sesión a partir del socket aceptado.
+ * El socket ya viene ligado a su propio strand desde el acceptor.
+ *
  * @param socket Socket TCP establecido con el cliente
  */
- void do_session(net::ip::tcp::socket socket) {
-    beast::flat_buffer buffer;
-    http::request<http::string_body> req;
-    std::string username;
-    bool connectionAccepted = false;
-    bool newRegister = false;
-    
+Session::Session(SessionSocket&& socket) : ws(std::move(socket)), batchTimer(ws.get_executor()) {}
 
-    try {
-        // Leer la solicitud HTTP inicial
-        http::read(socket, buffer, req);
-
-        std::string connHdr = std::string(req[http::field::connection]);
-        std::string upgHdr = std::string(req[http::field::upgrade]);
-        std::string target = std::string(req.target());
-        username = extract_username(target); 
-
-        // Verificar si la solicitud contiene los encabezados correctos para WebSocket
-        if (connHdr.find("Upgrade") == std::string::npos || upgHdr.find("websocket") == std::string::npos) {
-            http::response<http::string_body> res{http::status::ok, req.version()};
-
-            // Validación del nombre de usuario
-            if (username.empty() || username == "~") {
-                cout << "🧐 Nombre de usuario no permitido: " << username << "\n";
-                http::response<http::string_body> res{http::status::bad_request, req.version()};
-                res.body() = "Nombre de usuario no permitido.";
-                http::write(socket, res);
-                return;
-            }
+/**
+ * Descuenta de las métricas los mensajes que quedaron sin enviar.
+ */
+Session::~Session() {
+    metrics.counters.sub(OutboundQueued, outbox.size());
+}
 
-            // Comprobación de si el usuario ya está conectado
-            std::lock_guard<std::mutex> lock(clients_mutex);
-            auto it = clients.find(username);
-            if (it != clients.end() && it->second.status != 0) {
-                cout << "😶‍🌫️ Usuario ya está conectado: " << username << "\n";
-                http::response<http::string_body> res{http::status::bad_request, req.version()};
-                res.body() = "Usuario ya está conectado.";
-                http::write(socket, res);
-                return;
-            }
-            res.prepare_payload();
-            http::write(socket, res);
+/**
+ * Inicia la sesión leyendo la solicitud HTTP inicial.
+ * Puede ser una verificación de nombre (GET ?name=) o la solicitud de upgrade a WebSocket.
+ */
+void Session::run() {
+    TimerWheel::Tick now = sessionTimers.now();
+    lastReceived = now;
+    lastRequest = now;
+    sessionTimers.schedule(shared_from_this(), now + first_check_ticks());
+    net::dispatch(ws.get_executor(), [self = shared_from_this()]() {
+        http::async_read(self->ws.next_layer(), self->buffer, self->req,
+            beast::bind_front_handler(&Session::on_http_read, self));
+    });
+}
+
+/**
+ * Responde una solicitud HTTP simple y cierra la conexión.
+ *
+ * @param status Código HTTP de la respuesta
+ * @param body Cuerpo de la respuesta
+ * @param contentType Tipo del cuerpo (opcional)
+ */
+void Session::reply_http(http::status status, const std::string& body, const char* contentType) {
+    auto res = std::make_shared<http::response<http::string_body>>(status, req.version());
+    res->set("X-Chat-Protocol", std::to_string(PROTOCOL_LATEST));  // Versión más nueva que se acepta
+    if (contentType) {
+        res->set(http::field::content_type, contentType);
+    }
+    res->body() = body;
+    res->prepare_payload();
+    http::async_write(ws.next_layer(), *res,
+        [self = shared_from_this(), res](beast::error_code, std::size_t) {
+            beast::error_code ignored;
+            self->ws.next_layer().socket().shutdown(tcp::socket::shutdown_send, ignored);
+        });
+}
+
+/**
+ * Procesa la solicitud HTTP inicial.
+ * Si no es un upgrade responde la verificación de nombre; si lo es, registra
+ * al usuario y completa el handshake WebSocket.
+ */
+void Session::on_http_read(beast::error_code ec, std::size_t) {
+    if (ec) {
+        // operation_aborted: la rueda cerró una conexión que no completó el handshake
+        if (ec != http::error::end_of_stream && ec != net::error::operation_aborted) {
+            LOG_ERROR("❌ Error leyendo solicitud HTTP: " << ec.message());
+        }
+        return;
+    }
+
+    std::string connHdr = std::string(req[http::field::connection]);
+    std::string upgHdr = std::string(req[http::field::upgrade]);
+    std::string target = std::string(req.target());
+    username = extract_username(target);
+
+    // Verificar si la solicitud contiene los encabezados correctos para WebSocket
+    if (connHdr.find("Upgrade") == std::string::npos || upgHdr.find("websocket") == std::string::npos) {
+        // Métricas para Prometheus
+        if (is_metrics_path(target)) {
+            username.clear();
+            reply_http(http::status::ok, render_metrics(), "text/plain; version=0.0.4; charset=utf-8");
+            return;
+        }
+
+        // Validación del nombre de usuario
+        if (username.empty() || username == "~") {
+            LOG_INFO("🧐 Nombre de usuario no permitido: " << username);
+            reply_http(http::status::bad_request, "Nombre de usuario no permitido.");
             return;
         }
 
-        auto ws = std::make_shared<websocket::stream<net::ip::tcp::socket>>(std::move(socket));
-        std::string clientIP = ws->next_layer().remote_endpoint().address().to_string();
+        // Comprobación de si el usuario ya está conectado
+        auto id = symbols.find(username);
+        auto existing = id ? clients.lookup(*id) : std::nullopt;
+        if (existing && existing->status != 0) {
+            LOG_INFO("😶‍🌫️ Usuario ya está conectado: " << username);
+            reply_http(http::status::bad_request, "Usuario ya está conectado.");
+            return;
+        }
+        reply_http(http::status::ok, "");
+        return;
+    }
 
-        if (clients.find(username) == clients.end()) {
+    beast::error_code endpoint_ec;
+    auto endpoint = ws.next_layer().socket().remote_endpoint(endpoint_ec);
+    clientIP = endpoint_ec ? "" : endpoint.address().to_string();
+    protocolVersion = requested_protocol(target);  // Antes de registrarse: define cómo se le codifica todo
+
+    // Límite de sesiones abiertas: se reserva el lugar antes de registrar al usuario
+    if (max_sessions > 0 && live_sessions.fetch_add(1) >= max_sessions) {
+        live_sessions.fetch_sub(1);
+        metrics.counters.add(SessionsRejected);
+        LOG_WARN("🚧 Servidor lleno (" << max_sessions << " sesiones), rechazando a " << username);
+        username.clear();
+        reply_http(http::status::service_unavailable, "Servidor lleno.");
+        return;
+    }
+    admitted = max_sessions > 0;
+
+    try {
+        userId = symbols.intern(username);
+    } catch (const std::length_error&) {
+        // Los ids no se reutilizan: con la tabla llena solo entran nombres ya vistos
+        metrics.counters.add(NamesRejected);
+        LOG_WARN("🚧 Límite de " << symbols.limit() << " nombres alcanzado, rechazando a " << username);
+        username.clear();
+        on_close();
+        reply_http(http::status::service_unavailable, "Servidor lleno.");
+        return;
+    }
+    switch (clients.try_register(userId, {shared_from_this(), 1, clientIP})) {  // Estado: Activo
+        case RegisterResult::New:
             // Caso 1: Usuario completamente nuevo
-            clients[username] = {ws, 1, clientIP};  // Estado: Activo
-            cout << "✅ Nuevo usuario conectado: " << username<< " desde " << clientIP  << endl;
+            LOG_INFO("✅ Nuevo usuario conectado: " << username << " desde " << clientIP);
             newRegister = true;
-            connectionAccepted = true;
-        } else if (clients[username].status == 0) {
+            roster.record(userId);
+            break;
+        case RegisterResult::Reconnected:
             // Caso 2: Usuario estaba desconectado y se reconecta
-            clients[username] = {ws, 1};  // Estado: Activo
-            cout << "🔄 Usuario reconectado: " << username << " desde " << clientIP << endl;
-            connectionAccepted = true;
-
-            //Notificar el cambio de estado a activo
-            std::vector<unsigned char> message;
-            // Construir el mensaje para el cambio de estado
-            message.push_back(54);  // Tipo de mensaje 54: Notificación de cambio de estado
-            message.push_back(static_cast<unsigned char>(username.size()));  // Longitud del nombre de usuario
-            message.insert(message.end(), username.begin(), username.end());  // Nombre de usuario
-            message.push_back(1);  // Nuevo estado
-
-            //NOTIFICAR A TODOS
-            for (auto& [user, client] : clients) {
-                if (user != username && client.ws && client.ws->is_open()) {
-                    try {
-                        client.ws->write(net::buffer(message));
-                    } catch (const std::exception& e) {
-                        cerr << "⚠️ Error al notificar desconexión a " << user << ": " << e.what() << endl;
-                    }
-                }
+            LOG_INFO("🔄 Usuario reconectado: " << username << " desde " << clientIP);
+            break;
+        case RegisterResult::Taken:
+            // Caso 3: El nombre ya tiene una sesión activa
+            LOG_INFO("😶‍🌫️ Usuario ya está conectado: " << username);
+            username.clear();
+            userId = NO_USER;
+            on_close();
+            reply_http(http::status::bad_request, "Usuario ya está conectado.");
+            return;
+    }
+
+    if (!newRegister) {
+        // Avisar a todos el cambio de estado a activo (en el próximo anuncio)
+        presence_changed(userId);
+    }
+
+    // Aceptar la conexión WebSocket
+    ws.async_accept(req, beast::bind_front_handler(&Session::on_accept, shared_from_this()));
+}
+
+/**
+ * Finaliza el handshake WebSocket y arranca el bucle de lectura.
+ */
+void Session::on_accept(beast::error_code ec) {
+    if (ec) {
+        LOG_ERROR("❌ Error en handshake WebSocket: " << ec.message());
+        on_close();
+        return;
+    }
+
+    ws.binary(true);
+    ws.read_message_max(max_message_bytes + FRAME_OVERHEAD);
+    // Pings y pongs también cuentan como señal de vida (Beast responde los pings solo)
+    ws.control_callback([this](websocket::frame_type, beast::string_view) {
+        lastReceived.store(sessionTimers.now(), std::memory_order_relaxed);
+    });
+    lastReceived = lastRequest = sessionTimers.now();  // Los plazos cuentan desde el upgrade
+    open = true;
+    LOG_INFO("🔗 Cliente conectado (protocolo v" << protocolVersion << ")");
+    print_users();
+    if (protocolVersion >= PROTOCOL_V2) {
+        // Lista, estado, chat general y privados pendientes, antes del aviso de usuario nuevo
+        send_welcome(*this, userId);
+    } else if (!newRegister) {
+        deliver_inbox(userId);  // v1: solo se vacía la bandeja
+    }
+    if (newRegister) {
+        broadcast_new_user(userId);
+    }
+
+    // Enviar lo que se haya encolado durante el handshake (el aviso de nuevo
+    // usuario también llega a esta sesión y puede haber iniciado la escritura)
+    if (!outbox.empty() && !writing) {
+        do_write();
+    }
+    do_read();
+}
+
+/**
+ * Solicita de forma asíncrona el siguiente mensaje del cliente.
+ */
+void Session::do_read() {
+    ws.async_read(buffer, bind_handler_memory(readMemory,
+        beast::bind_front_handler(&Session::on_read, shared_from_this())));
+}
+
+/**
+ * Procesa un mensaje recibido y vuelve a leer.
+ */
+void Session::on_read(beast::error_code ec, std::size_t) {
+    if (ec) {
+        if (ec == websocket::error::closed) {
+            LOG_INFO("👋 Conexión cerrada limpiamente por " << username);
+        } else if (ec != net::error::operation_aborted) {  // Abortada: la cerró el servidor (y ya lo registró)
+            LOG_WARN("❌ Error de sistema: " << ec.message());
+        }
+        on_close();
+        return;
+    }
+    TimerWheel::Tick tick = sessionTimers.now();
+    lastReceived.store(tick, std::memory_order_relaxed);
+
+    // Procesar el mensaje directo sobre el buffer de lectura (un flat_buffer es
+    // contiguo); se libera al terminar y conserva su capacidad para el siguiente
+    auto data = buffer.data();
+    auto bytes = static_cast<const unsigned char*>(data.data());
+    auto start = std::chrono::steady_clock::now();
+    if (data.size() > 0 && !limiter.allow(rate_limits, bytes[0], start)) {
+        // Cliente por encima de su límite: se descarta la solicitud y se le
+        // avisa (a lo más una vez por THROTTLE_NOTICE_INTERVAL)
+        metrics.framesThrottled.add(bytes[0]);
+        ++throttled;
+        if (start - throttleNotice >= THROTTLE_NOTICE_INTERVAL) {
+            LOG_WARN("🚦 Limitando solicitudes de " << username << " (tipo " << static_cast<int>(bytes[0]) << ", "
+                     << throttled << " rechazadas)");
+            send_error(*this, 5);  // Demasiadas solicitudes
+            throttleNotice = start;
+            throttled = 0;
+        }
+    } else if (data.size() > 0) {
+        LOG_DEBUG("👀 Mensaje Recibido");
+        lastRequest.store(tick, std::memory_order_relaxed);
+        if (autoInactive) {
+            // El servidor lo había pasado a Inactivo: cualquier solicitud lo devuelve a Activo
+            autoInactive = false;
+            if (clients.replace_status(userId, 3, 1)) {
+                presence_changed(userId);
+                deliver_inbox(userId);
             }
         }
+        try {
+            handle_message(userId, bytes, data.size(), protocolVersion);  // Procesar el mensaje
+        } catch (const std::exception& e) {
+            LOG_ERROR("❌ Excepción: " << e.what());
+        }
+        auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start);
+        metrics.framesReceived.add(bytes[0]);
+        metrics.handleLatency[bytes[0] < METRIC_REQUEST_TYPES ? bytes[0] : 0].observe(elapsed.count());
+    }
+    buffer.consume(buffer.size());
 
-        if (connectionAccepted) {
-            // Aceptar la conexión WebSocket
-            ws->accept(req);
-            ws->binary(true);
-            cout << "🔗 Cliente conectado\n";
-            print_users();
-            if (newRegister){
-                broadcast_new_user(username);
-            }
-            
+    do_read();
+}
+
+/**
+ * Encola un mensaje para el cliente. Puede llamarse desde cualquier hilo:
+ * la escritura real ocurre en el strand de la sesión, así que quien difunde
+ * un mensaje nunca espera a que el cliente lo lea. Si ya se está en el
+ * strand de la sesión (la respuesta a su propia solicitud), se encola sin
+ * pasar por la cola del executor.
+ *
+ * @param frame Mensaje binario compartido a enviar
+ * @param key Clave para agrupar mensajes equivalentes con la política Coalesce
+ */
+void Session::send(SharedFrame frame, std::uint64_t key) {
+    metrics.framesSent.add(frame->front());
+    net::dispatch(ws.get_executor(),
+        [self = shared_from_this(), frame = OutboundFrame{std::move(frame), key}]() mutable {
+            self->enqueue(std::move(frame));
+        });
+}
+
+/**
+ * Agrega un mensaje a la cola respetando el límite configurado.
+ * Se ejecuta siempre dentro del strand de la sesión.
+ *
+ * @param frame Mensaje a encolar
+ */
+void Session::enqueue(OutboundFrame frame) {
+    if (closed) return;  // Difusión armada antes de que la sesión se cerrara
+
+    // El mensaje en escritura (outbox.front()) no se puede tocar
+    std::size_t first = writing ? 1 : 0;
+    metrics.queueDepth.observe(outbox.size());
+
+    if (outbox.size() >= outbound_limits.maxMessages) {
+        if (outbound_limits.policy == OverflowPolicy::Disconnect) {
+            LOG_WARN("🐢 Cola de salida llena, desconectando a " << username);
+            std::size_t discarded = outbox.size() - first;
+            metrics.counters.sub(OutboundQueued, discarded);
+            metrics.counters.add(OutboundDropped, discarded + 1);
+            metrics.counters.add(SlowDisconnects);
+            outbox.erase(outbox.begin() + first, outbox.end());
+            beast::error_code ignored;
+            beast::get_lowest_layer(ws).socket().close(ignored);
+            return;
         }
 
-        // Bucle principal de la sesión
-        while (connectionAccepted) {
-            if (!ws->is_open()) {
-                cout << "❌ Conexión WebSocket cerrada por el cliente: " << username << endl;
-                break;
+        if (outbound_limits.policy == OverflowPolicy::Coalesce && frame.key != 0) {
+            for (std::size_t i = first; i < outbox.size(); ++i) {
+                if (outbox[i].key == frame.key) {
+                    outbox[i] = std::move(frame);
+                    metrics.counters.add(OutboundCoalesced);
+                    return;
+                }
             }
+        }
 
-            beast::flat_buffer buffer;
-            ws->read(buffer);  // Leer datos del cliente WebSocket
+        metrics.counters.add(OutboundDropped);
+        if (outbox.size() <= first) return;  // Nada que descartar salvo el mensaje nuevo
+        outbox.erase(outbox.begin() + first);
+        metrics.counters.sub(OutboundQueued);
+        if (dropped++ == 0) {
+            LOG_WARN("🐢 Cola de salida llena, descartando mensajes para " << username);
+        }
+    }
 
-            // Convertir los datos recibidos a un vector de bytes
-            auto data = buffer.data();
-            std::vector<unsigned char> message_data(boost::asio::buffer_cast<const unsigned char*>(data),
-                                                    boost::asio::buffer_cast<const unsigned char*>(data) + boost::asio::buffer_size(data));
+    outbox.push_back(std::move(frame));
+    metrics.counters.add(OutboundQueued);
+    if (!writing && open) {
+        schedule_write(outbox.back().data->size());
+    }
+}
 
-            if (!message_data.empty()) {
-                cout<<"👀 Mensaje Recibido"<<endl;
-                handle_message(username, message_data);  // Procesar el mensaje
-            }
+/**
+ * Inicia la escritura de la cola, o la posterga hasta el fin de la ventana
+ * de agrupación para juntar más mensajes en una sola escritura.
+ *
+ * @param bytes Tamaño del mensaje recién encolado
+ */
+void Session::schedule_write(std::size_t bytes) {
+    if (outbound_limits.batchWindowUs <= 0 || protocolVersion < PROTOCOL_V2) {
+        do_write();
+        return;
+    }
+
+    batchBytes += bytes;
+    if (batchBytes >= BATCH_MAX_BYTES) {
+        // Ya hay suficiente para un grupo: no tiene sentido seguir esperando
+        batchTimer.cancel();
+        batchPending = false;
+        do_write();
+        return;
+    }
+    if (batchPending) return;
+
+    batchPending = true;
+    batchTimer.expires_after(std::chrono::microseconds(outbound_limits.batchWindowUs));
+    batchTimer.async_wait(beast::bind_front_handler(&Session::on_batch_timer, shared_from_this()));
+}
+
+/**
+ * Fin de la ventana de agrupación: escribe lo acumulado.
+ */
+void Session::on_batch_timer(beast::error_code ec) {
+    if (ec == net::error::operation_aborted) return;
+    batchPending = false;
+    if (!writing && open && !outbox.empty()) {
+        do_write();
+    }
+}
+
+/**
+ * Junta los primeros mensajes de la cola (hasta BATCH_MAX_BYTES) en un solo
+ * mensaje, que reemplaza a outbox.front(). Solo para clientes v2.
+ * Formato: [58, cantidad, [longitud, mensaje], ...]
+ */
+void Session::combine_outbox() {
+    std::size_t count = 0;
+    std::size_t bytes = 0;
+    while (count < outbox.size() && bytes + outbox[count].data->size() <= BATCH_MAX_BYTES) {
+        bytes += outbox[count].data->size();
+        ++count;
+    }
+    if (count < 2) return;
+
+    FrameWriter batch = FrameWriter::scratch(protocolVersion);
+    batch.u8(58);  // Código 58: Varios mensajes
+    batch.count(count);
+    for (std::size_t i = 0; i < count; ++i) {
+        const std::vector<unsigned char>& message = *outbox[i].data;
+        batch.str(std::string_view(reinterpret_cast<const char*>(message.data()), message.size()));
+    }
+    SharedFrame combined = make_frame(batch.finish());
+
+    outbox.erase(outbox.begin(), outbox.begin() + count);
+    outbox.push_front(OutboundFrame{std::move(combined), 0});
+    metrics.counters.sub(OutboundQueued, count - 1);
+    metrics.counters.add(BatchedFrames, count);
+}
+
+/**
+ * Escribe el primer mensaje de la cola.
+ */
+void Session::do_write() {
+    batchBytes = 0;
+    if (outbound_limits.batchWindowUs >= 0 && protocolVersion >= PROTOCOL_V2 && outbox.size() > 1) {
+        combine_outbox();
+    }
+    writing = true;
+    metrics.counters.add(OutboundWrites);
+    ws.async_write(net::buffer(*outbox.front().data), bind_handler_memory(writeMemory,
+        beast::bind_front_handler(&Session::on_write, shared_from_this())));
+}
+
+/**
+ * Continúa con el siguiente mensaje de la cola tras una escritura.
+ */
+void Session::on_write(beast::error_code ec, std::size_t) {
+    writing = false;
+    if (ec) {
+        LOG_WARN("⚠️ No se pudo enviar mensaje a " << username << ": " << ec.message());
+        metrics.counters.sub(OutboundQueued, outbox.size());
+        outbox.clear();
+        return;
+    }
+
+    if (!outbox.empty()) {
+        outbox.pop_front();
+        metrics.counters.sub(OutboundQueued);
+    }
+    if (!outbox.empty()) {
+        do_write();
+    } else if (dropped > 0) {
+        LOG_WARN("🐢 " << dropped << " mensajes descartados para " << username);
+        dropped = 0;
+    }
+}
+
+/**
+ * Marca al usuario como desconectado y notifica a los demás.
+ * Solo afecta la entrada del mapa si todavía pertenece a esta sesión; al
+ * pasar al directorio de desconectados el registro suelta la sesión.
+ */
+void Session::on_close() {
+    open = false;
+    closed = true;
+    batchTimer.cancel();
+    if (admitted) {
+        admitted = false;
+        live_sessions.fetch_sub(1);
+    }
+
+    // Lo que quede en la cola ya no se va a enviar; una difusión en curso
+    // puede mantener viva la sesión un rato, así que se libera ahora
+    std::size_t first = writing ? 1 : 0;
+    if (outbox.size() > first) {
+        metrics.counters.sub(OutboundQueued, outbox.size() - first);
+        outbox.erase(outbox.begin() + first, outbox.end());
+    }
+    if (userId == NO_USER) return;
+
+    if (!clients.mark_disconnected(userId, this)) return;
+
+    // Avisar a todos el cambio de estado a Desconectado (en el próximo anuncio)
+    presence_changed(userId);
+    leave_active(userId);
+
+    LOG_INFO("👋 Usuario desconectado: " << username);
+
+    print_users();
+}
+
+/**
+ * Revisa los plazos de la sesión. La llama la rueda desde su propio hilo,
+ * así que solo lee atómicos y, si hay algo que hacer, lo pasa al strand.
+ *
+ * - Sin terminar el handshake en HANDSHAKE_TICKS: se cierra.
+ * - Sin recibir nada en `latido`: ping (Beast contesta los del cliente solo).
+ * - Sin recibir nada, ni el pong, en `tiempo_muerto`: se cierra; así las
+ *   conexiones medio abiertas no quedan en línea hasta que el kernel se rinda.
+ * - Sin solicitudes en `inactivo` estando Activo: pasa a Inactivo.
+ *
+ * @param now Tick actual de la rueda
+ * @return Tick de la próxima revisión, o 0 si la sesión ya terminó
+ */
+TimerWheel::Tick Session::on_tick(TimerWheel::Tick now) {
+    if (closed) return 0;
+    TimerWheel::Tick seen = lastReceived.load(std::memory_order_relaxed);
+    auto strand = ws.get_executor();
+
+    if (!open) {
+        if (now - seen < HANDSHAKE_TICKS) return std::min(seen + HANDSHAKE_TICKS, now + first_check_ticks());
+        net::post(strand, [self = shared_from_this()] { self->close_dead(); });
+        return 0;
+    }
+
+    TimerWheel::Tick next = 0;
+    auto sooner = [&next](TimerWheel::Tick tick) {
+        if (next == 0 || tick < next) next = tick;
+    };
+
+    if (keepalive.deadSeconds > 0) {
+        if (now - seen >= keepalive.deadSeconds) {
+            net::post(strand, [self = shared_from_this()] { self->close_dead(); });
+            return 0;
         }
-    } catch (const boost::system::system_error& e) {
-        if (e.code() == boost::beast::websocket::error::closed) {
-            cout << "👋 Conexión cerrada limpiamente por " << username << endl;
+        sooner(seen + keepalive.deadSeconds);
+    }
+
+    if (keepalive.pingSeconds > 0) {
+        TimerWheel::Tick quiet = std::max(seen, pingedAt);
+        if (now - quiet >= keepalive.pingSeconds) {
+            pingedAt = quiet = now;
+            net::post(strand, [self = shared_from_this()] { self->send_ping(); });
+        }
+        sooner(quiet + keepalive.pingSeconds);
+    }
+
+    if (keepalive.idleSeconds > 0) {
+        TimerWheel::Tick request = lastRequest.load(std::memory_order_relaxed);
+        if (idleSince != request && now - request >= keepalive.idleSeconds) {
+            idleSince = request;
+            net::post(strand, [self = shared_from_this()] { self->mark_idle(); });
+        }
+        // Ya marcada: se vuelve a mirar por si llegan solicitudes nuevas
+        sooner(idleSince == request ? now + keepalive.idleSeconds : request + keepalive.idleSeconds);
+    }
+    return next;
+}
+
+/**
+ * Envía un ping al cliente, uno a la vez. Puede ir a la par de una escritura.
+ */
+void Session::send_ping() {
+    if (!open || pinging) return;
+    pinging = true;
+    metrics.counters.add(KeepalivePings);
+    ws.async_ping({}, [self = shared_from_this()](beast::error_code) {
+        self->pinging = false;
+    });
+}
+
+/**
+ * Cierra una conexión que dejó de responder (o no completó el handshake).
+ * La lectura pendiente falla y on_read/on_http_read terminan la sesión.
+ */
+void Session::close_dead() {
+    if (closed) return;
+    metrics.counters.add(DeadSessionsClosed);
+    if (open) {
+        LOG_INFO("💀 Sin respuesta de " << username << ", cerrando la conexión");
+    } else {
+        LOG_DEBUG("💀 Handshake sin completar, cerrando la conexión");
+    }
+    beast::error_code ignored;
+    beast::get_lowest_layer(ws).socket().close(ignored);
+}
+
+/**
+ * Pasa al usuario a Inactivo por no hacer solicitudes. Solo si sigue
+ * Activo: Ocupado o un Inactivo elegido por el usuario no se tocan.
+ */
+void Session::mark_idle() {
+    if (!open || userId == NO_USER) return;
+    if (!clients.replace_status(userId, 1, 3)) return;
+    autoInactive = true;
+    metrics.counters.add(IdleTransitions);
+    LOG_INFO("💤 " << username << " pasa a Inactivo por inactividad");
+    presence_changed(userId);
+    leave_active(userId);
+}
+
+
+// SO_REUSEPORT: varios sockets pueden escuchar en el mismo puerto
+using reuse_port = net::detail::socket_option::boolean<SOL_SOCKET, SO_REUSEPORT>;
+
+/**
+ * Acepta conexiones entrantes de forma asíncrona.
+ * Cada socket aceptado recibe su propio strand y se entrega a una Session.
+ *
+ * Puede haber varios Listener en el mismo puerto (con SO_REUSEPORT): el
+ * kernel reparte las conexiones nuevas entre sus colas y cada uno acepta
+ * por su cuenta, así que varios hilos pueden aceptar a la vez en lugar de
+ * turnarse un solo async_accept.
+ */
+// Espera antes de volver a aceptar cuando se acabaron los descriptores o la memoria
+constexpr auto ACCEPT_BACKOFF = std::chrono::milliseconds(100);
+
+/**
+ * Si un error de accept se debe a falta de recursos: reintentar enseguida
+ * fallaría igual, así que conviene esperar a que se libere algo.
+ */
+bool is_resource_error(const beast::error_code& ec) {
+    namespace errc = boost::system::errc;
+    return ec == errc::too_many_files_open || ec == errc::too_many_files_open_in_system ||
+           ec == errc::not_enough_memory || ec == errc::no_buffer_space;
+}
+
+class Listener : public std::enable_shared_from_this<Listener> {
+public:
+    Listener(net::io_context& ioc, tcp::endpoint endpoint, const SocketOptions& options)
+        : ioc(ioc), acceptor(ioc), retryTimer(ioc), noDelay(options.noDelay) {
+        acceptor.open(endpoint.protocol());
+        acceptor.set_option(net::socket_base::reuse_address(true));
+        if (options.reusePort) {
+            acceptor.set_option(reuse_port(true));
+        }
+        // Los buffers se fijan antes de listen() para que las conexiones los
+        // hereden y la ventana TCP se negocie con ellos
+        if (options.sendBuffer > 0) {
+            acceptor.set_option(net::socket_base::send_buffer_size(options.sendBuffer));
+        }
+        if (options.receiveBuffer > 0) {
+            acceptor.set_option(net::socket_base::receive_buffer_size(options.receiveBuffer));
+        }
+        acceptor.bind(endpoint);
+        acceptor.listen(net::socket_base::max_listen_connections);
+    }
+
+    void run() {
+        do_accept();
+    }
+
+private:
+    void do_accept() {
+        acceptor.async_accept(net::make_strand(ioc),
+            beast::bind_front_handler(&Listener::on_accept, shared_from_this()));
+    }
+
+    void on_accept(beast::error_code ec, SessionSocket socket) {
+        if (ec) {
+            if (ec == net::error::operation_aborted) return;  // Se cerró el aceptador
+            metrics.counters.add(AcceptErrors);
+            // Solo se registra el primero de una racha; el resto se cuenta en /metrics
+            if (!failing) {
+                failing = true;
+                LOG_ERROR("❌ Error aceptando conexión: " << ec.message());
+            }
+            if (is_resource_error(ec)) {
+                retryTimer.expires_after(ACCEPT_BACKOFF);
+                retryTimer.async_wait([self = shared_from_this()](beast::error_code timerEc) {
+                    if (!timerEc) self->do_accept();
+                });
+                return;
+            }
         } else {
-            cerr << "❌ Error de sistema: " << e.what() << endl;
-        }
-    } catch (const std::exception& e) {
-        cerr << "❌ Excepción: " << e.what() << endl;
-    }
-
-    // Marcar usuario como desconectado y notificar a los demás
-    {
-        std::lock_guard<std::mutex> lock(clients_mutex);
-        if (clients.find(username) != clients.end()) {
-            clients[username].status = 0;  // Estado: Desconectado
-            
-            // Notificar a todos los usuarios del cambio de estado
-            std::vector<unsigned char> stateChangeMsg;
-            stateChangeMsg.push_back(54);  // Tipo 54: Cambio de estado
-            stateChangeMsg.push_back(username.size());
-            stateChangeMsg.insert(stateChangeMsg.end(), username.begin(), username.end());
-            stateChangeMsg.push_back(0);  // Estado: Desconectado
-            
-            for (auto& [user, client] : clients) {
-                if (user != username && client.ws && client.ws->is_open()) {
-                    try {
-                        client.ws->write(net::buffer(stateChangeMsg));
-                    } catch (const std::exception& e) {
-                        cerr << "⚠️ Error al notificar desconexión a " << user << ": " << e.what() << endl;
-                    }
-                }
+            failing = false;
+            metrics.counters.add(ConnectionsAccepted);
+            if (noDelay) {
+                beast::error_code ignored;
+                socket.set_option(tcp::no_delay(true), ignored);
             }
-            
-            cout << "👋 Usuario desconectado: " << username << endl;
+            std::make_shared<Session>(std::move(socket))->run();
         }
+        do_accept();
     }
 
-    print_users();
-}
+    net::io_context& ioc;
+    tcp::acceptor acceptor;
+    net::steady_timer retryTimer;   // Espera tras un error por falta de recursos
+    bool noDelay;                   // TCP_NODELAY en cada conexión aceptada
+    bool failing = false;           // Si el último accept falló (una sola operación en curso a la vez)
+};
 
 
 /**
  * Función principal del programa.
- * Inicia el servidor WebSocket en el puerto 8080 y acepta conexiones entrantes.
+ * Lee la configuración (ver ServerConfig::usage), inicia el servidor
+ * WebSocket y atiende las conexiones con un grupo fijo de hilos que comparten
+ * el mismo io_context.
+ *
+ * La forma original sigue funcionando:
+ * ./server [hilos] [max_cola] [política] [profundidad] [memoria_mb] [dir_historial|-] [lote_us]
  */
-int main() {
+int main(int argc, char* argv[]) {
+    ServerConfig config;
+    std::string configError;
+    if (!config.parse_args(argc, argv, configError)) {
+        LOG_ERROR("❌ Configuración inválida: " << configError << " (ver ./server --help)");
+        return 1;
+    }
+    if (config.help) {
+        std::fputs(ServerConfig::usage(), stdout);
+        return 0;
+    }
+
+    Logger::instance().set_level(config.logLevel);
+    if (config.logLevel == LogLevel::Debug && LOG_COMPILE_LEVEL > 0) {
+        LOG_WARN("⚠️ El nivel debug no está compilado (usar -DLOG_COMPILE_LEVEL=0)");
+    }
+    rate_limits = config.rateLimits;
+    outbound_limits = config.outbound;
+    max_sessions = config.maxSessions;
+    max_message_bytes = config.maxMessageBytes;
+    keepalive = config.keepalive;
+    offline_retention = config.offline;
+    inbox.configure(config.inboxCapacity);
+
+    beast::error_code addressError;
+    auto address = net::ip::make_address(config.address, addressError);
+    if (addressError) {
+        LOG_ERROR("❌ Dirección inválida: " << config.address);
+        return 1;
+    }
+
     try {
-        net::io_context ioc;
-        tcp::acceptor acceptor(ioc, tcp::endpoint(tcp::v4(), 8080));
-        cout << "🌐 Servidor WebSocket en el puerto 8080...\n";
+        unsigned threads = config.threads;
+        if (threads == 0) threads = std::thread::hardware_concurrency();
+        if (threads == 0) threads = 1;
+
+        chatHistory.configure(config.historyDepth, config.historyMegabytes << 20);
+
+        if (!config.historyDir.empty()) {
+            // Historial persistente: el índice se reconstruye leyendo los segmentos
+            auto messageLog = std::make_shared<MessageLog>(config.historyDir);
+            LogStats logStats = messageLog->stats();
+            LOG_INFO("📚 Historial persistente en " << config.historyDir << ": " << logStats.records
+                     << " mensajes de " << logStats.chats << " chats en " << logStats.segments << " segmentos");
+            chatHistory.attach_log(std::move(messageLog));
+        }
+        // Después de leer el registro: los nombres que ya tenía se conservan
+        symbols.set_limit(config.maxUsers);
+
+        if (outbound_limits.batchWindowUs >= 0) {
+            LOG_INFO("📦 Agrupando mensajes para clientes v2 (ventana de "
+                     << outbound_limits.batchWindowUs << " µs)");
+        }
+
+        // Con más de un aceptador todos comparten el puerto con SO_REUSEPORT
+        std::size_t acceptors = config.acceptors == 0 ? threads : config.acceptors;
+        SocketOptions socketOptions = config.socket;
+        if (acceptors > 1) socketOptions.reusePort = true;
 
-        while (true) {
-            tcp::socket socket(ioc);
-            acceptor.accept(socket);
-            // Manejar la sesión en un hilo separado
-            thread{do_session, move(socket)}.detach();
+        net::io_context ioc{static_cast<int>(threads)};
+        for (std::size_t i = 0; i < acceptors; ++i) {
+            std::make_shared<Listener>(ioc, tcp::endpoint(address, config.port), socketOptions)->run();
+        }
+        LOG_INFO("🌐 Servidor WebSocket en " << config.address << ":" << config.port << " con "
+                 << threads << " hilos y " << acceptors << (acceptors == 1 ? " aceptador..." : " aceptadores..."));
+        if (max_sessions > 0) {
+            LOG_INFO("🚧 Máximo de " << max_sessions << " sesiones abiertas");
+        }
+        if (config.maxUsers > 0) {
+            LOG_INFO("🚧 Máximo de " << symbols.limit() << " nombres de usuario");
         }
+        LOG_INFO("💓 Latido a los " << keepalive.pingSeconds << " s, cierre a los " << keepalive.deadSeconds
+                 << " s sin respuesta, Inactivo a los " << keepalive.idleSeconds << " s (0: desactivado)");
+
+        net::steady_timer presenceTimer(ioc);
+        schedule_presence_flush(presenceTimer);
+
+        net::steady_timer sessionTimer(ioc);
+        schedule_session_ticks(sessionTimer);
+
+        // Ctrl+C o SIGTERM detienen el io_context: main termina normalmente y el
+        // logger escribe las líneas que tenga pendientes
+        net::signal_set signals(ioc, SIGINT, SIGTERM);
+        signals.async_wait([&ioc](const beast::error_code&, int signal) {
+            LOG_INFO("🛑 Señal " << signal << " recibida, deteniendo el servidor");
+            ioc.stop();
+        });
+
+        // El hilo principal también atiende el io_context
+        std::vector<std::thread> workers;
+        workers.reserve(threads - 1);
+        for (unsigned i = 1; i < threads; ++i) {
+            workers.emplace_back([&ioc]() { ioc.run(); });
+        }
+        ioc.run();
 
+        for (auto& worker : workers) {
+            worker.join();
+        }
     } catch (const exception& e) {
-        cerr << "❌ Error: " << e.what() << endl;
+        LOG_ERROR("❌ Error: " << e.what());
     }
 
     return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,106 @@
+#include <cstdio>
+#include <filesystem>
+#include <string>
+#include "MessageLog.h"
+
+namespace fs = std::filesystem;
+
+/**
+ * Pruebas del registro persistente con segmentos faltantes o que no se
+ * pueden usar: al reabrirlo, el siguiente segmento debe numerarse después
+ * del mayor en disco y las escrituras deben seguir funcionando.
+ *
+ * Uso: ./message_log_test [directorio_temporal]
+ */
+
+namespace {
+constexpr std::size_t SEGMENT_BYTES = 4096;   // Segmentos chicos: cambia de archivo cada ~30 mensajes
+int failures = 0;
+
+void check(bool ok, const std::string& what) {
+    std::printf("%s %s\n", ok ? "✅" : "❌", what.c_str());
+    if (!ok) ++failures;
+}
+
+std::string segment_name(std::size_t number) {
+    char name[32];
+    std::snprintf(name, sizeof(name), "segment-%06zu.log", number);
+    return name;
+}
+
+/**
+ * Agrega `count` mensajes al chat "~"; devuelve false si alguno falló.
+ */
+bool fill(MessageLog& log, int count, int first = 0) {
+    try {
+        for (int i = first; i < first + count; ++i) {
+            log.append("~", "ana", "mensaje " + std::to_string(i) + std::string(80, '.'));
+        }
+        return true;
+    } catch (const std::exception& e) {
+        std::printf("   excepción: %s\n", e.what());
+        return false;
+    }
+}
+
+/**
+ * Reabre el registro, escribe lo suficiente para crear segmentos nuevos y
+ * comprueba que se numeren desde `expected` y que todo se pueda leer.
+ */
+void reopen_and_write(const fs::path& dir, std::size_t expected, const std::string& name) {
+    try {
+        MessageLog log(dir.string(), SEGMENT_BYTES);
+        std::uint64_t before = log.count("~");
+        check(fill(log, 100), name + ": escribe tras reabrir");
+        check(log.count("~") == before + 100, name + ": cuenta los mensajes nuevos");
+        check(fs::is_regular_file(dir / segment_name(expected)), name + ": crea " + segment_name(expected));
+
+        std::string last;
+        log.read("~", before + 99, before + 100, [&](std::uint64_t, std::string_view, std::string_view body) {
+            last = std::string(body.substr(0, 11));
+        });
+        check(last == "mensaje 99.", name + ": lee el último mensaje");
+    } catch (const std::exception& e) {
+        check(false, name + ": abre el registro (" + e.what() + ")");
+    }
+}
+}
+
+int main(int argc, char* argv[]) {
+    fs::path root = argc > 1 ? fs::path(argv[1]) : fs::temp_directory_path() / "message_log_test";
+    fs::remove_all(root);
+
+    // Hueco: falta un segmento del medio
+    {
+        fs::path dir = root / "hueco";
+        {
+            MessageLog log(dir.string(), SEGMENT_BYTES);
+            fill(log, 100);
+        }
+        std::size_t files = std::distance(fs::directory_iterator(dir), fs::directory_iterator());
+        fs::remove(dir / segment_name(1));
+        reopen_and_write(dir, files, "hueco");
+    }
+
+    // Omitido: un segmento que no se puede abrir (un directorio con su nombre)
+    {
+        fs::path dir = root / "omitido";
+        {
+            MessageLog log(dir.string(), SEGMENT_BYTES);
+            fill(log, 10);
+        }
+        fs::create_directory(dir / segment_name(1));
+        reopen_and_write(dir, 2, "omitido");
+    }
+
+    // Ninguno se puede usar: el registro arranca vacío con un número nuevo
+    {
+        fs::path dir = root / "ninguno";
+        fs::create_directories(dir / segment_name(0));
+        reopen_and_write(dir, 1, "ninguno");
+    }
+
+    fs::remove_all(root);
+    std::printf("%s\n", failures == 0 ? "Todas las pruebas pasaron" : "Hubo fallas");
+    return failures == 0 ? 0 : 1;
+}